@@ -0,0 +1,402 @@
+#pragma once
+#ifndef LIGHT_UNIFORMS_H
+#define LIGHT_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// the uniform buffer binding point of the "Lights" block, the same for every program (the Camera block has 0)
+const GLuint LIGHT_UNIFORM_BINDING = 1;
+
+// the texture units the light arrays stay bound to, as samplerBuffers. Above the ones the scenes use for their materials,
+// GL 3.3 guarantees 16 per shader stage.
+const GLuint DIR_LIGHT_TEXTURE_UNIT = 13;
+const GLuint POINT_LIGHT_TEXTURE_UNIT = 14;
+const GLuint SPOT_LIGHT_TEXTURE_UNIT = 15;
+
+// the lights are stored as RGBA32F texels of a texture buffer: a vec3 takes one texel and a float after it fills its
+// alpha, so the scalars sit between the vectors instead of where they'd usually be written. The shaders fetch the
+// texels back into their structs member for member. cutOff and outerCutOff are cosines, like the shaders compare them.
+struct DirLight {
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float padding0 = 0.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    float padding1 = 0.0f;
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    float padding2 = 0.0f;
+    glm::vec3 specular = glm::vec3(0.0f);
+    float padding3 = 0.0f;
+};
+
+struct PointLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    float constant = 1.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    float linear = 0.0f;
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    float quadratic = 0.0f;
+    glm::vec3 specular = glm::vec3(0.0f);
+    float padding = 0.0f;
+};
+
+struct SpotLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    float cutOff = 1.0f;
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float outerCutOff = 1.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    float constant = 1.0f;
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    float linear = 0.0f;
+    glm::vec3 specular = glm::vec3(0.0f);
+    float quadratic = 0.0f;
+};
+
+// the "Lights" uniform block as the shaders declare it:
+//
+//     layout (std140) uniform Lights {
+//         int dirLightCount;
+//         int pointLightCount;
+//         int spotLightCount;
+//     };
+//
+// next to it the lights themselves are read from "uniform samplerBuffer dirLightData, pointLightData, spotLightData".
+struct LightCounts {
+    GLint dirLightCount;
+    GLint pointLightCount;
+    GLint spotLightCount;
+    GLint padding;
+};
+
+struct LightUploadStats {
+    unsigned long long uploads = 0;     // upload() calls that had something to copy
+    unsigned long long clean = 0;       // upload() calls that didn't
+    unsigned long long ranges = 0;      // glBufferData / glBufferSubData calls
+    unsigned long long bytes = 0;       // copied by them
+    unsigned int dropped = 0;           // lights past what GL_MAX_TEXTURE_BUFFER_SIZE leaves room for, not drawn
+};
+
+// the lights of one type in a texture buffer. The buffer grows with the lights, doubling so adding lights one by one
+// doesn't reallocate it every time, and only the lights that changed since the last upload get copied.
+template<typename Light>
+class LightBuffer {
+public:
+    static const size_t TEXELS = sizeof(Light) / 16;   // RGBA32F texels per light
+
+    vector<Light> lights;
+
+    unsigned int add(const Light& light) {
+        lights.push_back(light);
+        dirtyLights.push_back(0);
+        markDirty(lights.size() - 1);
+        return (unsigned int)lights.size() - 1;
+    }
+
+    // false if the light is already what it's set to
+    bool set(unsigned int index, const Light& light) {
+        if (memcmp(&lights[index], &light, sizeof(Light)) == 0)
+            return false;
+        lights[index] = light;
+        markDirty(index);
+        return true;
+    }
+
+    void clear() {
+        lights.clear();
+        dirtyLights.clear();
+        dirty = false;
+    }
+
+    // copies the first count lights to the buffer where they changed, creating or growing it (up to maxCount lights) when
+    // they don't fit. The texture is only bound, to unit, when the buffer gets allocated.
+    void upload(GLuint unit, size_t count, size_t maxCount, LightUploadStats& totals) {
+        if (buffer == 0 || count > capacity) {
+            if (buffer == 0) {
+                glGenBuffers(1, &buffer);
+                glGenTextures(1, &texture);
+            }
+            capacity = std::max(capacity * 2, count);
+            if (capacity < MIN_CAPACITY)
+                capacity = MIN_CAPACITY;
+            capacity = std::min(capacity, maxCount);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(Light), NULL, GL_DYNAMIC_DRAW);
+            if (count > 0)
+                glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(Light), lights.data());
+            attach(unit);
+            totals.ranges++;
+            totals.bytes += count * sizeof(Light);
+            clearDirty(0, dirtyLights.size());
+            dirty = false;
+            return;
+        }
+        if (!dirty)
+            return;
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        size_t light = firstDirty;
+        size_t last = std::min(lastDirty + 1, count);
+        while (light < last) {
+            if (!dirtyLights[light]) {
+                light++;
+                continue;
+            }
+            // a clean light between two dirty ones is cheaper to copy along than to split the range for
+            size_t start = light, end = light + 1;
+            for (size_t next = end; next < last && next - end <= MERGE_GAP_LIGHTS; next++) {
+                if (dirtyLights[next])
+                    end = next + 1;
+            }
+            glBufferSubData(GL_TEXTURE_BUFFER, start * sizeof(Light), (end - start) * sizeof(Light), &lights[start]);
+            totals.ranges++;
+            totals.bytes += (end - start) * sizeof(Light);
+            clearDirty(start, end);
+            light = end;
+        }
+        dirty = false;
+    }
+
+    bool isDirty() const {
+        return dirty || buffer == 0;
+    }
+
+    void shutdown() {
+        if (texture != 0)
+            glDeleteTextures(1, &texture);
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        texture = buffer = 0;
+        capacity = 0;
+    }
+
+private:
+    static const size_t MIN_CAPACITY = 16;
+    static const size_t MERGE_GAP_LIGHTS = 1;
+
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t capacity = 0;                        // lights the buffer has room for
+    vector<unsigned char> dirtyLights;          // one per light
+    bool dirty = false;
+    size_t firstDirty = 0;                      // the dirty lights lie between these two, when dirty
+    size_t lastDirty = 0;
+
+    void markDirty(size_t index) {
+        dirtyLights[index] = 1;
+        if (!dirty || index < firstDirty)
+            firstDirty = index;
+        if (!dirty || index > lastDirty)
+            lastDirty = index;
+        dirty = true;
+    }
+
+    void clearDirty(size_t start, size_t end) {
+        if (end > start)
+            memset(dirtyLights.data() + start, 0, end - start);
+    }
+
+    // glTexBuffer works on the texture bound to the active unit, the previous unit is restored so state caches
+    // like GLStateCache don't lose track of it
+    void attach(GLuint unit) {
+        GLint previousUnit = GL_TEXTURE0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previousUnit);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        glActiveTexture((GLenum)previousUnit);
+    }
+};
+
+// every light of the scene in texture buffers, instead of a set of "light[i].member" uniforms per light set on each
+// program every frame. The shaders loop up to the counts in the Lights block, so the number of lights is no longer a
+// #define, and as the lights don't live in the uniform block it isn't held to GL_MAX_UNIFORM_BLOCK_SIZE either: a texture
+// buffer takes at least 65536 texels, over 13000 spot lights.
+//
+// the lights are kept on the CPU laid out like the buffers. Setting a light only marks it dirty when it actually
+// changed, and upload() copies just the dirty ranges, so lights that stay put are uploaded once and a flashlight that
+// follows the camera costs one small glBufferSubData a frame. The buffers stay bound to their texture units and the
+// counts to LIGHT_UNIFORM_BINDING, so drawing with the lights never binds anything either.
+//
+// GLSL 3.30 can't give a block a binding or a sampler a unit in the shader, so attach() every program that uses the lights
+// once after it's linked. Call upload() before the draws of a frame, only from the thread that owns the GL context, and
+// shutdown() before the context goes away.
+class LightUniforms {
+public:
+    static LightUniforms& instance() {
+        static LightUniforms uniforms;
+        return uniforms;
+    }
+
+    LightUniforms(const LightUniforms&) = delete;
+    LightUniforms& operator=(const LightUniforms&) = delete;
+
+    // points the program's Lights block at LIGHT_UNIFORM_BINDING and its light samplers at their units. Programs without
+    // them are left alone. Uses the program to set the samplers, the one in use before is restored.
+    void attach(unsigned int program) {
+        GLuint index = glGetUniformBlockIndex(program, "Lights");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, LIGHT_UNIFORM_BINDING);
+
+        GLint previousProgram = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glUseProgram(program);
+        setSampler(program, "dirLightData", DIR_LIGHT_TEXTURE_UNIT);
+        setSampler(program, "pointLightData", POINT_LIGHT_TEXTURE_UNIT);
+        setSampler(program, "spotLightData", SPOT_LIGHT_TEXTURE_UNIT);
+        glUseProgram((GLuint)previousProgram);
+    }
+
+    // the add functions return the index of the new light, for setting it later
+    unsigned int addDirLight(const DirLight& light) {
+        return dirLights.add(light);
+    }
+
+    unsigned int addPointLight(const PointLight& light) {
+        return pointLights.add(light);
+    }
+
+    unsigned int addSpotLight(const SpotLight& light) {
+        return spotLights.add(light);
+    }
+
+    // setting a light to what it already is doesn't upload anything, so it's fine to set lights every frame
+    void setDirLight(unsigned int index, const DirLight& light) {
+        set(dirLights, index, light);
+    }
+
+    void setPointLight(unsigned int index, const PointLight& light) {
+        set(pointLights, index, light);
+    }
+
+    void setSpotLight(unsigned int index, const SpotLight& light) {
+        set(spotLights, index, light);
+    }
+
+    const DirLight& dirLight(unsigned int index) const { return dirLights.lights[index]; }
+    const PointLight& pointLight(unsigned int index) const { return pointLights.lights[index]; }
+    const SpotLight& spotLight(unsigned int index) const { return spotLights.lights[index]; }
+
+    unsigned int dirLightCount() const { return (unsigned int)dirLights.lights.size(); }
+    unsigned int pointLightCount() const { return (unsigned int)pointLights.lights.size(); }
+    unsigned int spotLightCount() const { return (unsigned int)spotLights.lights.size(); }
+
+    // removes every light, only the counts have to be uploaded again
+    void clear() {
+        dirLights.clear();
+        pointLights.clear();
+        spotLights.clear();
+    }
+
+    // copies the changed lights and counts to their buffers, creating them on the first call
+    void upload() {
+        if (countBuffer == 0) {
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+            maxTexels = std::max(maxTexels, (GLint)65536);      // what GL 3.3 promises at least
+
+            glGenBuffers(1, &countBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, countBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(LightCounts), NULL, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_UNIFORM_BINDING, countBuffer);
+            uploaded.dirLightCount = uploaded.pointLightCount = uploaded.spotLightCount = -1;
+        }
+
+        // lights the texture buffers have no room for are left out of the counts
+        LightCounts counts = {};
+        counts.dirLightCount = (GLint)fitting(dirLights);
+        counts.pointLightCount = (GLint)fitting(pointLights);
+        counts.spotLightCount = (GLint)fitting(spotLights);
+        unsigned int dropped = (dirLightCount() - counts.dirLightCount) + (pointLightCount() - counts.pointLightCount) +
+                               (spotLightCount() - counts.spotLightCount);
+        if (dropped != 0 && totals.dropped == 0)
+            std::cout << "ERROR::LIGHT_UNIFORMS::" << dropped << " LIGHTS DON'T FIT INTO GL_MAX_TEXTURE_BUFFER_SIZE " << maxTexels << std::endl;
+        totals.dropped = dropped;
+
+        bool countsChanged = memcmp(&counts, &uploaded, sizeof(LightCounts)) != 0;
+        if (!countsChanged && !dirLights.isDirty() && !pointLights.isDirty() && !spotLights.isDirty()) {
+            totals.clean++;
+            return;
+        }
+
+        dirLights.upload(DIR_LIGHT_TEXTURE_UNIT, (size_t)counts.dirLightCount, maxLights(dirLights), totals);
+        pointLights.upload(POINT_LIGHT_TEXTURE_UNIT, (size_t)counts.pointLightCount, maxLights(pointLights), totals);
+        spotLights.upload(SPOT_LIGHT_TEXTURE_UNIT, (size_t)counts.spotLightCount, maxLights(spotLights), totals);
+        if (countsChanged) {
+            glBindBuffer(GL_UNIFORM_BUFFER, countBuffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightCounts), &counts);
+            uploaded = counts;
+            totals.ranges++;
+            totals.bytes += sizeof(LightCounts);
+        }
+        totals.uploads++;
+    }
+
+    const LightUploadStats& stats() const {
+        return totals;
+    }
+
+    void resetStats() {
+        totals = LightUploadStats();
+    }
+
+    void printStats() const {
+        std::cout << "LIGHT_UNIFORMS::STATS " << dirLightCount() << " directional, " << pointLightCount() << " point, "
+                  << spotLightCount() << " spot lights, " << totals.uploads << " uploads (" << totals.clean << " with nothing to upload), "
+                  << totals.bytes << " bytes in " << totals.ranges << " ranges, " << totals.dropped << " lights dropped" << std::endl;
+    }
+
+    // deletes the buffers, the lights stay and are uploaded whole by the next upload()
+    void shutdown() {
+        dirLights.shutdown();
+        pointLights.shutdown();
+        spotLights.shutdown();
+        if (countBuffer != 0)
+            glDeleteBuffers(1, &countBuffer);
+        countBuffer = 0;
+    }
+
+private:
+    LightBuffer<DirLight> dirLights;
+    LightBuffer<PointLight> pointLights;
+    LightBuffer<SpotLight> spotLights;
+    GLuint countBuffer = 0;
+    LightCounts uploaded = {};                  // what the count buffer holds
+    GLint maxTexels = 0;                        // GL_MAX_TEXTURE_BUFFER_SIZE
+    LightUploadStats totals;
+
+    LightUniforms() {}
+
+    template<typename Light>
+    void set(LightBuffer<Light>& buffer, unsigned int index, const Light& light) {
+        if (index >= buffer.lights.size()) {
+            std::cout << "ERROR::LIGHT_UNIFORMS::NO LIGHT " << index << ", THERE ARE " << buffer.lights.size() << std::endl;
+            return;
+        }
+        buffer.set(index, light);
+    }
+
+    // how many lights of the type a texture buffer can hold
+    template<typename Light>
+    size_t maxLights(const LightBuffer<Light>&) const {
+        return (size_t)maxTexels / LightBuffer<Light>::TEXELS;
+    }
+
+    template<typename Light>
+    size_t fitting(const LightBuffer<Light>& buffer) const {
+        return std::min(buffer.lights.size(), maxLights(buffer));
+    }
+
+    static void setSampler(unsigned int program, const char* name, GLuint unit) {
+        GLint location = glGetUniformLocation(program, name);
+        if (location != -1)
+            glUniform1i(location, (GLint)unit);
+    }
+};
+
+#endif // !LIGHT_UNIFORMS_H
@@ -11,6 +11,10 @@
 
 #include <cmath> 
 #include "stb_image.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+#include "CameraUniforms.h"
+#include "LightUniforms.h"
 #include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -40,6 +44,10 @@ float lastFrame = 0.0f;
 // escape button
 bool escPressed = false;
 
+// F1 switches the once a second stats printing on and off, it starts off
+bool printStats = false;
+bool statsKeyDown = false;
+
 // NEXT STEPS
 // add a translucent cone representing the cone of light (create another shaders)
 // create a cube of little kamala harris' being abducted by obamids
@@ -79,7 +87,7 @@ int main()
     gladLoadGL(); // load the needed configurations (GLAD) for openGL
 
     // ENABLE DEPTH AND BLENDING (blend for transparency)
-    glEnable(GL_DEPTH_TEST);  
+    GLStateCache::instance().enable(GL_DEPTH_TEST);  
     //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); 
 
 
@@ -88,6 +96,12 @@ int main()
     Shader lightShader("lightShader.vts", "lightShader.fts");
     Shader coneShader("coneShaders.vts", "coneShaders.fts");
 
+    // all three read view, projection and the camera position from the one Camera uniform block
+    CameraUniforms& cameraUniforms = CameraUniforms::instance();
+    cameraUniforms.attach(ourShader.ID);
+    cameraUniforms.attach(lightShader.ID);
+    cameraUniforms.attach(coneShader.ID);
+
     // Set vertices for triangle
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -422,6 +436,42 @@ int main()
     }
 
 
+    // every bind, program switch and depth/blend change in the loop goes through the state cache, which skips the ones
+    // that wouldn't change anything and counts both
+    GLStateCache& glState = GLStateCache::instance();
+    float lastStateReport = 0.0f;
+
+    // the draws of a frame, executed sorted instead of in the order they are submitted
+    RenderQueue renderQueue;
+    glm::mat4 view = glm::mat4(1.0f);
+
+    // the moon and a spot light over each obamid, all in LightUniforms' buffers. They never move, so they're set once here
+    // and uploaded by the first lights.upload() in the loop
+    LightUniforms& lights = LightUniforms::instance();
+    lights.attach(ourShader.ID);
+
+    DirLight moon;
+    moon.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    moon.ambient = glm::vec3(0.25f, 0.25f, 0.2f);
+    lights.addDirLight(moon);
+
+    // each obamid gets its own inner and outer cone, in degrees
+    float obamaLightCutOffs[] = { 7.5f, 6.5f, 8.5f };
+    float obamaLightOuterCutOffs[] = { 26.0f, 28.0f, 22.0f };
+    for (unsigned int i = 0; i < 3; i++) {
+        SpotLight obamaLight;
+        obamaLight.position = obamidLocations[i];
+        // straight down. The old per frame setVec3 misspelled this one as "obamalight", so before LightUniforms the shader
+        // got a zero direction, normalize() of which is undefined, and the spot cones mostly didn't show at all
+        obamaLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        obamaLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+        obamaLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.cutOff = glm::cos(glm::radians(obamaLightCutOffs[i]));
+        obamaLight.outerCutOff = glm::cos(glm::radians(obamaLightOuterCutOffs[i]));
+        lights.addSpotLight(obamaLight);
+    }
+
     // render loop
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
     while (!glfwWindowShouldClose(window)) {
@@ -431,6 +481,14 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // print how many state changes the last frame issued and skipped, about once a second while F1 has it on. The counts
+        // are kept either way, glState.lastFrameStats() has them
+        glState.beginFrame();
+        if (printStats && currentFrame - lastStateReport >= 1.0f) {
+            glState.printStats();
+            lastStateReport = currentFrame;
+        }
+
         // input
         // -----
         processInput(window);
@@ -443,144 +501,72 @@ int main()
         // create obamaids
         // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-        // bind the texture
-        glBindTexture(GL_TEXTURE_2D, triangleTexture);
-
         // activate shader
-        ourShader.use();
-        ourShader.setVec3("viewPos", camera.Position);
+        glState.useProgram(ourShader.ID);
 
-        // set up moon light
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-        ourShader.setVec3("moon.direction", -0.2f, -1.0f, -0.3f);
-        ourShader.setVec3("moon.ambient", 0.25f, 0.25f, 0.2f);
-        
-        // set up spot light
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
+        // the lights are set up before the loop and don't change, so after the first frame this uploads nothing
+        lights.upload();
 
 
-        // spot light one
-        ourShader.setVec3("obamaLight[0].position", obamidLocations[0]);
-        ourShader.setVec3("obamalight[0].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[0].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[0].cutOff", glm::cos(glm::radians(7.5f)));
-        ourShader.setFloat("obamaLight[0].outerCutOff", glm::cos(glm::radians(26.0f)));
-
-        // spot light two
-        ourShader.setVec3("obamaLight[1].position", obamidLocations[1]);
-        ourShader.setVec3("obamalight[1].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[1].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[1].cutOff", glm::cos(glm::radians(6.5f)));
-        ourShader.setFloat("obamaLight[1].outerCutOff", glm::cos(glm::radians(28.0f)));
-
-        // spot light three
-        ourShader.setVec3("obamaLight[2].position", obamidLocations[2]);  
-        ourShader.setVec3("obamalight[2].direction", 0.0f, -1.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].ambient", 0.0f, 0.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].diffuse", 1.0f, 1.0f, 1.0f); 
-        ourShader.setVec3("obamaLight[2].specular", 1.0f, 1.0f, 1.0f); 
-        ourShader.setFloat("obamaLight[2].cutOff", glm::cos(glm::radians(8.5f))); 
-        ourShader.setFloat("obamaLight[2].outerCutOff", glm::cos(glm::radians(22.0f))); 
-        
-
-       // create sand plane
-       // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
+        // per frame uniforms, set once. The per draw "model" and "normalMatrix" are set by the render queue
+        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
         // projection transformation
         glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f); 
-        ourShader.setMat4("projection", projection);
 
-        // view transformation
-        glm::mat4 view = glm::mat4(1.0f); 
+        // view transformation, frozen while the cursor is released
         if (escPressed == false) {
             view = camera.getViewMatrix();
-            ourShader.setMat4("view", view);
         }
 
-        // bind the sand/floor texture
-        glActiveTexture(GL_TEXTURE0);  
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
+        // one upload for all three programs
+        cameraUniforms.update(view, projection, camera.Position, currentFrame);
 
-        // bind the floor vertex array object
-        glBindVertexArray(FloorVAO);
-
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1.0f)); 
-        model = glm::scale(model, glm::vec3(3.0f, 1.0f, 3.0f)); 
-
-        ourShader.setMat4("model", model);
-
-        // send in normal uniform to shaders
-        glm::mat3 normalMatrix = glm::mat3(transpose(inverse(view * model)));
-        ourShader.setMat3("normalMatrix", normalMatrix); 
-        
-        // draw sand/floor plane
-        glDrawArrays(GL_TRIANGLES, 0, 6); 
+        ourShader.setFloat("material.shininess", 16.0f);
 
+        glState.useProgram(lightShader.ID);
+        lightShader.setVec3("lightColour", 0.5f, 0.5f, 0.5f);
 
-        // set up obamid shaders (which is the light source)
+        // submit every draw of the frame, the queue sorts them by program, texture and vertex array (and front to back)
+        // and draws the transparent cone last
         // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
+        renderQueue.clear();
 
-        lightShader.use(); 
-
-        // projection transformations
-        lightShader.setMat4("projection", projection); 
+        // sand plane
+        DrawPacket floorPacket;
+        floorPacket.program = ourShader.ID;
+        floorPacket.vao = FloorVAO;
+        floorPacket.texture = floorTexture;
+        floorPacket.count = 6;
 
-        // view transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix(); 
-            lightShader.setMat4("view", view);
-        }
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1.0f)); 
+        model = glm::scale(model, glm::vec3(3.0f, 1.0f, 3.0f)); 
+        renderQueue.submit(floorPacket, model, RenderQueue::viewDepth(view, model));
 
-        // BIND vertex array object and obama texture to object
-        glBindVertexArray(VAO); 
-        glActiveTexture(GL_TEXTURE0); 
-        glBindTexture(GL_TEXTURE_2D, triangleTexture); 
+        // obamids (the light sources)
+        DrawPacket obamidPacket;
+        obamidPacket.program = lightShader.ID;
+        obamidPacket.vao = VAO;
+        obamidPacket.texture = triangleTexture;
+        obamidPacket.count = 18;
 
         for (int i = 0; i < 3; i++) {
-            // set up world transformations for each model (obamid)
-            lightShader.setVec3("lightColour", 0.5f, 0.5f, 0.5f);
-
-            glm::mat4 model = glm::mat4(1.0f); 
-
+            model = glm::mat4(1.0f); 
             model = glm::translate(model, obamidLocations[i]); 
             model = glm::rotate(model, (float)glfwGetTime() * glm::radians(-75.0f), glm::vec3(0.0f, 1.0f, 0.0f));  
-
-            lightShader.setMat4("model", model); 
-             
-            glDepthMask(GL_TRUE);  
-            glDrawArrays(GL_TRIANGLES, 0, 18);
-
+            renderQueue.submit(obamidPacket, model, RenderQueue::viewDepth(view, model));
         }
-        
-        // set up kamala kube
-       // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-        ourShader.use();
-        ourShader.setFloat("material.shininess", 16.0f);
-        ourShader.setVec3("viewPos", camera.Position);
-
-        ourShader.setMat4("projection", projection);
-
-        // view transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix();
-            lightShader.setMat4("view", view);
-        }
-         
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, kamalaTexture);
+        // kamala kubes
+        DrawPacket kubePacket;
+        kubePacket.program = ourShader.ID;
+        kubePacket.vao = cubeVAO;
+        kubePacket.texture = kamalaTexture;
+        kubePacket.count = 36;
 
         for (int i = 0; i < 3; i++) {   
-
             model = glm::mat4(1.0f);
-
             model = glm::translate(model, hoverLocations[i]);
 
             if (i == 0) {
@@ -594,44 +580,24 @@ int main()
             }
 
             model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-
-            ourShader.setMat4("model", model);
-
-            ourShader.setMat3("normalMatrix", normalMatrix);
-             
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        }
-
-        
-        // cone
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-        coneShader.use();
-        coneShader.setMat4("projection", projection);
-      
-        // view transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix();
-            coneShader.setMat4("view", view);
+            renderQueue.submit(kubePacket, model, RenderQueue::viewDepth(view, model));
         }
 
-        glBindVertexArray(coneVAO);
+        // cone, blended without depth writes after everything opaque
+        DrawPacket conePacket;
+        conePacket.pass = RENDER_PASS_TRANSPARENT;
+        conePacket.program = coneShader.ID;
+        conePacket.vao = coneVAO;
+        conePacket.mode = GL_TRIANGLE_FAN;
+        conePacket.count = coneVertices.size() / 7;
 
         model = glm::mat4(1.0f);
-
         model = glm::translate(model, glm::vec3(-1.5f, -2.0f, 0.0f));
-
         model = glm::scale(model, glm::vec3(1.8f, 3.5f, 1.8f));
+        renderQueue.submit(conePacket, model, RenderQueue::viewDepth(view, model));
 
-        coneShader.setMat4("model", model);
-
-        glEnable(GL_BLEND);
-        glDepthMask(GL_FALSE);  
-
-        glDrawArrays(GL_TRIANGLE_FAN, 0, coneVertices.size() / 7);
-       
-        glDisable(GL_BLEND);
-        glDepthMask(GL_TRUE);
+        renderQueue.sort();
+        renderQueue.execute(view);
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -653,6 +619,9 @@ int main()
     glDeleteVertexArrays(1, &coneVAO);
     glDeleteBuffers(1, &coneVBO);
 
+    cameraUniforms.shutdown();
+    lights.shutdown();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -679,6 +648,12 @@ void processInput(GLFWwindow* window)
         escPressed = false;
     }
 
+    // F1 switches the stats printing, only on the press, not every frame it's held
+    bool statsKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+        printStats = !printStats;
+    statsKeyDown = statsKey;
+
 
     if (escPressed == false) {
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
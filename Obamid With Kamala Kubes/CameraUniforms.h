@@ -0,0 +1,92 @@
+#pragma once
+#ifndef CAMERA_UNIFORMS_H
+#define CAMERA_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+using namespace std;
+
+// the uniform buffer binding point of the "Camera" block, the same for every program
+const GLuint CAMERA_UNIFORM_BINDING = 0;
+
+// the "Camera" uniform block as the shaders declare it, std140 layout:
+//
+//     layout (std140) uniform Camera {
+//         mat4 view;
+//         mat4 projection;
+//         mat4 viewProjection;
+//         vec3 cameraPosition;
+//         float time;
+//     };
+//
+// the float fills the rest of the vec3's 16 bytes, so the block is 208 bytes with no padding, like the struct.
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 position;
+    float time;
+};
+
+// the per frame camera data every shader program reads from one uniform buffer, instead of "view" / "projection" /
+// "viewPos" uniforms set on each program every frame.
+//
+// update() computes viewProjection and uploads the whole block with a single glBufferSubData, once a frame, however many
+// programs draw with it. GLSL 3.30 can't give a block a binding in the shader, so attach() every program that declares the
+// block once after it's linked. The buffer stays bound to CAMERA_UNIFORM_BINDING, nothing else may use that binding point.
+// Only use it from the thread that owns the GL context, and call shutdown() before the context goes away.
+class CameraUniforms {
+public:
+    static CameraUniforms& instance() {
+        static CameraUniforms uniforms;
+        return uniforms;
+    }
+
+    CameraUniforms(const CameraUniforms&) = delete;
+    CameraUniforms& operator=(const CameraUniforms&) = delete;
+
+    // points the program's Camera block at CAMERA_UNIFORM_BINDING, programs without the block are left alone
+    void attach(unsigned int program) {
+        GLuint index = glGetUniformBlockIndex(program, "Camera");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, CAMERA_UNIFORM_BINDING);
+    }
+
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position, float time) {
+        block.view = view;
+        block.projection = projection;
+        block.viewProjection = projection * view;
+        block.position = position;
+        block.time = time;
+
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &block, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, buffer);
+            return;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+    }
+
+    // what the last update() uploaded, for CPU code that needs the same matrices (culling, sort depths)
+    const CameraBlock& current() const {
+        return block;
+    }
+
+    void shutdown() {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+private:
+    GLuint buffer = 0;
+    CameraBlock block = CameraBlock();
+
+    CameraUniforms() {}
+};
+
+#endif // !CAMERA_UNIFORMS_H
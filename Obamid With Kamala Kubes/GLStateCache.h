@@ -0,0 +1,204 @@
+#pragma once
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+using namespace std;
+
+struct GLStateStats {
+    unsigned int issued;    // state changes that reached GL
+    unsigned int elided;    // state changes skipped because GL already had that state
+};
+
+// remembers the GL state the program set last and skips calls that wouldn't change anything: the bound program, vertex
+// array, active texture unit, 2D texture per unit, depth mask and the blend / depth test / face culling switches.
+//
+// the cache only knows about calls that go through it. Until a piece of state has been set through the cache it counts as
+// unknown and the first call always goes to GL. Code that changes tracked state behind its back has to call invalidate(),
+// and deleting a texture or vertex array that may be bound has to be reported with forgetTexture() / forgetVertexArray()
+// (GL unbinds deleted objects, and a new object could get the same name). Only use it from the thread that owns the context.
+class GLStateCache {
+public:
+    static GLStateCache& instance() {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    GLStateCache(const GLStateCache&) = delete;
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    void useProgram(GLuint program) {
+        if (program == boundProgram) {
+            frame.elided++;
+            return;
+        }
+        glUseProgram(program);
+        boundProgram = program;
+        frame.issued++;
+    }
+
+    void bindVertexArray(GLuint vao) {
+        if (vao == boundVertexArray) {
+            frame.elided++;
+            return;
+        }
+        glBindVertexArray(vao);
+        boundVertexArray = vao;
+        frame.issued++;
+    }
+
+    // unit is GL_TEXTURE0 + i, like glActiveTexture
+    void activeTexture(GLenum unit) {
+        if (unit == activeUnit) {
+            frame.elided++;
+            return;
+        }
+        glActiveTexture(unit);
+        activeUnit = unit;
+        frame.issued++;
+    }
+
+    // binds to the active unit. Only GL_TEXTURE_2D is tracked, other targets always go through.
+    void bindTexture(GLenum target, GLuint texture) {
+        unsigned int unit = activeUnit - GL_TEXTURE0;
+        if (target != GL_TEXTURE_2D || activeUnit == UNKNOWN || unit >= MAX_TEXTURE_UNITS) {
+            glBindTexture(target, texture);
+            frame.issued++;
+            return;
+        }
+        if (boundTextures[unit] == texture) {
+            frame.elided++;
+            return;
+        }
+        glBindTexture(target, texture);
+        boundTextures[unit] = texture;
+        frame.issued++;
+    }
+
+    // both in one go, the usual way a texture gets bound for drawing. If the unit already has the texture the active unit
+    // is left alone as well, so meshes sharing their textures don't switch units back and forth.
+    void bindTexture(GLenum unit, GLenum target, GLuint texture) {
+        if (target == GL_TEXTURE_2D && unit - GL_TEXTURE0 < MAX_TEXTURE_UNITS && boundTextures[unit - GL_TEXTURE0] == texture) {
+            frame.elided += 2;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    void depthMask(GLboolean enabled) {
+        int value = enabled ? 1 : 0;
+        if (value == depthWrites) {
+            frame.elided++;
+            return;
+        }
+        glDepthMask(enabled);
+        depthWrites = value;
+        frame.issued++;
+    }
+
+    void enable(GLenum capability) {
+        setCapability(capability, true);
+    }
+
+    void disable(GLenum capability) {
+        setCapability(capability, false);
+    }
+
+    // forgets everything, the next call for each piece of state goes to GL again
+    void invalidate() {
+        boundProgram = boundVertexArray = activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+            boundTextures[i] = UNKNOWN;
+        depthWrites = -1;
+        for (unsigned int i = 0; i < CAPABILITY_COUNT; i++)
+            capabilities[i] = -1;
+    }
+
+    // call after glDeleteTextures, GL has unbound the texture from every unit it was on
+    void forgetTexture(GLuint texture) {
+        for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+            if (boundTextures[i] == texture)
+                boundTextures[i] = 0;
+        }
+    }
+
+    // call after glDeleteVertexArrays
+    void forgetVertexArray(GLuint vao) {
+        if (boundVertexArray == vao)
+            boundVertexArray = 0;
+    }
+
+    // the vertex array bound through the cache, 0xFFFFFFFF while unknown
+    GLuint vertexArray() const {
+        return boundVertexArray;
+    }
+
+    // starts counting a new frame, the counts of the one before stay available through lastFrameStats()
+    void beginFrame() {
+        lastFrame = frame;
+        frame = GLStateStats();
+    }
+
+    const GLStateStats& frameStats() const {
+        return frame;
+    }
+
+    const GLStateStats& lastFrameStats() const {
+        return lastFrame;
+    }
+
+    void printStats() const {
+        unsigned int total = lastFrame.issued + lastFrame.elided;
+        std::cout << "GL_STATE::STATS " << lastFrame.issued << " state changes issued, " << lastFrame.elided << " elided ("
+                  << (total ? 100.0 * lastFrame.elided / total : 0.0) << "%) last frame" << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+    static const unsigned int CAPABILITY_COUNT = 3;
+
+    GLuint boundProgram;
+    GLuint boundVertexArray;
+    GLenum activeUnit;
+    GLuint boundTextures[MAX_TEXTURE_UNITS];
+    int depthWrites;                        // -1 unknown, 0 / 1
+    int capabilities[CAPABILITY_COUNT];     // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, -1 unknown
+
+    GLStateStats frame = GLStateStats();
+    GLStateStats lastFrame = GLStateStats();
+
+    GLStateCache() {
+        invalidate();
+    }
+
+    static int capabilityIndex(GLenum capability) {
+        switch (capability) {
+        case GL_BLEND: return 0;
+        case GL_DEPTH_TEST: return 1;
+        case GL_CULL_FACE: return 2;
+        default: return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, bool enabled) {
+        int index = capabilityIndex(capability);
+        if (index >= 0 && capabilities[index] == (enabled ? 1 : 0)) {
+            frame.elided++;
+            return;
+        }
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (index >= 0)
+            capabilities[index] = enabled ? 1 : 0;
+        frame.issued++;
+    }
+};
+
+#endif // !GL_STATE_CACHE_H
@@ -11,6 +11,10 @@
 
 #include <cmath> 
 #include "stb_image.h"
+#include "GLStateCache.h"
+#include "InstanceBuffer.h"
+#include "CameraUniforms.h"
+#include "LightUniforms.h"
 
 //#include <windef.h>
 //#include <gl/GLU.h>
@@ -39,6 +43,10 @@ float lastFrame = 0.0f;
 // escape button
 bool escPressed = false;
 
+// F1 switches the once a second stats printing on and off, it starts off
+bool printStats = false;
+bool statsKeyDown = false;
+
 // NEXT STEPS
 // add a translucent cone representing the cone of light (create another shaders)
 // create a cube of little kamala harris' being abducted by obamids
@@ -77,12 +85,18 @@ int main()
 
     gladLoadGL(); // load the needed configurations (GLAD) for openGL
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::instance().enable(GL_DEPTH_TEST);
 
 
     // build and compile the shader program
-    Shader ourShader("shader.vts", "shader.fts");
-    Shader lightShader("lightShader.vts", "lightShader.fts");
+    // the instanced variants take the model (and normal) matrices from an InstanceBuffer
+    Shader ourShader("shaderInstanced.vts", "shader.fts");
+    Shader lightShader("lightShaderInstanced.vts", "lightShader.fts");
+
+    // both read view, projection and the camera position from the one Camera uniform block
+    CameraUniforms& cameraUniforms = CameraUniforms::instance();
+    cameraUniforms.attach(ourShader.ID);
+    cameraUniforms.attach(lightShader.ID);
 
     // Set vertices for triangle
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -282,6 +296,28 @@ int main()
     glEnableVertexAttribArray(2);
 
 
+    // instances: every copy of an object is drawn with one instanced draw call, the matrices come from these buffers
+    // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+    // the sand plane doesn't move, its one instance is uploaded once
+    InstanceBuffer floorInstance(INSTANCE_NORMAL_MATRIX);
+    floorInstance.attach(FloorVAO);
+    glm::mat4 floorModel = glm::mat4(1.0f);
+    floorModel = glm::translate(floorModel, glm::vec3(0.0f, 0.0f, -1.0f));
+    floorModel = glm::scale(floorModel, glm::vec3(3.0f, 1.0f, 3.0f));
+    floorInstance.add(floorModel);
+
+    // the obamids and kamala kubes spin, their matrices are set again every frame
+    InstanceBuffer obamidInstances;
+    obamidInstances.attach(VAO);
+    InstanceBuffer kubeInstances(INSTANCE_NORMAL_MATRIX);
+    kubeInstances.attach(cubeVAO);
+    for (int i = 0; i < 3; i++) {
+        obamidInstances.add(glm::mat4(1.0f));
+        kubeInstances.add(glm::mat4(1.0f));
+    }
+
+
 
     // texture:
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -380,6 +416,41 @@ int main()
     }
 
 
+    // every bind, program switch and depth/blend change in the loop goes through the state cache, which skips the ones
+    // that wouldn't change anything and counts both
+    GLStateCache& glState = GLStateCache::instance();
+    float lastStateReport = 0.0f;
+
+    // the view stays where it was while the cursor is released
+    glm::mat4 view = glm::mat4(1.0f);
+
+    // the moon and a spot light over each obamid, all in LightUniforms' buffers. They never move, so they're set once here
+    // and uploaded by the first lights.upload() in the loop
+    LightUniforms& lights = LightUniforms::instance();
+    lights.attach(ourShader.ID);
+
+    DirLight moon;
+    moon.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    moon.ambient = glm::vec3(0.25f, 0.25f, 0.2f);
+    lights.addDirLight(moon);
+
+    // each obamid gets its own inner and outer cone, in degrees
+    float obamaLightCutOffs[] = { 7.5f, 6.5f, 8.5f };
+    float obamaLightOuterCutOffs[] = { 26.0f, 28.0f, 22.0f };
+    for (unsigned int i = 0; i < 3; i++) {
+        SpotLight obamaLight;
+        obamaLight.position = obamidLocations[i];
+        // straight down. The old per frame setVec3 misspelled this one as "obamalight", so before LightUniforms the shader
+        // got a zero direction, normalize() of which is undefined, and the spot cones mostly didn't show at all
+        obamaLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        obamaLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+        obamaLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.cutOff = glm::cos(glm::radians(obamaLightCutOffs[i]));
+        obamaLight.outerCutOff = glm::cos(glm::radians(obamaLightOuterCutOffs[i]));
+        lights.addSpotLight(obamaLight);
+    }
+
     // render loop
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
     while (!glfwWindowShouldClose(window)) {
@@ -389,6 +460,14 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // print how many state changes the last frame issued and skipped, about once a second while F1 has it on. The counts
+        // are kept either way, glState.lastFrameStats() has them
+        glState.beginFrame();
+        if (printStats && currentFrame - lastStateReport >= 1.0f) {
+            glState.printStats();
+            lastStateReport = currentFrame;
+        }
+
         // input
         // -----
         processInput(window);
@@ -398,144 +477,77 @@ int main()
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // create obamaids
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-
-        // bind the texture
-        glBindTexture(GL_TEXTURE_2D, triangleTexture);
-
-        // activate shader
-        ourShader.use();
-        ourShader.setVec3("viewPos", camera.Position);
-
-        // set up moon light
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-        ourShader.setVec3("moon.direction", -0.2f, -1.0f, -0.3f);
-        ourShader.setVec3("moon.ambient", 0.25f, 0.25f, 0.2f);
-        
-        // set up spot light
+        // camera for every shader, one upload a frame
         // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-
-        // spot light one
-        ourShader.setVec3("obamaLight[0].position", obamidLocations[0]);
-        ourShader.setVec3("obamalight[0].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[0].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[0].cutOff", glm::cos(glm::radians(7.5f)));
-        ourShader.setFloat("obamaLight[0].outerCutOff", glm::cos(glm::radians(26.0f)));
-
-        // spot light two
-        ourShader.setVec3("obamaLight[1].position", obamidLocations[1]);
-        ourShader.setVec3("obamalight[1].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[1].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[1].cutOff", glm::cos(glm::radians(6.5f)));
-        ourShader.setFloat("obamaLight[1].outerCutOff", glm::cos(glm::radians(28.0f)));
-
-        // spot light three
-        ourShader.setVec3("obamaLight[2].position", obamidLocations[2]);  
-        ourShader.setVec3("obamalight[2].direction", 0.0f, -1.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].ambient", 0.0f, 0.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].diffuse", 1.0f, 1.0f, 1.0f); 
-        ourShader.setVec3("obamaLight[2].specular", 1.0f, 1.0f, 1.0f); 
-        ourShader.setFloat("obamaLight[2].cutOff", glm::cos(glm::radians(8.5f))); 
-        ourShader.setFloat("obamaLight[2].outerCutOff", glm::cos(glm::radians(22.0f))); 
-        
-
-       // create sand plane
-       // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-
         // projection transformation
         glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f); 
-        ourShader.setMat4("projection", projection);
 
         // view transformation
-        glm::mat4 view = glm::mat4(1.0f); 
         if (escPressed == false) {
             view = camera.getViewMatrix();
-            ourShader.setMat4("view", view);
         }
 
-        // bind the sand/floor texture
-        glActiveTexture(GL_TEXTURE0);  
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
+        cameraUniforms.update(view, projection, camera.Position, currentFrame);
 
-        // bind the floor vertex array object
-        glBindVertexArray(FloorVAO);
+        // create obamaids
+        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
+        // activate shader
+        glState.useProgram(ourShader.ID);
 
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1.0f)); 
-        model = glm::scale(model, glm::vec3(3.0f, 1.0f, 3.0f)); 
+        // the lights are set up before the loop and don't change, so after the first frame this uploads nothing
+        lights.upload();
 
-        ourShader.setMat4("model", model);
 
-        // send in normal uniform to shaders
-        glm::mat3 normalMatrix = glm::mat3(transpose(inverse(view * model)));
-        ourShader.setMat3("normalMatrix", normalMatrix); 
-        
+       // create sand plane
+       // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
+
+        // bind the sand/floor texture
+        glState.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, floorTexture);
+
+        // bind the floor vertex array object
+        glState.bindVertexArray(FloorVAO);
+
         // draw sand/floor plane
-        glDrawArrays(GL_TRIANGLES, 0, 6); 
+        floorInstance.drawArrays(GL_TRIANGLES, 0, 6); 
 
 
         // set up obamid shaders (which is the light source)
         // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-        lightShader.use(); 
-
-        // projection transformations
-        lightShader.setMat4("projection", projection); 
-
-        // view transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix(); 
-            lightShader.setMat4("view", view);
-        }
+        glState.useProgram(lightShader.ID); 
 
         // BIND vertex array object and obama texture to object
-        glBindVertexArray(VAO); 
-        glActiveTexture(GL_TEXTURE0); 
-        glBindTexture(GL_TEXTURE_2D, triangleTexture); 
+        glState.bindVertexArray(VAO); 
+        glState.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, triangleTexture); 
+
+        lightShader.setVec3("lightColour", 0.5f, 0.5f, 0.5f);
 
         for (int i = 0; i < 3; i++) {
             // set up world transformations for each model (obamid)
-            lightShader.setVec3("lightColour", 0.5f, 0.5f, 0.5f);
-
             glm::mat4 model = glm::mat4(1.0f); 
 
             model = glm::translate(model, obamidLocations[i]); 
             model = glm::rotate(model, (float)glfwGetTime() * glm::radians(-75.0f), glm::vec3(0.0f, 1.0f, 0.0f));  
 
-            lightShader.setMat4("model", model); 
-
-            glDrawArrays(GL_TRIANGLES, 0, 18);
-
+            obamidInstances.set(i, model); 
         }
+
+        // all three in one draw
+        obamidInstances.drawArrays(GL_TRIANGLES, 0, 18);
         
         // set up kamala kube
        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-        ourShader.use();
+        glState.useProgram(ourShader.ID);
         ourShader.setFloat("material.shininess", 16.0f);
-        ourShader.setVec3("viewPos", camera.Position);
-
-        ourShader.setMat4("projection", projection);
-
-        // view transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix();
-            lightShader.setMat4("view", view);
-        }
 
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, kamalaTexture);
+        glState.bindVertexArray(cubeVAO);
+        glState.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, kamalaTexture);
 
         for (int i = 0; i < 3; i++) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
 
             model = glm::translate(model, hoverLocations[i]);
 
@@ -543,15 +555,12 @@ int main()
 
             model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
 
-            ourShader.setMat4("model", model);
-
-            ourShader.setMat3("normalMatrix", normalMatrix);
-
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-
+            kubeInstances.set(i, model);
         }
 
+        // all three in one draw, each with the normal matrix of its own rotation
+        kubeInstances.drawArrays(GL_TRIANGLES, 0, 36);
+
       
         
       
@@ -564,6 +573,10 @@ int main()
     }
 
     // delete all the objects that were created
+    floorInstance.shutdown();
+    obamidInstances.shutdown();
+    kubeInstances.shutdown();
+
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
 
@@ -573,6 +586,8 @@ int main()
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteBuffers(1, &cubeVBO);
 
+    cameraUniforms.shutdown();
+    lights.shutdown();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -600,6 +615,12 @@ void processInput(GLFWwindow* window)
         escPressed = false;
     }
 
+    // F1 switches the stats printing, only on the press, not every frame it's held
+    bool statsKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+        printStats = !printStats;
+    statsKeyDown = statsKey;
+
 
     if (escPressed == false) {
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
@@ -11,6 +11,8 @@
 
 #include <cmath>
 #include "stb_image.h"
+#include "CameraUniforms.h"
+#include "LightUniforms.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
@@ -78,6 +80,11 @@ int main()
     Shader ourShader("shader.vts", "shader.fts");
     Shader lightShader("lightShader.vts", "lightShader.fts");
 
+    // both read view, projection and the camera position from the one Camera uniform block
+    CameraUniforms& cameraUniforms = CameraUniforms::instance();
+    cameraUniforms.attach(ourShader.ID);
+    cameraUniforms.attach(lightShader.ID);
+
     // Set vertices fo triangle
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -270,6 +277,39 @@ int main()
         return -1;
     }
 
+    // the view stays where it was while the cursor is released
+    glm::mat4 view = glm::mat4(1.0f);
+
+    // the moon and a spot light over each obamid, all in LightUniforms' buffers. They never move, so they're set once here
+    // and uploaded by the first lights.upload() in the loop
+    LightUniforms& lights = LightUniforms::instance();
+    lights.attach(ourShader.ID);
+
+    DirLight moon;
+    moon.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    moon.ambient = glm::vec3(0.25f, 0.25f, 0.2f);
+    lights.addDirLight(moon);
+
+    // each obamid gets its own inner and outer cone, in degrees
+    float obamaLightCutOffs[] = { 7.5f, 6.5f, 8.5f };
+    float obamaLightOuterCutOffs[] = { 26.0f, 28.0f, 22.0f };
+    for (unsigned int i = 0; i < 3; i++) {
+        SpotLight obamaLight;
+        obamaLight.position = obamidLocations[i];
+        // straight down. The old per frame setVec3 misspelled this one as "obamalight", so before LightUniforms the shader
+        // got a zero direction, normalize() of which is undefined, and the spot cones mostly didn't show at all
+        obamaLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        obamaLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+        obamaLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        obamaLight.constant = 1.0f;
+        obamaLight.linear = 0.09f;
+        obamaLight.quadratic = 0.032f;
+        obamaLight.cutOff = glm::cos(glm::radians(obamaLightCutOffs[i]));
+        obamaLight.outerCutOff = glm::cos(glm::radians(obamaLightOuterCutOffs[i]));
+        lights.addSpotLight(obamaLight);
+    }
+
     // render loop
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
     while (!glfwWindowShouldClose(window)) {
@@ -288,6 +328,19 @@ int main()
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // camera for every shader, one upload a frame
+        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
+
+        // projection transformation
+        glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f); 
+
+        // view transformation
+        if (escPressed == false) {
+            view = camera.getViewMatrix();
+        }
+
+        cameraUniforms.update(view, projection, camera.Position, currentFrame);
+
         // create obamaids
         // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
@@ -297,68 +350,14 @@ int main()
         // activate shader
         ourShader.use();
         ourShader.setFloat("material.shininess", 4.0f);
-        ourShader.setVec3("viewPos", camera.Position);
-
-        // set up moon light
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
-        ourShader.setVec3("moon.direction", -0.2f, -1.0f, -0.3f);
-        ourShader.setVec3("moon.ambient", 0.25f, 0.25f, 0.2f);
-        
-        // set up spot light
-        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
+        // the lights are set up before the loop and don't change, so after the first frame this uploads nothing
+        lights.upload();
 
-        // spot light one
-        ourShader.setVec3("obamaLight[0].position", obamidLocations[0]);
-        ourShader.setVec3("obamalight[0].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[0].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[0].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[0].constant", 1.0f);
-        ourShader.setFloat("obamaLight[0].linear", 0.09f); 
-        ourShader.setFloat("obamaLight[0].quadratic", 0.032f);
-        ourShader.setFloat("obamaLight[0].cutOff", glm::cos(glm::radians(7.5f)));
-        ourShader.setFloat("obamaLight[0].outerCutOff", glm::cos(glm::radians(26.0f)));
-
-        // spot light two
-        ourShader.setVec3("obamaLight[1].position", obamidLocations[1]);
-        ourShader.setVec3("obamalight[1].direction", 0.0f, -1.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].ambient", 0.0f, 0.0f, 0.0f);
-        ourShader.setVec3("obamaLight[1].diffuse", 1.0f, 1.0f, 1.0f);
-        ourShader.setVec3("obamaLight[1].specular", 1.0f, 1.0f, 1.0f);
-        ourShader.setFloat("obamaLight[1].constant", 1.0f);
-        ourShader.setFloat("obamaLight[1].linear", 0.09f);
-        ourShader.setFloat("obamaLight[1].quadratic", 0.032f);
-        ourShader.setFloat("obamaLight[1].cutOff", glm::cos(glm::radians(6.5f)));
-        ourShader.setFloat("obamaLight[1].outerCutOff", glm::cos(glm::radians(28.0f)));
-
-        // spot light three
-        ourShader.setVec3("obamaLight[2].position", obamidLocations[2]);  
-        ourShader.setVec3("obamalight[2].direction", 0.0f, -1.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].ambient", 0.0f, 0.0f, 0.0f); 
-        ourShader.setVec3("obamaLight[2].diffuse", 1.0f, 1.0f, 1.0f); 
-        ourShader.setVec3("obamaLight[2].specular", 1.0f, 1.0f, 1.0f); 
-        ourShader.setFloat("obamaLight[2].constant", 1.0f); 
-        ourShader.setFloat("obamaLight[2].linear", 0.09f); 
-        ourShader.setFloat("obamaLight[2].quadratic", 0.032f); 
-        ourShader.setFloat("obamaLight[2].cutOff", glm::cos(glm::radians(8.5f))); 
-        ourShader.setFloat("obamaLight[2].outerCutOff", glm::cos(glm::radians(22.0f))); 
-        
 
        // create sand plane
        // -------------------------------------------------------------------------------------------------------------------------------------------------------------------- -
 
-        // projection transformation
-        glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f); 
-        ourShader.setMat4("projection", projection);
-
-        // view transformation
-        glm::mat4 view = glm::mat4(1.0f); 
-        if (escPressed == false) {
-            view = camera.getViewMatrix();
-            ourShader.setMat4("view", view);
-        }
-
         // bind the sand/floor texture
         glActiveTexture(GL_TEXTURE0);  
         glBindTexture(GL_TEXTURE_2D, floorTexture);
@@ -387,15 +386,6 @@ int main()
 
         lightShader.use(); 
 
-        // projection transformations
-        lightShader.setMat4("projection", projection); 
-
-        // ciew transformations
-        if (escPressed == false) {
-            view = camera.getViewMatrix(); 
-            lightShader.setMat4("view", view);
-        }
-
         // BIND vertex array object and obama texture to object
         glBindVertexArray(VAO); 
         glActiveTexture(GL_TEXTURE0); 
@@ -446,6 +436,8 @@ int main()
     glDeleteVertexArrays(1, &FloorVAO);
     glDeleteBuffers(1, &FloorVBO);
 
+    cameraUniforms.shutdown();
+    lights.shutdown();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
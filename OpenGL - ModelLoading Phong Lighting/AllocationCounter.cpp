@@ -0,0 +1,79 @@
+// the global operator new / delete replacements behind AllocationCounter, see AllocationCounter.h. Compile this file into
+// an executable only if it wants allocation counts, a program can replace the operators just once.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+using namespace std;
+
+static void* allocate(size_t size) {
+    AllocationCounter::record(size);
+    return malloc(size ? size : 1);
+}
+
+// aligned_alloc wants the size to be a multiple of the alignment, and MSVC has neither it nor a free() for its result
+static void* allocateAligned(size_t size, align_val_t alignment) {
+    AllocationCounter::record(size);
+    size_t align = (size_t)alignment;
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, align);
+#else
+    size_t rounded = size ? (size + align - 1) / align * align : align;
+    return aligned_alloc(align, rounded);
+#endif
+}
+
+static void freeAligned(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void* operator new(size_t size) {
+    if (void* p = allocate(size))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    if (void* p = allocate(size))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return allocate(size); }
+
+void* operator new(size_t size, align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+
+void operator delete(void* p, align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { freeAligned(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { freeAligned(p); }
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+// counts every heap allocation made through operator new, for checking how many allocations a piece of code makes.
+//
+// the counting replaces the global operator new / delete, which a program can only do once, so the replacements live in
+// AllocationCounter.cpp and only the executables that want the counts compile it in (ModelBenchmark does, Main doesn't).
+// Out of line, the compiler never sees a new inlined next to the free() of the matching delete. Without
+// AllocationCounter.cpp count() and bytes() just read the counters, which stay 0.
+class AllocationCounter {
+public:
+    // allocations and bytes requested since the program started, read them before and after the code to measure
+    static size_t count() { return allocations().load(memory_order_relaxed); }
+    static size_t bytes() { return allocatedBytes().load(memory_order_relaxed); }
+
+    static void record(size_t size) {
+        allocations().fetch_add(1, memory_order_relaxed);
+        allocatedBytes().fetch_add(size, memory_order_relaxed);
+    }
+
+private:
+    static atomic<size_t>& allocations() {
+        static atomic<size_t> value(0);
+        return value;
+    }
+
+    static atomic<size_t>& allocatedBytes() {
+        static atomic<size_t> value(0);
+        return value;
+    }
+};
+
+#endif // !ALLOCATION_COUNTER_H
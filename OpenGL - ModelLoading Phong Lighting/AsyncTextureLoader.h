@@ -0,0 +1,287 @@
+#pragma once
+#ifndef ASYNC_TEXTURE_LOADER_H
+#define ASYNC_TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/stb_image.h"
+#include "GLStateCache.h"
+#include "TextureCooker.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// timings for a single texture, filled in once its upload has finished
+struct TextureLoadStats {
+    string path;
+    unsigned int textureID;
+    int width, height, channels;
+    double decodeMs;    // stbi_load + mip chain (or reading/cooking the compressed texture) on the worker thread
+    double uploadMs;    // PBO fill + glTexImage2D (or glCompressedTexImage2D) per level on the GL thread
+    TextureFormat format;
+    bool failed;
+};
+
+// set to true by whoever owns a texture that gets deleted while it's still loading. Texture names are recycled, so the
+// loader can't ask GL whether the texture is still there: a later glGenTextures may have handed the same name out again.
+typedef std::shared_ptr<std::atomic<bool>> TextureLoadToken;
+
+inline TextureLoadToken makeTextureLoadToken() {
+    return std::make_shared<std::atomic<bool>>(false);
+}
+
+// decodes image files and builds their mip chains on worker threads, then streams the pixels to the GPU through pixel
+// buffer objects.
+//
+// load() hands back a texture ID straight away. Until the upload has happened that texture holds a 1x1 placeholder, so
+// it can be bound and drawn with immediately. update() has to be called on the GL thread (once per frame is fine); it
+// uploads whatever finished decoding since the last call, optionally stopping once a time budget is used up.
+// call shutdown() (or destroy the loader) before the GL context goes away, it owns the PBOs.
+class AsyncTextureLoader {
+public:
+    AsyncTextureLoader(unsigned int numThreads = 0) : workers(numThreads) {}
+
+    ~AsyncTextureLoader() {
+        shutdown();
+    }
+
+    // drops everything that hasn't been uploaded yet and frees the PBOs. Safe to call more than once.
+    void shutdown() {
+        shuttingDown = true;
+        workers.waitIdle();
+
+        decoded.clear();
+
+        if (!pixelBuffers.empty())
+            glDeleteBuffers((GLsizei)pixelBuffers.size(), pixelBuffers.data());
+        pixelBuffers.clear();
+        pending = 0;
+    }
+
+    AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+    // creates the texture object with a placeholder and queues the file for decoding. Must be called on the GL thread.
+    // with a compressed format the worker loads (or first cooks) the block compressed mip chain instead, see TextureCooker.
+    // once the token is set the image is dropped instead of uploaded, so set it before deleting the texture.
+    unsigned int load(const string& path, const TextureLoadParams& params = TextureLoadParams(), TextureLoadToken cancelled = TextureLoadToken()) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::instance().bindTexture(GL_TEXTURE_2D, textureID);
+
+        // mid grey so lit surfaces look neutral while they wait
+        unsigned char placeholder[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (shuttingDown)
+            return textureID;
+
+        pending++;
+        workers.enqueue([this, path, textureID, params, cancelled] { decode(path, textureID, params, cancelled); });
+
+        return textureID;
+    }
+
+    // uploads decoded images, returns how many textures were finished. A budget of 0 means "upload everything ready".
+    unsigned int update(double budgetMs = 0.0) {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int uploaded = 0;
+
+        while (true) {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                if (decoded.empty())
+                    break;
+                image = std::move(decoded.front());
+                decoded.pop_front();
+            }
+
+            upload(image);
+            uploaded++;
+            pending--;
+
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (budgetMs > 0.0 && elapsedMs >= budgetMs)
+                break;
+        }
+
+        return uploaded;
+    }
+
+    // blocks until every queued texture is decoded and uploaded
+    void finish() {
+        while (pending > 0) {
+            if (update() == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    // number of textures that have been requested but not uploaded yet
+    unsigned int pendingCount() const {
+        return pending;
+    }
+
+    const vector<TextureLoadStats>& stats() const {
+        return finished;
+    }
+
+    void printStats() const {
+        double totalDecode = 0.0, totalUpload = 0.0;
+        for (unsigned int i = 0; i < finished.size(); i++) {
+            const TextureLoadStats& s = finished[i];
+            std::cout << "TEXTURE::ASYNC " << s.path << " " << s.width << "x" << s.height << "x" << s.channels << " " << textureFormatName(s.format)
+                      << " decode " << s.decodeMs << " ms, upload " << s.uploadMs << " ms" << (s.failed ? " (FAILED)" : "") << std::endl;
+            totalDecode += s.decodeMs;
+            totalUpload += s.uploadMs;
+        }
+        std::cout << "TEXTURE::ASYNC " << finished.size() << " textures, decode " << totalDecode << " ms (worker threads), upload "
+                  << totalUpload << " ms (GL thread)" << std::endl;
+    }
+
+private:
+    struct DecodedImage {
+        string path;
+        unsigned int textureID = 0;
+        int width = 0, height = 0, channels = 0;
+        double decodeMs = 0.0;
+        TextureFormat format = TEXTURE_FORMAT_UNCOMPRESSED;
+        TextureLoadToken cancelled;     // empty if nobody can cancel the load
+        MipChain mips;                  // every level of an uncompressed texture
+        CompressedTexture compressed;   // filled instead of mips for compressed formats
+    };
+
+    std::mutex decodedMutex;
+    std::deque<DecodedImage> decoded;
+    std::atomic<unsigned int> pending{ 0 };
+    std::atomic<bool> shuttingDown{ false };
+
+    vector<unsigned int> pixelBuffers;  // reused round robin, each one is orphaned before it gets refilled
+    unsigned int nextPixelBuffer = 0;
+    vector<TextureLoadStats> finished;
+
+    // declared last so the workers are joined before the queue they write into is destroyed
+    ThreadPool workers;
+
+    static const unsigned int PIXEL_BUFFER_COUNT = 4;
+
+    // runs on a worker thread, no GL calls allowed in here
+    void decode(const string& path, unsigned int textureID, const TextureLoadParams& params, const TextureLoadToken& cancelled) {
+        DecodedImage image;
+        image.path = path;
+        image.textureID = textureID;
+        image.format = params.format;
+        image.cancelled = cancelled;
+
+        if (!shuttingDown && !isCancelled(image)) {
+            auto start = std::chrono::steady_clock::now();
+            if (params.format != TEXTURE_FORMAT_UNCOMPRESSED) {
+                // the other workers are busy with other textures, so cook on this thread only
+                if (TextureCooker::loadOrCook(path, params, image.compressed, 1)) {
+                    image.width = image.compressed.width;
+                    image.height = image.compressed.height;
+                    image.channels = 4;
+                }
+            }
+            else {
+                unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+                if (pixels) {
+                    MipGenerator::generate(pixels, image.width, image.height, image.channels, image.mips, params.colorSpace, params.mipFilter);
+                    stbi_image_free(pixels);
+                }
+            }
+            image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        decoded.push_back(std::move(image));
+    }
+
+    static bool isCancelled(const DecodedImage& image) {
+        return image.cancelled && image.cancelled->load();
+    }
+
+    // runs on the GL thread
+    void upload(DecodedImage& image) {
+        auto start = std::chrono::steady_clock::now();
+
+        TextureLoadStats s;
+        s.path = image.path;
+        s.textureID = image.textureID;
+        s.width = image.width;
+        s.height = image.height;
+        s.channels = image.channels;
+        s.decodeMs = image.decodeMs;
+        s.format = image.format;
+        s.failed = (image.mips.levels.empty() && image.compressed.levels.empty());
+
+        // the texture was released (and deleted) while it was still decoding, its name may belong to another one by now
+        bool cancelled = isCancelled(image);
+        if (cancelled) {
+            image.mips = MipChain();
+            image.compressed = CompressedTexture();
+            s.failed = false;
+        }
+
+        if (!image.compressed.levels.empty()) {
+            // already has its mip chain, no PBO either: the blocks are a fraction of the raw size
+            TextureCooker::upload(image.compressed, image.textureID);
+            image.compressed = CompressedTexture();
+        }
+        else if (!image.mips.levels.empty()) {
+            // the whole chain goes into the PBO, every level is a glTexImage2D at its offset
+            GLsizeiptr size = (GLsizeiptr)image.mips.data.size();
+
+            if (pixelBuffers.empty()) {
+                pixelBuffers.resize(PIXEL_BUFFER_COUNT);
+                glGenBuffers(PIXEL_BUFFER_COUNT, pixelBuffers.data());
+            }
+            unsigned int pbo = pixelBuffers[nextPixelBuffer];
+            nextPixelBuffer = (nextPixelBuffer + 1) % PIXEL_BUFFER_COUNT;
+
+            // orphan the previous storage so we never wait on a transfer that is still reading from it
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst) {
+                memcpy(dst, image.mips.data.data(), (size_t)size);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+                // the level pointers are offsets into the bound PBO, the driver copies from there without blocking us
+                MipGenerator::upload(image.mips, image.textureID, NULL);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            else {
+                // mapping failed, fall back to a plain client memory upload
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                MipGenerator::upload(image.mips, image.textureID, image.mips.data.data());
+            }
+
+            image.mips = MipChain();
+        }
+        else if (!shuttingDown && !cancelled) {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        }
+
+        s.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        finished.push_back(s);
+    }
+};
+
+#endif // !ASYNC_TEXTURE_LOADER_H
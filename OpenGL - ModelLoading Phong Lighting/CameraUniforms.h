@@ -0,0 +1,126 @@
+#pragma once
+#ifndef CAMERA_UNIFORMS_H
+#define CAMERA_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+
+#include "RingBuffer.h"
+
+using namespace std;
+
+// the uniform buffer binding point of the "Camera" block, the same for every program
+const GLuint CAMERA_UNIFORM_BINDING = 0;
+
+// the "Camera" uniform block as the shaders declare it, std140 layout:
+//
+//     layout (std140) uniform Camera {
+//         mat4 view;
+//         mat4 projection;
+//         mat4 viewProjection;
+//         vec3 cameraPosition;
+//         float time;
+//     };
+//
+// the float fills the rest of the vec3's 16 bytes, so the block is 208 bytes with no padding, like the struct.
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 position;
+    float time;
+};
+
+// the per frame camera data every shader program reads from one uniform buffer, instead of "view" / "projection" /
+// "viewPos" uniforms set on each program every frame.
+//
+// update() computes viewProjection and uploads the whole block once a frame, however many programs draw with it. While
+// the RingBuffer has a frame open the block is written into it and CAMERA_UNIFORM_BINDING pointed at that range, so
+// there's no copy in the driver and the GPU can still read the frames before. Otherwise it goes to a buffer of its own
+// with a single glBufferSubData. GLSL 3.30 can't give a block a binding in the shader, so attach() every program that
+// declares the block once after it's linked. Nothing else may use CAMERA_UNIFORM_BINDING.
+// Only use it from the thread that owns the GL context, and call shutdown() before the context goes away.
+class CameraUniforms {
+public:
+    static CameraUniforms& instance() {
+        static CameraUniforms uniforms;
+        return uniforms;
+    }
+
+    CameraUniforms(const CameraUniforms&) = delete;
+    CameraUniforms& operator=(const CameraUniforms&) = delete;
+
+    // points the program's Camera block at CAMERA_UNIFORM_BINDING, programs without the block are left alone
+    void attach(unsigned int program) {
+        GLuint index = glGetUniformBlockIndex(program, "Camera");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, CAMERA_UNIFORM_BINDING);
+    }
+
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position, float time) {
+        block.view = view;
+        block.projection = projection;
+        block.viewProjection = projection * view;
+        block.position = position;
+        block.time = time;
+
+        RingBuffer& ring = RingBuffer::instance();
+        GLintptr offset = 0;
+        void* memory = ring.allocate(sizeof(CameraBlock), uniformAlignment(), offset);
+        if (memory) {
+            memcpy(memory, &block, sizeof(CameraBlock));
+            ring.flush();
+            glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, ring.buffer(), offset, sizeof(CameraBlock));
+            ownBufferBound = false;
+            return;
+        }
+
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &block, GL_DYNAMIC_DRAW);
+        }
+        else {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+        }
+        if (!ownBufferBound) {
+            glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, buffer);
+            ownBufferBound = true;
+        }
+    }
+
+    // what the last update() uploaded, for CPU code that needs the same matrices (culling, sort depths)
+    const CameraBlock& current() const {
+        return block;
+    }
+
+    void shutdown() {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        ownBufferBound = false;
+    }
+
+private:
+    GLuint buffer = 0;
+    bool ownBufferBound = false;    // false while the binding point has a range of the RingBuffer, or nothing yet
+    CameraBlock block = CameraBlock();
+
+    CameraUniforms() {}
+
+    // what offsets into a uniform buffer have to be a multiple of
+    static size_t uniformAlignment() {
+        static GLint alignment = 0;
+        if (alignment == 0) {
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            if (alignment <= 0)
+                alignment = 256;
+        }
+        return (size_t)alignment;
+    }
+};
+
+#endif // !CAMERA_UNIFORMS_H
@@ -0,0 +1,654 @@
+#pragma once
+#ifndef GEOMETRY_HEAP_H
+#define GEOMETRY_HEAP_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "GLStateCache.h"
+
+using namespace std;
+
+// two level segregated fit allocator (Masmoudi et al. 2004) handing out ranges of a buffer that lives somewhere else, e.g.
+// on the GPU. Sizes and offsets are in whatever unit the caller picks (vertices, 4 byte words, ...).
+//
+// free ranges are kept in 32 x 16 size classes with a bitmap over them, so allocate() and free() are O(1): the first
+// level is the power of two of the size, the second level splits that range into 16 linear steps. Freed ranges are
+// merged with free neighbours right away. compact() slides every live range to the front and reports the moves, which is
+// how the owner defragments the real buffer.
+class TlsfAllocator {
+public:
+    static const uint32_t INVALID = 0xFFFFFFFFu;
+
+    // where compact() put a live range
+    struct Move {
+        uint32_t handle;
+        uint32_t from;
+        uint32_t to;
+        uint32_t size;
+    };
+
+    explicit TlsfAllocator(uint32_t capacity = 0) {
+        reset(capacity);
+    }
+
+    // forgets every allocation
+    void reset(uint32_t capacity) {
+        blocks.clear();
+        unusedSlots.clear();
+        flBitmap = 0;
+        memset(slBitmap, 0, sizeof(slBitmap));
+        for (int fl = 0; fl < FL_COUNT; fl++)
+            for (int sl = 0; sl < SL_COUNT; sl++)
+                freeHeads[fl][sl] = INVALID;
+
+        total = 0;
+        used = 0;
+        liveCount = 0;
+        firstBlock = lastBlock = INVALID;
+        grow(capacity);
+    }
+
+    // returns a handle for a range of at least `size` units, or INVALID if no free range is big enough
+    uint32_t allocate(uint32_t size) {
+        if (size == 0)
+            size = 1;
+
+        int fl, sl;
+        mappingSearch(size, fl, sl);
+        uint32_t b = findSuitable(fl, sl);
+
+        // the search rounds the size up to the next class; a block in the exact class might still fit
+        if (b == INVALID) {
+            mappingInsert(size, fl, sl);
+            for (uint32_t it = freeHeads[fl][sl]; it != INVALID; it = blocks[it].nextFree) {
+                if (blocks[it].size >= size) {
+                    b = it;
+                    break;
+                }
+            }
+        }
+        if (b == INVALID)
+            return INVALID;
+
+        removeFree(b);
+        if (blocks[b].size > size)
+            split(b, size);
+
+        blocks[b].free = false;
+        used += blocks[b].size;
+        liveCount++;
+        return b;
+    }
+
+    void free(uint32_t handle) {
+        if (handle == INVALID || handle >= blocks.size() || blocks[handle].free)
+            return;
+
+        uint32_t b = handle;
+        blocks[b].free = true;
+        used -= blocks[b].size;
+        liveCount--;
+
+        // merge with the physical neighbours
+        uint32_t next = blocks[b].nextPhys;
+        if (next != INVALID && blocks[next].free) {
+            removeFree(next);
+            blocks[b].size += blocks[next].size;
+            unlinkPhysical(next);
+            releaseBlock(next);
+        }
+        uint32_t prev = blocks[b].prevPhys;
+        if (prev != INVALID && blocks[prev].free) {
+            removeFree(prev);
+            blocks[prev].size += blocks[b].size;
+            unlinkPhysical(b);
+            releaseBlock(b);
+            b = prev;
+        }
+
+        insertFree(b);
+    }
+
+    uint32_t offset(uint32_t handle) const { return blocks[handle].offset; }
+    uint32_t size(uint32_t handle) const { return blocks[handle].size; }
+
+    // adds free space at the end
+    void grow(uint32_t newCapacity) {
+        if (newCapacity <= total)
+            return;
+        uint32_t extra = newCapacity - total;
+
+        if (lastBlock != INVALID && blocks[lastBlock].free) {
+            removeFree(lastBlock);
+            blocks[lastBlock].size += extra;
+            insertFree(lastBlock);
+        }
+        else {
+            uint32_t b = newBlock();
+            blocks[b].offset = total;
+            blocks[b].size = extra;
+            blocks[b].free = true;
+            blocks[b].prevPhys = lastBlock;
+            blocks[b].nextPhys = INVALID;
+            if (lastBlock != INVALID)
+                blocks[lastBlock].nextPhys = b;
+            else
+                firstBlock = b;
+            lastBlock = b;
+            insertFree(b);
+        }
+        total = newCapacity;
+    }
+
+    // packs all live ranges at the front (handles stay valid) and leaves one free range at the end. Returns the old and new
+    // offset of every live range, including the ones that stayed where they were.
+    vector<Move> compact() {
+        vector<Move> moves;
+
+        vector<uint32_t> live;
+        live.reserve(liveCount);
+        for (uint32_t b = firstBlock; b != INVALID; ) {
+            uint32_t next = blocks[b].nextPhys;
+            if (blocks[b].free)
+                releaseBlock(b);
+            else
+                live.push_back(b);
+            b = next;
+        }
+
+        flBitmap = 0;
+        memset(slBitmap, 0, sizeof(slBitmap));
+        for (int fl = 0; fl < FL_COUNT; fl++)
+            for (int sl = 0; sl < SL_COUNT; sl++)
+                freeHeads[fl][sl] = INVALID;
+
+        uint32_t cursor = 0;
+        firstBlock = lastBlock = INVALID;
+        for (size_t i = 0; i < live.size(); i++) {
+            Block& block = blocks[live[i]];
+            moves.push_back(Move{ live[i], block.offset, cursor, block.size });
+            block.offset = cursor;
+            block.prevPhys = lastBlock;
+            block.nextPhys = INVALID;
+            if (lastBlock != INVALID)
+                blocks[lastBlock].nextPhys = live[i];
+            else
+                firstBlock = live[i];
+            lastBlock = live[i];
+            cursor += block.size;
+        }
+
+        uint32_t capacity = total;
+        total = cursor;
+        grow(capacity);
+        return moves;
+    }
+
+    uint32_t capacity() const { return total; }
+    uint32_t usedSize() const { return used; }
+    uint32_t freeSize() const { return total - used; }
+    unsigned int allocationCount() const { return liveCount; }
+
+    // the biggest single allocation that would succeed right now
+    uint32_t largestFreeBlock() const {
+        for (int fl = FL_COUNT - 1; fl >= 0; fl--) {
+            if (!(flBitmap & (1u << fl)))
+                continue;
+            for (int sl = SL_COUNT - 1; sl >= 0; sl--) {
+                uint32_t largest = 0;
+                for (uint32_t it = freeHeads[fl][sl]; it != INVALID; it = blocks[it].nextFree)
+                    largest = largest > blocks[it].size ? largest : blocks[it].size;
+                if (largest > 0)
+                    return largest;
+            }
+        }
+        return 0;
+    }
+
+    // 0 when all free space is one range, close to 1 when it's scattered in small pieces
+    float fragmentation() const {
+        uint32_t freeUnits = freeSize();
+        return freeUnits == 0 ? 0.0f : 1.0f - (float)largestFreeBlock() / (float)freeUnits;
+    }
+
+private:
+    static const int SL_LOG2 = 4;
+    static const int SL_COUNT = 1 << SL_LOG2;
+    static const int FL_COUNT = 32;
+    static const uint32_t SMALL_BLOCK = SL_COUNT;
+
+    struct Block {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t prevPhys = INVALID, nextPhys = INVALID;
+        uint32_t prevFree = INVALID, nextFree = INVALID;
+        bool free = false;
+    };
+
+    vector<Block> blocks;               // indexed by handle
+    vector<uint32_t> unusedSlots;
+    uint32_t flBitmap;
+    uint32_t slBitmap[FL_COUNT];
+    uint32_t freeHeads[FL_COUNT][SL_COUNT];
+    uint32_t total, used;
+    unsigned int liveCount;
+    uint32_t firstBlock, lastBlock;     // physical order
+
+    static int floorLog2(uint32_t v) {
+        int r = 0;
+        while (v >>= 1)
+            r++;
+        return r;
+    }
+
+    static int lowestBit(uint32_t v) {
+        int r = 0;
+        while (!(v & 1u)) {
+            v >>= 1;
+            r++;
+        }
+        return r;
+    }
+
+    // size class a free block of this size is filed under
+    static void mappingInsert(uint32_t size, int& fl, int& sl) {
+        if (size < SMALL_BLOCK) {
+            fl = 0;
+            sl = (int)size;
+        }
+        else {
+            int f = floorLog2(size);
+            sl = (int)((size >> (f - SL_LOG2)) - SL_COUNT);
+            fl = f - SL_LOG2 + 1;
+        }
+    }
+
+    // first size class in which every block is at least this big
+    static void mappingSearch(uint32_t size, int& fl, int& sl) {
+        if (size >= SMALL_BLOCK) {
+            uint32_t round = (1u << (floorLog2(size) - SL_LOG2)) - 1;
+            size = size > 0xFFFFFFFFu - round ? 0xFFFFFFFFu : size + round;
+        }
+        mappingInsert(size, fl, sl);
+    }
+
+    uint32_t findSuitable(int fl, int sl) const {
+        if (fl >= FL_COUNT)
+            return INVALID;
+
+        uint32_t slMap = slBitmap[fl] & (~0u << sl);
+        if (!slMap) {
+            uint32_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0u << (fl + 1)) : 0;
+            if (!flMap)
+                return INVALID;
+            fl = lowestBit(flMap);
+            slMap = slBitmap[fl];
+        }
+        return freeHeads[fl][lowestBit(slMap)];
+    }
+
+    void insertFree(uint32_t b) {
+        int fl, sl;
+        mappingInsert(blocks[b].size, fl, sl);
+        blocks[b].prevFree = INVALID;
+        blocks[b].nextFree = freeHeads[fl][sl];
+        if (freeHeads[fl][sl] != INVALID)
+            blocks[freeHeads[fl][sl]].prevFree = b;
+        freeHeads[fl][sl] = b;
+        flBitmap |= 1u << fl;
+        slBitmap[fl] |= 1u << sl;
+    }
+
+    void removeFree(uint32_t b) {
+        int fl, sl;
+        mappingInsert(blocks[b].size, fl, sl);
+        if (blocks[b].prevFree != INVALID)
+            blocks[blocks[b].prevFree].nextFree = blocks[b].nextFree;
+        else
+            freeHeads[fl][sl] = blocks[b].nextFree;
+        if (blocks[b].nextFree != INVALID)
+            blocks[blocks[b].nextFree].prevFree = blocks[b].prevFree;
+        blocks[b].prevFree = blocks[b].nextFree = INVALID;
+
+        if (freeHeads[fl][sl] == INVALID) {
+            slBitmap[fl] &= ~(1u << sl);
+            if (!slBitmap[fl])
+                flBitmap &= ~(1u << fl);
+        }
+    }
+
+    // cuts block b down to `size` units, the rest becomes a free block right after it
+    void split(uint32_t b, uint32_t size) {
+        uint32_t rest = newBlock();
+        blocks[rest].offset = blocks[b].offset + size;
+        blocks[rest].size = blocks[b].size - size;
+        blocks[rest].free = true;
+        blocks[rest].prevPhys = b;
+        blocks[rest].nextPhys = blocks[b].nextPhys;
+        if (blocks[b].nextPhys != INVALID)
+            blocks[blocks[b].nextPhys].prevPhys = rest;
+        else
+            lastBlock = rest;
+        blocks[b].nextPhys = rest;
+        blocks[b].size = size;
+        insertFree(rest);
+    }
+
+    void unlinkPhysical(uint32_t b) {
+        if (blocks[b].prevPhys != INVALID)
+            blocks[blocks[b].prevPhys].nextPhys = blocks[b].nextPhys;
+        else
+            firstBlock = blocks[b].nextPhys;
+        if (blocks[b].nextPhys != INVALID)
+            blocks[blocks[b].nextPhys].prevPhys = blocks[b].prevPhys;
+        else
+            lastBlock = blocks[b].prevPhys;
+    }
+
+    uint32_t newBlock() {
+        if (!unusedSlots.empty()) {
+            uint32_t b = unusedSlots.back();
+            unusedSlots.pop_back();
+            blocks[b] = Block();
+            return b;
+        }
+        blocks.push_back(Block());
+        return (uint32_t)blocks.size() - 1;
+    }
+
+    void releaseBlock(uint32_t b) {
+        blocks[b] = Block();
+        blocks[b].free = true; // so a stale handle can't be freed twice
+        unusedSlots.push_back(b);
+    }
+};
+
+struct GeometryHeapStats {
+    unsigned long long vertexBytesUsed;
+    unsigned long long vertexBytesCapacity;
+    unsigned long long indexBytesUsed;
+    unsigned long long indexBytesCapacity;
+    float vertexFragmentation;      // worst of all vertex pools, see TlsfAllocator::fragmentation
+    float indexFragmentation;
+    unsigned int allocations;       // live vertex + index ranges
+    unsigned int defragmentations;  // since startup
+    unsigned int vaoBinds;          // since the last beginFrame()
+    unsigned int drawCalls;         // since the last beginFrame()
+};
+
+// process wide vertex and index storage for every Mesh.
+//
+// each vertex layout gets one big VBO and one VAO set up for it, and all layouts share one big EBO. Meshes get ranges in
+// them from a TlsfAllocator and draw with glDrawElementsBaseVertex, so consecutive meshes with the same layout don't need
+// any vertex state changes at all: bind() goes through the GLStateCache, which skips the VAO that is already bound. When
+// a buffer runs out of space it is first defragmented (if enough space is free in total) and otherwise grown, both by
+// copying on the GPU with glCopyBufferSubData. Ranges are referred to by handle so they can move, ask for the offset at draw time.
+// only use it from the thread that owns the GL context, and call shutdown() before the context goes away.
+class GeometryHeap {
+public:
+    // sets up the attribute pointers for a vertex layout, called with the layout's VAO and VBO bound
+    typedef void (*AttributeSetup)(unsigned int format);
+
+    static GeometryHeap& instance() {
+        static GeometryHeap heap;
+        return heap;
+    }
+
+    GeometryHeap(const GeometryHeap&) = delete;
+    GeometryHeap& operator=(const GeometryHeap&) = delete;
+
+    // makes a vertex layout known to the heap, does nothing if it already is
+    void registerFormat(unsigned int format, unsigned int stride, AttributeSetup setup) {
+        if (format < pools.size() && pools[format].stride != 0)
+            return;
+        if (format >= pools.size())
+            pools.resize(format + 1);
+        pools[format].stride = stride;
+        pools[format].setup = setup;
+    }
+
+    // copies `count` vertices into the layout's buffer, returns the handle of their range
+    uint32_t allocateVertices(unsigned int format, const void* data, uint32_t count) {
+        VertexPool& pool = pools[format];
+        if (pool.vao == 0)
+            createPool(format);
+
+        uint32_t handle = allocate(pool.allocator, count, [&](uint32_t capacity) { resizeVertexPool(format, capacity, false); },
+                                   [&]() { resizeVertexPool(format, pool.allocator.capacity(), true); });
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)pool.allocator.offset(handle) * pool.stride, (GLsizeiptr)count * pool.stride, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return handle;
+    }
+
+    // copies `bytes` of index data into the shared index buffer. Ranges are 4 byte aligned, so 16 and 32 bit indices mix.
+    uint32_t allocateIndices(const void* data, size_t bytes) {
+        if (ebo == 0)
+            createIndexBuffer();
+
+        uint32_t words = (uint32_t)((bytes + INDEX_UNIT - 1) / INDEX_UNIT);
+        uint32_t handle = allocate(indexAllocator, words, [&](uint32_t capacity) { resizeIndexBuffer(capacity, false); },
+                                   [&]() { resizeIndexBuffer(indexAllocator.capacity(), true); });
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)indexAllocator.offset(handle) * INDEX_UNIT, (GLsizeiptr)bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return handle;
+    }
+
+    void freeVertices(unsigned int format, uint32_t handle) {
+        if (format < pools.size())
+            pools[format].allocator.free(handle);
+    }
+
+    void freeIndices(uint32_t handle) {
+        indexAllocator.free(handle);
+    }
+
+    // what to pass as basevertex to glDrawElementsBaseVertex
+    GLint baseVertex(unsigned int format, uint32_t handle) const {
+        return (GLint)pools[format].allocator.offset(handle);
+    }
+
+    // byte offset of an index range in the shared EBO
+    size_t indexByteOffset(uint32_t handle) const {
+        return (size_t)indexAllocator.offset(handle) * INDEX_UNIT;
+    }
+
+    // binds the layout's VAO unless it's already bound, the GLStateCache knows what is
+    void bind(unsigned int format) {
+        GLStateCache& state = GLStateCache::instance();
+        if (state.vertexArray() != pools[format].vao)
+            vaoBinds++;
+        state.bindVertexArray(pools[format].vao);
+    }
+
+    void countDraws(unsigned int draws = 1) {
+        drawCalls += draws;
+    }
+
+    // resets the per frame counters
+    void beginFrame() {
+        vaoBinds = 0;
+        drawCalls = 0;
+    }
+
+    // packs all vertex and index ranges to the front of their buffers
+    void defragment() {
+        for (unsigned int f = 0; f < pools.size(); f++) {
+            if (pools[f].vao != 0)
+                resizeVertexPool(f, pools[f].allocator.capacity(), true);
+        }
+        if (ebo != 0)
+            resizeIndexBuffer(indexAllocator.capacity(), true);
+    }
+
+    GeometryHeapStats stats() const {
+        GeometryHeapStats s;
+        memset(&s, 0, sizeof(s));
+        for (unsigned int f = 0; f < pools.size(); f++) {
+            const VertexPool& pool = pools[f];
+            s.vertexBytesUsed += (unsigned long long)pool.allocator.usedSize() * pool.stride;
+            s.vertexBytesCapacity += (unsigned long long)pool.allocator.capacity() * pool.stride;
+            s.vertexFragmentation = std::max(s.vertexFragmentation, pool.allocator.fragmentation());
+            s.allocations += pool.allocator.allocationCount();
+        }
+        s.indexBytesUsed = (unsigned long long)indexAllocator.usedSize() * INDEX_UNIT;
+        s.indexBytesCapacity = (unsigned long long)indexAllocator.capacity() * INDEX_UNIT;
+        s.indexFragmentation = indexAllocator.fragmentation();
+        s.allocations += indexAllocator.allocationCount();
+        s.defragmentations = defragmentations;
+        s.vaoBinds = vaoBinds;
+        s.drawCalls = drawCalls;
+        return s;
+    }
+
+    void printStats() const {
+        GeometryHeapStats s = stats();
+        std::cout << "GEOMETRY_HEAP::STATS vertices " << s.vertexBytesUsed / 1024 << "/" << s.vertexBytesCapacity / 1024 << " KB (fragmentation "
+                  << s.vertexFragmentation << "), indices " << s.indexBytesUsed / 1024 << "/" << s.indexBytesCapacity / 1024 << " KB (fragmentation "
+                  << s.indexFragmentation << "), " << s.allocations << " ranges, " << s.defragmentations << " defragmentations, "
+                  << s.vaoBinds << " VAO binds / " << s.drawCalls << " draws this frame" << std::endl;
+    }
+
+    // deletes every buffer and VAO, all handles become invalid
+    void shutdown() {
+        for (unsigned int f = 0; f < pools.size(); f++) {
+            if (pools[f].vao != 0) {
+                glDeleteVertexArrays(1, &pools[f].vao);
+                GLStateCache::instance().forgetVertexArray(pools[f].vao);
+                glDeleteBuffers(1, &pools[f].vbo);
+            }
+            pools[f].vao = pools[f].vbo = 0;
+            pools[f].allocator.reset(0);
+        }
+        if (ebo != 0)
+            glDeleteBuffers(1, &ebo);
+        ebo = 0;
+        indexAllocator.reset(0);
+    }
+
+private:
+    static const uint32_t INDEX_UNIT = 4;                     // bytes per index allocation unit
+    static const uint32_t INITIAL_VERTICES = 1u << 16;
+    static const uint32_t INITIAL_INDEX_UNITS = 1u << 18;     // 1 MB
+
+    struct VertexPool {
+        unsigned int stride = 0;
+        AttributeSetup setup = NULL;
+        unsigned int vao = 0;
+        unsigned int vbo = 0;
+        TlsfAllocator allocator;
+    };
+
+    vector<VertexPool> pools;           // indexed by format
+    unsigned int ebo = 0;
+    TlsfAllocator indexAllocator;
+    unsigned int vaoBinds = 0;
+    unsigned int drawCalls = 0;
+    unsigned int defragmentations = 0;
+
+    GeometryHeap() {}
+
+    // allocates, defragmenting or growing the buffer through the callbacks when there's no free range that fits
+    template <typename Grow, typename Compact>
+    uint32_t allocate(TlsfAllocator& allocator, uint32_t size, Grow grow, Compact compact) {
+        uint32_t handle = allocator.allocate(size);
+        if (handle != TlsfAllocator::INVALID)
+            return handle;
+
+        // enough space in total, it's just scattered
+        if (allocator.freeSize() >= size) {
+            compact();
+            handle = allocator.allocate(size);
+            if (handle != TlsfAllocator::INVALID)
+                return handle;
+        }
+
+        uint32_t capacity = allocator.capacity();
+        uint32_t newCapacity = capacity * 2 > capacity + size ? capacity * 2 : capacity + size;
+        grow(newCapacity);
+        return allocator.allocate(size);
+    }
+
+    void createPool(unsigned int format) {
+        VertexPool& pool = pools[format];
+        glGenVertexArrays(1, &pool.vao);
+        pool.allocator.reset(0);
+        resizeVertexPool(format, INITIAL_VERTICES, false);
+    }
+
+    void createIndexBuffer() {
+        indexAllocator.reset(0);
+        resizeIndexBuffer(INITIAL_INDEX_UNITS, false);
+    }
+
+    // moves the pool into a new VBO of the given capacity, packing the ranges to the front if compact is set, and points
+    // the VAO at it
+    void resizeVertexPool(unsigned int format, uint32_t capacity, bool compact) {
+        VertexPool& pool = pools[format];
+        unsigned int oldBuffer = pool.vbo;
+        unsigned int newBuffer = copyRanges(oldBuffer, pool.allocator, capacity, pool.stride, compact);
+        pool.vbo = newBuffer;
+
+        GLStateCache& state = GLStateCache::instance();
+        state.bindVertexArray(pool.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        if (ebo != 0)
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        pool.setup(format);
+        state.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // same for the index buffer, every VAO has to be told about the new EBO
+    void resizeIndexBuffer(uint32_t capacity, bool compact) {
+        ebo = copyRanges(ebo, indexAllocator, capacity, INDEX_UNIT, compact);
+
+        for (unsigned int f = 0; f < pools.size(); f++) {
+            if (pools[f].vao == 0)
+                continue;
+            GLStateCache::instance().bindVertexArray(pools[f].vao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        }
+        GLStateCache::instance().bindVertexArray(0);
+    }
+
+    // creates a buffer of capacity * unit bytes and copies the live data of the old one (if any) over on the GPU
+    unsigned int copyRanges(unsigned int oldBuffer, TlsfAllocator& allocator, uint32_t capacity, uint32_t unit, bool compact) {
+        unsigned int newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * unit, NULL, GL_STATIC_DRAW);
+
+        if (oldBuffer != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+            if (compact) {
+                vector<TlsfAllocator::Move> moves = allocator.compact();
+                for (unsigned int i = 0; i < moves.size(); i++)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)moves[i].from * unit, (GLintptr)moves[i].to * unit,
+                                        (GLsizeiptr)moves[i].size * unit);
+                defragmentations++;
+            }
+            else {
+                GLsizeiptr oldBytes = (GLsizeiptr)allocator.capacity() * unit;
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &oldBuffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        allocator.grow(capacity);
+        return newBuffer;
+    }
+};
+
+#endif // !GEOMETRY_HEAP_H
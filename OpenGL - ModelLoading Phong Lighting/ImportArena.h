@@ -0,0 +1,161 @@
+#pragma once
+#ifndef IMPORT_ARENA_H
+#define IMPORT_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// monotonic scratch memory for the import steps (welding, vertex cache optimization, simplification, meshlets).
+//
+// allocate() bumps a pointer through the current block and only goes to the heap when the block is full, freeing single
+// allocations does nothing. reset() throws everything away at once and, if the last round needed more than one block,
+// replaces them with one block of the combined size, so an arena that is reset between meshes stops touching the heap
+// after the first few meshes. One arena per load (or per worker thread of a parallel load), never shared between threads.
+class ImportArena {
+public:
+    explicit ImportArena(size_t initialBytes = 1 << 20) : nextBlockBytes(initialBytes) {}
+
+    ~ImportArena() {
+        for (size_t i = 0; i < blocks.size(); i++)
+            ::operator delete(blocks[i].data);
+    }
+
+    ImportArena(const ImportArena&) = delete;
+    ImportArena& operator=(const ImportArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        // the current block, or one that is free again after a rewind
+        for (; current < blocks.size(); current++) {
+            Block& block = blocks[current];
+            size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+            if (offset + bytes <= block.size) {
+                block.used = offset + bytes;
+                used += bytes;
+                highWater = used > highWater ? used : highWater;
+                return block.data + offset;
+            }
+        }
+
+        // room for the request at any alignment, and at least double the previous block so a round needs few of them
+        size_t size = bytes + alignment > nextBlockBytes ? bytes + alignment : nextBlockBytes;
+        addBlock(size);
+        nextBlockBytes = size * 2;
+        current = blocks.size() - 1;
+        return allocate(bytes, alignment);
+    }
+
+    template <typename T>
+    T* allocate(size_t count) {
+        return (T*)allocate(count * sizeof(T), alignof(T));
+    }
+
+    // forgets every allocation. Memory handed out before is invalid afterwards.
+    void reset() {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); i++)
+            total += blocks[i].size;
+
+        if (blocks.size() > 1) {
+            for (size_t i = 0; i < blocks.size(); i++)
+                ::operator delete(blocks[i].data);
+            blocks.clear();
+            addBlock(total);
+        }
+        else if (!blocks.empty()) {
+            blocks[0].used = 0;
+        }
+        current = 0;
+        used = 0;
+    }
+
+    struct Mark {
+        size_t block, blockUsed, used;
+    };
+
+    // mark() / rewind() free everything allocated in between, for scratch arrays that only live through one step
+    Mark mark() const {
+        Mark m;
+        m.block = current;
+        m.blockUsed = current < blocks.size() ? blocks[current].used : 0;
+        m.used = used;
+        return m;
+    }
+
+    void rewind(const Mark& m) {
+        for (size_t i = m.block + 1; i < blocks.size(); i++)
+            blocks[i].used = 0;
+        if (m.block < blocks.size())
+            blocks[m.block].used = m.blockUsed;
+        current = m.block;
+        used = m.used;
+    }
+
+    // heap allocations the arena itself made so far
+    size_t heapAllocations() const { return blockAllocations; }
+
+    // bytes handed out since the last reset, and the most that were ever live at once
+    size_t bytesUsed() const { return used; }
+    size_t peakBytes() const { return highWater; }
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+        size_t used;
+    };
+
+    vector<Block> blocks;
+    size_t nextBlockBytes;
+    size_t current = 0;     // the block allocations are served from
+    size_t used = 0;
+    size_t highWater = 0;
+    size_t blockAllocations = 0;
+
+    void addBlock(size_t size) {
+        Block block;
+        block.data = (uint8_t*)::operator new(size);
+        block.size = size;
+        block.used = 0;
+        blocks.push_back(block);
+        blockAllocations++;
+    }
+};
+
+// lets standard containers take their memory from an ImportArena. deallocate is a no-op, the memory comes back with the
+// arena's next reset().
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    ImportArena* arena;
+
+    explicit ArenaAllocator(ImportArena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocate<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = vector<T, ArenaAllocator<T>>;
+
+// fixed size scratch array from an arena, value initialized like vector(count, value)
+template <typename T>
+T* arenaArray(ImportArena& arena, size_t count, const T& value) {
+    T* data = arena.allocate<T>(count);
+    for (size_t i = 0; i < count; i++)
+        data[i] = value;
+    return data;
+}
+
+#endif // !IMPORT_ARENA_H
@@ -0,0 +1,337 @@
+#pragma once
+#ifndef INDIRECT_RENDERER_H
+#define INDIRECT_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "GLStateCache.h"
+#include "GeometryHeap.h"
+#include "Mesh.h"
+#include "RingBuffer.h"
+#include "Shaders.h"
+
+using namespace std;
+
+// the layout glMultiDrawElementsIndirect reads from the GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;      // in indices, not bytes
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// what the indirect vertex shaders fetch per draw from the shader storage buffer, std430 layout
+struct IndirectDrawData {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;     // the mat3 in the first three columns
+    glm::vec4 positionOffset;   // mesh bounding box, compact vertex format only
+    glm::vec4 positionScale;
+};
+
+struct IndirectDrawStats {
+    unsigned int draws = 0;     // meshes in the last submit
+    unsigned int batches = 0;   // glMultiDrawElementsIndirect calls they took
+};
+
+// the binding point of the per draw storage buffer, "layout (std430, binding = 0)" in modelShadersIndirect.vts
+const GLuint INDIRECT_DRAW_DATA_BINDING = 0;
+
+// submits meshes with glMultiDrawElementsIndirect (GL 4.3 and GL_ARB_shader_draw_parameters) instead of a draw call each.
+//
+// every mesh lives in the GeometryHeap, so all meshes of a vertex format share one VAO and index buffer and a draw is
+// nothing but an index range and a base vertex. add() collects a command per mesh and the mesh's matrices, prepare() sorts
+// them so meshes with the same format, index type and textures line up, and submit() uploads the commands and the per
+// draw data (into the RingBuffer while it has a frame open) and issues one glMultiDrawElementsIndirect per run of equal
+// materials. The vertex shader reads its model and normal matrix from the storage buffer at drawOffset + gl_DrawIDARB.
+// Textures can't be picked per draw without bindless textures, so a scene still takes one call per distinct material,
+// but no longer one per mesh.
+//
+// check supported() first and keep the per mesh Draw loop for drivers without it (Model::DrawIndirect does). The GL 4.3
+// entry points are only compiled in with a glad generated for 4.3 or newer, like the 4.4 one in Libraries/include, otherwise
+// supported() is always false.
+// Only use it from the thread that owns the GL context, and call shutdown() before the context goes away.
+class IndirectRenderer {
+public:
+    static IndirectRenderer& instance() {
+        static IndirectRenderer renderer;
+        return renderer;
+    }
+
+    IndirectRenderer(const IndirectRenderer&) = delete;
+    IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+
+    // whether the context can draw indirect, asked once
+    static bool supported() {
+        static int result = -1;
+        if (result < 0)
+            result = detectSupport() ? 1 : 0;
+        return result == 1;
+    }
+
+    // starts a new list of draws
+    void clear() {
+        pending.clear();
+        prepared = false;
+    }
+
+    // queues the given level of detail of a mesh. view is needed for the normal matrix, like the "normalMatrix" uniform.
+    void add(Mesh& mesh, const glm::mat4& model, const glm::mat4& view, unsigned int lod = 0) {
+        PendingDraw draw;
+        draw.mesh = &mesh;
+        draw.lod = lod;
+        // format and index type on top, so every batch is one VAO and one index type. The material hash fills the rest,
+        // prepare() still compares the textures, a collision only costs an extra batch.
+        draw.sortKey = ((uint64_t)(mesh.format & 1) << 63) | ((uint64_t)(mesh.elementType() == GL_UNSIGNED_SHORT) << 62)
+                     | (mesh.material.key() >> 2);
+        draw.data.model = model;
+        draw.data.normalMatrix = glm::mat4(glm::mat3(glm::transpose(glm::inverse(view * model))));
+        draw.data.positionOffset = glm::vec4(mesh.boundsMin, 0.0f);
+        draw.data.positionScale = glm::vec4(mesh.boundsMax - mesh.boundsMin, 0.0f);
+        pending.push_back(draw);
+        prepared = false;
+    }
+
+    // sorts the queued draws into batches and fills the command and draw data arrays. CPU only, submit() calls it if needed.
+    void prepare() {
+        groupDraws();
+
+        commands.resize(pending.size());
+        drawData.resize(pending.size());
+        batches.clear();
+        for (unsigned int i = 0; i < order.size(); i++) {
+            const PendingDraw& draw = pending[order[i]];
+            DrawElementsIndirectCommand& command = commands[i];
+            draw.mesh->heapRange(draw.lod, command.firstIndex, command.count, command.baseVertex);
+            command.instanceCount = 1;
+            command.baseInstance = 0;
+            drawData[i] = draw.data;
+
+            // a new batch whenever the VAO, the index type or the textures change
+            if (batches.empty() || !sameBatch(*pending[order[batches.back().first]].mesh, *draw.mesh)) {
+                Batch batch;
+                batch.first = i;
+                batch.count = 0;
+                batches.push_back(batch);
+            }
+            batches.back().count++;
+        }
+
+        stats.draws = (unsigned int)pending.size();
+        stats.batches = (unsigned int)batches.size();
+        prepared = true;
+    }
+
+    // draws everything queued since clear() with the given shader, which has to be one of the indirect variants
+    // (modelShadersIndirect.vts / modelShadersCompactIndirect.vts). Does nothing if indirect drawing isn't supported.
+    void submit(Shader& shader) {
+        if (!prepared)
+            prepare();
+        if (!supported() || commands.empty())
+            return;
+
+#ifdef GL_VERSION_4_3
+        size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        size_t dataBytes = drawData.size() * sizeof(IndirectDrawData);
+        GLintptr commandOffset = 0, dataOffset = 0;
+
+        // into this frame's part of the RingBuffer if one is running, no copy in the driver when it's mapped
+        RingBuffer& ring = RingBuffer::instance();
+        void* commandMemory = ring.allocate(commandBytes, sizeof(GLuint), commandOffset);
+        void* dataMemory = commandMemory ? ring.allocate(dataBytes, storageAlignment(), dataOffset) : NULL;
+        if (dataMemory) {
+            memcpy(commandMemory, commands.data(), commandBytes);
+            memcpy(dataMemory, drawData.data(), dataBytes);
+            ring.flush();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer());
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INDIRECT_DRAW_DATA_BINDING, ring.buffer(), dataOffset, dataBytes);
+        }
+        else {
+            if (commandBuffer == 0) {
+                glGenBuffers(1, &commandBuffer);
+                glGenBuffers(1, &dataBuffer);
+            }
+
+            // fresh storage every frame (orphaning) so the GPU can still read last frame's commands
+            commandOffset = 0;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, commands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, dataBytes, drawData.data(), GL_STREAM_DRAW);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_DRAW_DATA_BINDING, dataBuffer);
+        }
+
+        GLStateCache::instance().useProgram(shader.ID);
+        GLint drawOffset = drawOffsetLocation(shader.ID);
+        GeometryHeap& heap = GeometryHeap::instance();
+        for (unsigned int b = 0; b < batches.size(); b++) {
+            const Batch& batch = batches[b];
+            Mesh& mesh = *pending[order[batch.first]].mesh;
+            mesh.material.bind(shader);
+            glUniform1i(drawOffset, (GLint)batch.first);
+            heap.bind(mesh.format);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.elementType(), (const void*)(commandOffset + batch.first * sizeof(DrawElementsIndirectCommand)),
+                                        (GLsizei)batch.count, 0);
+            heap.countDraws();
+        }
+#else
+        (void)shader;
+#endif
+    }
+
+    // draws and batches of the last prepare() / submit()
+    const IndirectDrawStats& lastStats() const {
+        return stats;
+    }
+
+    void shutdown() {
+        if (commandBuffer != 0) {
+            glDeleteBuffers(1, &commandBuffer);
+            glDeleteBuffers(1, &dataBuffer);
+        }
+        commandBuffer = dataBuffer = 0;
+        clear();
+    }
+
+private:
+    struct PendingDraw {
+        Mesh* mesh;
+        unsigned int lod;
+        uint64_t sortKey;
+        IndirectDrawData data;
+    };
+
+    // the draws with one sort key
+    struct Group {
+        uint64_t key;
+        unsigned int count;
+        unsigned int first;     // in order
+    };
+
+    // a run of commands drawn with one call, starting at commands[first]
+    struct Batch {
+        unsigned int first;
+        unsigned int count;
+    };
+
+    vector<PendingDraw> pending;
+    vector<unsigned int> order;     // indices into pending, in batch order
+    vector<Group> groups;
+    vector<unsigned int> groupOrder;
+    vector<int> groupSlots;         // hash table of group indices by key, -1 for free
+    vector<unsigned int> drawGroups;
+    vector<DrawElementsIndirectCommand> commands;
+    vector<IndirectDrawData> drawData;
+    vector<Batch> batches;
+    bool prepared = false;
+    IndirectDrawStats stats;
+
+    GLuint commandBuffer = 0;
+    GLuint dataBuffer = 0;
+    unordered_map<unsigned int, GLint> drawOffsetLocations;
+
+    IndirectRenderer() {}
+
+    // orders the draws by sort key, keeping the submission order among equal keys. A frame has many draws but few distinct
+    // keys, so the draws are counted per key through a hash table and placed with a counting sort, only the groups get
+    // sorted by key.
+    void groupDraws() {
+        size_t slotCount = 16;
+        while (slotCount < pending.size() * 2)
+            slotCount <<= 1;
+        groupSlots.assign(slotCount, -1);
+        groups.clear();
+        drawGroups.resize(pending.size());
+
+        for (unsigned int i = 0; i < pending.size(); i++) {
+            uint64_t key = pending[i].sortKey;
+            size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (slotCount - 1);
+            while (groupSlots[slot] >= 0 && groups[groupSlots[slot]].key != key)
+                slot = (slot + 1) & (slotCount - 1);
+            if (groupSlots[slot] < 0) {
+                groupSlots[slot] = (int)groups.size();
+                Group group;
+                group.key = key;
+                group.count = 0;
+                groups.push_back(group);
+            }
+            drawGroups[i] = (unsigned int)groupSlots[slot];
+            groups[groupSlots[slot]].count++;
+        }
+
+        groupOrder.resize(groups.size());
+        for (unsigned int g = 0; g < groups.size(); g++)
+            groupOrder[g] = g;
+        std::sort(groupOrder.begin(), groupOrder.end(), [this](unsigned int a, unsigned int b) { return groups[a].key < groups[b].key; });
+        unsigned int first = 0;
+        for (unsigned int g = 0; g < groupOrder.size(); g++) {
+            groups[groupOrder[g]].first = first;
+            first += groups[groupOrder[g]].count;
+        }
+
+        order.resize(pending.size());
+        for (unsigned int i = 0; i < pending.size(); i++)
+            order[groups[drawGroups[i]].first++] = i;
+    }
+
+    static bool sameBatch(const Mesh& a, const Mesh& b) {
+        return a.format == b.format && a.elementType() == b.elementType() && a.material.sameTextures(b.material);
+    }
+
+#ifdef GL_VERSION_4_3
+    // what offsets into a storage buffer have to be a multiple of
+    static size_t storageAlignment() {
+        static GLint alignment = 0;
+        if (alignment == 0) {
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            if (alignment <= 0)
+                alignment = 256;
+        }
+        return (size_t)alignment;
+    }
+#endif
+
+    GLint drawOffsetLocation(unsigned int program) {
+        unordered_map<unsigned int, GLint>::iterator it = drawOffsetLocations.find(program);
+        if (it != drawOffsetLocations.end())
+            return it->second;
+        GLint location = glGetUniformLocation(program, "drawOffset");
+        drawOffsetLocations[program] = location;
+        return location;
+    }
+
+    static bool detectSupport() {
+#ifdef GL_VERSION_4_3
+        if (!GLAD_GL_VERSION_4_3)
+            return false;
+
+        // gl_DrawIDARB in the vertex shader, glad looks for the extension itself when it was generated with it
+#ifdef GL_ARB_shader_draw_parameters
+        if (GLAD_GL_ARB_shader_draw_parameters)
+            return true;
+#else
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions; i++) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (name && strcmp(name, "GL_ARB_shader_draw_parameters") == 0)
+                return true;
+        }
+#endif
+        std::cout << "INDIRECT_RENDERER::GL_ARB_shader_draw_parameters MISSING, DRAWING MESH BY MESH" << std::endl;
+        return false;
+#else
+        return false;
+#endif
+    }
+};
+
+#endif // !INDIRECT_RENDERER_H
@@ -0,0 +1,236 @@
+#pragma once
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "GLStateCache.h"
+#include "RingBuffer.h"
+
+using namespace std;
+
+// what an instance carries besides its model matrix
+enum InstanceAttributes {
+    INSTANCE_MODEL_ONLY = 0,
+    INSTANCE_NORMAL_MATRIX = 1 << 0,    // mat3(transpose(inverse(model))), normals in world space like FragPos
+    INSTANCE_MATERIAL = 1 << 1          // an int, e.g. an index into a uniform array of colours or materials
+};
+
+// per instance vertex attributes for drawing the same geometry many times with one glDraw*Instanced call, instead of a
+// setMat4("model") and a draw per copy.
+//
+// the attributes start at the location given to attach() (3 by default, after position / normal / texture coordinates):
+//     location + 0 .. 3   mat4 model
+//     location + 4 .. 6   mat3 normalMatrix   (INSTANCE_NORMAL_MATRIX)
+//     location + 7        int material        (INSTANCE_MATERIAL)
+// so an instanced vertex shader declares e.g. "layout (location = 3) in mat4 model;" in place of the uniform.
+//
+// the instances are kept on the CPU and only go to the GPU when they changed. While the RingBuffer has a frame open they
+// are written into it and the attached vertex arrays are pointed at that frame's copy, so instances that change every
+// frame cost no buffer reallocation and no copy in the driver. Instances that stop changing move to a buffer of their own
+// once that frame is over (the ring reuses its regions), with one glBufferSubData, and from then on every frame costs one
+// draw call however many there are. Without an open ring frame changed instances go straight to the own buffer.
+// Only use it on the thread that owns the GL context, and call shutdown() (or destroy it) before the context goes away.
+class InstanceBuffer {
+public:
+    static const GLuint DEFAULT_LOCATION = 3;
+
+    explicit InstanceBuffer(unsigned int attributes = INSTANCE_MODEL_ONLY) : attributes(attributes) {
+        instanceBytes = sizeof(glm::mat4);
+        if (attributes & INSTANCE_NORMAL_MATRIX)
+            instanceBytes += sizeof(glm::mat3);
+        if (attributes & INSTANCE_MATERIAL)
+            instanceBytes += sizeof(GLint);
+    }
+
+    ~InstanceBuffer() {
+        shutdown();
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // adds the instance attributes to a vertex array, any number of vertex arrays can share the buffer. Binds the vertex
+    // array and leaves 0 bound, so do it while setting up, before a GLStateCache is in use (or invalidate it after).
+    void attach(GLuint vao, GLuint location = DEFAULT_LOCATION) {
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            source = buffer;
+            sourceOffset = 0;
+        }
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, source);
+        enableAttributes(location, 0, 4);
+        if (attributes & INSTANCE_NORMAL_MATRIX)
+            enableAttributes(location, 4, 3);
+        if (attributes & INSTANCE_MATERIAL)
+            enableAttributes(location, 7, 1);
+        setPointers(location);
+        glBindVertexArray(0);
+        vertexArrays.push_back(make_pair(vao, location));
+    }
+
+    void clear() {
+        data.clear();
+        dirty = true;
+    }
+
+    void reserve(unsigned int count) {
+        data.reserve((size_t)count * instanceBytes);
+    }
+
+    // returns the index of the new instance
+    unsigned int add(const glm::mat4& model, int material = 0) {
+        unsigned int index = size();
+        data.resize(data.size() + instanceBytes);
+        set(index, model, material);
+        return index;
+    }
+
+    void set(unsigned int index, const glm::mat4& model, int material = 0) {
+        unsigned char* instance = &data[(size_t)index * instanceBytes];
+        memcpy(instance, &model[0][0], sizeof(glm::mat4));
+        instance += sizeof(glm::mat4);
+        if (attributes & INSTANCE_NORMAL_MATRIX) {
+            glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+            memcpy(instance, &normalMatrix[0][0], sizeof(glm::mat3));
+            instance += sizeof(glm::mat3);
+        }
+        if (attributes & INSTANCE_MATERIAL) {
+            GLint value = material;
+            memcpy(instance, &value, sizeof(value));
+        }
+        dirty = true;
+    }
+
+    unsigned int size() const {
+        return (unsigned int)(data.size() / instanceBytes);
+    }
+
+    // copies the instances to the GPU if they changed since the last upload, and out of the ring once they stopped
+    // changing. The draws call it themselves.
+    void upload() {
+        if (buffer == 0)
+            return;
+        RingBuffer& ring = RingBuffer::instance();
+        if (!dirty) {
+            if (source != buffer && (!ring.frameOpen() || ring.currentFrame() != ringFrame))
+                uploadToBuffer();
+            return;
+        }
+
+        GLintptr offset = 0;
+        void* memory = data.empty() ? NULL : ring.allocate(data.size(), 16, offset);
+        if (memory) {
+            memcpy(memory, data.data(), data.size());
+            ring.flush();
+            ringFrame = ring.currentFrame();
+            pointAt(ring.buffer(), offset);
+        }
+        else
+            uploadToBuffer();
+        dirty = false;
+    }
+
+    // draw every instance with the vertex array bound now, which has to be one this buffer is attached to and bound through
+    // the GLStateCache (a frame in the ring may re-point the vertex arrays and bind the cached one again)
+    void drawArrays(GLenum mode, GLint first, GLsizei count) {
+        upload();
+        if (size() > 0)
+            glDrawArraysInstanced(mode, first, count, (GLsizei)size());
+    }
+
+    void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+        upload();
+        if (size() > 0)
+            glDrawElementsInstanced(mode, count, type, indices, (GLsizei)size());
+    }
+
+    // deletes the buffer, the vertex arrays it was attached to mustn't draw instanced after this
+    void shutdown() {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = source = 0;
+        sourceOffset = 0;
+        capacity = 0;
+        vertexArrays.clear();
+        dirty = true;
+    }
+
+private:
+    unsigned int attributes;
+    size_t instanceBytes;
+    vector<unsigned char> data;     // the instances, instanceBytes each, laid out like the buffer
+    GLuint buffer = 0;
+    size_t capacity = 0;            // bytes the buffer has storage for
+    bool dirty = true;
+
+    // where the attached vertex arrays read the instances from: buffer at 0, or a RingBuffer frame's copy
+    GLuint source = 0;
+    GLintptr sourceOffset = 0;
+    unsigned long long ringFrame = 0;               // the ring frame the copy there was written in
+    vector<pair<GLuint, GLuint> > vertexArrays;     // attached, with their first instance location
+
+    // the locations keep their place whatever else the instances carry, so the material is at location + 7 even without
+    // the normal matrix
+    void enableAttributes(GLuint location, GLuint first, GLuint count) {
+        for (GLuint i = first; i < first + count; i++) {
+            glEnableVertexAttribArray(location + i);
+            glVertexAttribDivisor(location + i, 1);
+        }
+    }
+
+    void uploadToBuffer() {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (data.size() > capacity)
+            capacity = data.capacity();
+        // fresh storage every time (orphaning), so the GPU can keep reading the old instances while the new ones are written
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+        if (!data.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, data.size(), data.data());
+        pointAt(buffer, 0);
+    }
+
+    // re-points every attached vertex array through the GLStateCache, which binds the vertex array it had bound again
+    void pointAt(GLuint newSource, GLintptr offset) {
+        if (newSource == source && offset == sourceOffset)
+            return;
+        source = newSource;
+        sourceOffset = offset;
+
+        GLStateCache& state = GLStateCache::instance();
+        GLuint boundVertexArray = state.vertexArray();
+        glBindBuffer(GL_ARRAY_BUFFER, source);
+        for (size_t i = 0; i < vertexArrays.size(); i++) {
+            state.bindVertexArray(vertexArrays[i].first);
+            setPointers(vertexArrays[i].second);
+        }
+        if (boundVertexArray != 0xFFFFFFFF)
+            state.bindVertexArray(boundVertexArray);
+    }
+
+    // the attribute pointers of the bound vertex array into the buffer bound to GL_ARRAY_BUFFER, which has to be source
+    void setPointers(GLuint location) {
+        size_t offset = (size_t)sourceOffset;
+        for (GLuint column = 0; column < 4; column++)
+            glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, (GLsizei)instanceBytes, (void*)(offset + column * sizeof(glm::vec4)));
+        offset += sizeof(glm::mat4);
+
+        if (attributes & INSTANCE_NORMAL_MATRIX) {
+            for (GLuint column = 0; column < 3; column++)
+                glVertexAttribPointer(location + 4 + column, 3, GL_FLOAT, GL_FALSE, (GLsizei)instanceBytes, (void*)(offset + column * sizeof(glm::vec3)));
+            offset += sizeof(glm::mat3);
+        }
+
+        if (attributes & INSTANCE_MATERIAL)
+            glVertexAttribIPointer(location + 7, 1, GL_INT, (GLsizei)instanceBytes, (void*)offset);
+    }
+};
+
+#endif // !INSTANCE_BUFFER_H
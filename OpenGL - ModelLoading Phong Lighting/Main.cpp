@@ -9,7 +9,10 @@
 
 #include "Shaders.h"
 #include "Camera.h" 
+#include "CameraUniforms.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "RingBuffer.h"
 #include "src/stb_image.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -31,18 +34,30 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// F1 switches the once a second stats printing on and off, it starts off
+bool printStats = false;
+bool statsKeyDown = false;
+
 int main()
 {
     // glfw: initialize and configure
     // ------------------------------
+    // 4.4 for the persistently mapped RingBuffer, 4.3 for the indirect drawing (see IndirectRenderer.h), the glad in
+    // Libraries/include is generated for 4.4. Without a 4.4 driver the ring falls back to glBufferSubData, and on 3.3
+    // everything still runs and draws mesh by mesh
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Model Loading", NULL, NULL);
+    const int contextVersions[][2] = { { 4, 4 }, { 4, 3 }, { 3, 3 } };
+    GLFWwindow* window = NULL;
+    for (int i = 0; i < 3 && window == NULL; i++)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Model Loading", NULL, NULL);
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -70,15 +85,43 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::instance().enable(GL_DEPTH_TEST);
 
-    // build and compile shaders
-    // -------------------------
-    Shader ourShader("modelShaders.vts", "modelShaders.fts");
+    // a triple buffered ring for whatever is written anew every frame (the camera block, the IndirectRenderer's commands and
+    // moving instances go there), the CPU may be at most two frames ahead of the GPU
+    RingBuffer::instance().init(1024 * 1024);
+    RingBuffer::instance().setFramesInFlight(2);
 
     // load models
     // -----------
-    Model ourModel("Libraries/models/backpack.obj");
+    // the model is imported on a worker thread and its textures are decoded on others, both get uploaded a few at a time
+    // inside the render loop so the window shows up right away
+    AsyncTextureLoader textureLoader;
+    ModelLoader modelLoader;
+    ModelLoadOptions loadOptions;
+    loadOptions.textureLoader = &textureLoader;
+    loadOptions.vertexFormat = VERTEX_FORMAT_COMPACT; // half the vertex memory, needs the matching vertex shader below
+    loadOptions.textureCompression = TEXTURE_COMPRESSION_FAST; // BCn textures, cooked once next to the images
+    loadOptions.residency = MESH_RESIDENCY_DISCARD; // nothing here reads the geometry back, the GPU copy is enough
+    shared_ptr<Model> ourModel = modelLoader.load("Libraries/models/backpack.obj", loadOptions);
+    bool modelReported = false;
+
+    // build and compile shaders
+    // -------------------------
+    Shader ourShader(loadOptions.vertexFormat == VERTEX_FORMAT_COMPACT ? "modelShadersCompact.vts" : "modelShaders.vts", "modelShaders.fts");
+    CameraUniforms::instance().attach(ourShader.ID);
+    // the indirect variant needs GL 4.3 and GL_ARB_shader_draw_parameters to compile, without them DrawIndirect falls back
+    // to drawing mesh by mesh with ourShader
+    unique_ptr<Shader> indirectShader;
+    if (IndirectRenderer::supported()) {
+        indirectShader.reset(new Shader(loadOptions.vertexFormat == VERTEX_FORMAT_COMPACT ? "modelShadersCompactIndirect.vts" : "modelShadersIndirect.vts",
+                                        "modelShaders.fts"));
+        CameraUniforms::instance().attach(indirectShader->ID);
+    }
+    Shader& drawShader = indirectShader ? *indirectShader : ourShader;
+    bool texturesReported = false;
+    bool firstFrame = true;
+    float lastReport = 0.0f;
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -96,47 +139,95 @@ int main()
         // -----
         processInput(window);
 
+        GeometryHeap::instance().beginFrame();
+        GLStateCache::instance().beginFrame();
+        RingBuffer::instance().beginFrame();
+
+        // finish any model and texture uploads that are ready, keeping at most ~2ms of the frame for each
+        modelLoader.update(2.0);
+        if (!modelReported && ourModel->isReady()) {
+            std::cout << "MODEL::GPU GEOMETRY " << ourModel->gpuGeometryBytes() / 1024 << " KB" << std::endl;
+            ourModel->printMemoryReport();
+            modelReported = true;
+        }
+        textureLoader.update(2.0);
+        if (!texturesReported && textureLoader.pendingCount() == 0) {
+            textureLoader.printStats();
+            TextureRegistry::instance().printStats();
+            texturesReported = true;
+        }
+
         // render
         // ------
         glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // view/projection transformations, uploaded once for every shader through the Camera uniform block
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = camera.GetViewMatrix();
+        CameraUniforms::instance().update(view, projection, camera.Position, currentFrame);
+
         // don't forget to enable shader before setting uniforms
-        ourShader.use();
+        drawShader.use();
         // set uniforms for point light
-        ourShader.setVec3("viewPosition", camera.Position);
-        ourShader.setVec3("torch.lightPosition", -2.0f, 1.0f, 2.0f);
-        ourShader.setVec4("torch.diffuse", 1.0f, 1.0f, 1.0f, 1.0f);
-        ourShader.setVec4("torch.specular", 0.3f, 0.3f, 0.3f, 1.0f);
-        ourShader.setFloat("torch.constant", 1.0f);
-        ourShader.setFloat("torch.linear", 0.22f);
-        ourShader.setFloat("torch.quadratic", 0.2f);
-
+        drawShader.setVec3("torch.lightPosition", -2.0f, 1.0f, 2.0f);
+        drawShader.setVec4("torch.diffuse", 1.0f, 1.0f, 1.0f, 1.0f);
+        drawShader.setVec4("torch.specular", 0.3f, 0.3f, 0.3f, 1.0f);
+        drawShader.setFloat("torch.constant", 1.0f);
+        drawShader.setFloat("torch.linear", 0.22f);
+        drawShader.setFloat("torch.quadratic", 0.2f);
 
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
 
         // render the loaded model
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
         model = glm::rotate(model, (float)glfwGetTime() * glm::radians(20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        ourModel.Draw(ourShader);
-
+        // the indirect shader reads its matrices from the per draw data, these are for the mesh by mesh fallback
+        drawShader.setMat4("model", model);
         glm::mat3 normalMatrix = glm::mat3(transpose(inverse(view * model)));
-        ourShader.setMat3("normalMatrix", normalMatrix);
+        drawShader.setMat3("normalMatrix", normalMatrix);
+        // skips meshes outside the view, the rest go out in one glMultiDrawElementsIndirect per material
+        ourModel->DrawIndirect(drawShader, ourShader, projection, view, model);
+
 
+        RingBuffer::instance().endFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        // report the draws, the geometry heap usage and the GL state changes about once a second while F1 has it on. The
+        // counters run either way, their stats() / lastStats() are there for anything else that wants them
+        if (printStats && currentFrame - lastReport >= 1.0f && ourModel->isReady()) {
+            const IndirectDrawStats& draws = IndirectRenderer::instance().lastStats();
+            if (IndirectRenderer::supported())
+                std::cout << "MODEL::INDIRECT " << draws.draws << " meshes in " << draws.batches << " glMultiDrawElementsIndirect calls, ";
+            else
+                std::cout << "MODEL::MESH BY MESH " << ourModel->meshCount() << " meshes, ";
+            std::cout << ourModel->lastDrawTriangles() << " triangles drawn" << std::endl;
+            GeometryHeap::instance().printStats();
+            GLStateCache::instance().printStats();
+            RingBuffer::instance().printStats();
+            lastReport = currentFrame;
+        }
+
+        if (firstFrame) {
+            std::cout << "MAIN::FIRST FRAME AFTER " << glfwGetTime() * 1000.0 << " ms" << std::endl;
+            firstFrame = false;
+        }
     }
 
+    // stop the loader workers and free the model while the context still exists
+    modelLoader.shutdown();
+    ourModel.reset();
+    textureLoader.shutdown();
+    IndirectRenderer::instance().shutdown();
+    GeometryHeap::instance().shutdown();
+    RingBuffer::instance().shutdown();
+    CameraUniforms::instance().shutdown();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -150,6 +241,12 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // F1 switches the stats printing, only on the press, not every frame it's held
+    bool statsKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+        printStats = !printStats;
+    statsKeyDown = statsKey;
+
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
         camera.ProcessKeyboard(FORWARD, deltaTime); 
         std::cout << "W pressed" << std::endl;
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            close();
+            return false;
+        }
+
+        bytes = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (bytes == NULL) {
+            close();
+            return false;
+        }
+#else
+        fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fileDescriptor, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        length = (size_t)info.st_size;
+
+        void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close();
+            return false;
+        }
+        bytes = (const unsigned char*)mapping;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap((void*)bytes, length);
+        if (fileDescriptor >= 0) ::close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = NULL;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#else
+    int fileDescriptor = -1;
+#endif
+};
+
+// 64 bit FNV-1a over the file contents, returns 0 if the file can't be read. fileSize (if given) gets the byte count.
+inline uint64_t hashFileContents(const string& path, size_t* fileSize = NULL) {
+    MappedFile file;
+    if (!file.open(path))
+        return 0;
+    if (fileSize)
+        *fileSize = file.size();
+
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* data = file.data();
+    for (size_t i = 0; i < file.size(); i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GLStateCache.h"
+#include "Shaders.h"
+
+using namespace std;
+
+struct Texture {
+    unsigned int id;
+    string type;
+    string path;
+};
+
+// what a texture is used for, interned from the Texture::type strings when a material is compiled
+enum TextureSlot {
+    TEXTURE_SLOT_DIFFUSE,   // "texture_diffuse", sampled as texture_diffuseN
+    TEXTURE_SLOT_SPECULAR,  // "texture_specular", texture_specularN
+    TEXTURE_SLOT_NORMAL,    // "texture_normal", texture_normalN
+    TEXTURE_SLOT_HEIGHT,    // "texture_height", texture_heightN
+    TEXTURE_SLOT_COUNT
+};
+
+inline const char* textureSlotType(TextureSlot slot) {
+    static const char* const types[TEXTURE_SLOT_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    return slot < TEXTURE_SLOT_COUNT ? types[slot] : "";
+}
+
+// returns TEXTURE_SLOT_COUNT for a type no shader samples
+inline TextureSlot textureSlotFromType(const string& type) {
+    for (int slot = 0; slot < TEXTURE_SLOT_COUNT; slot++) {
+        if (type == textureSlotType((TextureSlot)slot))
+            return (TextureSlot)slot;
+    }
+    return TEXTURE_SLOT_COUNT;
+}
+
+const unsigned int MATERIAL_MAX_TEXTURES = 16;          // texture units, the most GL 3.3 guarantees for a fragment shader
+const unsigned int MATERIAL_MAX_SAMPLERS_PER_SLOT = 4;  // texture_diffuse1 .. texture_diffuse4
+
+// the uniform locations drawing a mesh needs, looked up once per shader program and kept for the rest of the run.
+// -1 for whatever the program doesn't use, glUniform ignores those.
+struct MeshUniforms {
+    unsigned int program = 0;
+    GLint samplers[TEXTURE_SLOT_COUNT][MATERIAL_MAX_SAMPLERS_PER_SLOT];
+    GLint model = -1;
+    GLint normalMatrix = -1;
+    GLint positionOffset = -1;  // compact vertex format only
+    GLint positionScale = -1;
+
+    // the locations of the given program, resolved by name on its first use. Only call it on the GL thread.
+    static const MeshUniforms& of(unsigned int program) {
+        static unordered_map<unsigned int, MeshUniforms> programs;
+        unordered_map<unsigned int, MeshUniforms>::iterator it = programs.find(program);
+        if (it != programs.end())
+            return it->second;
+
+        MeshUniforms& uniforms = programs[program];
+        uniforms.program = program;
+        for (int slot = 0; slot < TEXTURE_SLOT_COUNT; slot++) {
+            for (unsigned int n = 0; n < MATERIAL_MAX_SAMPLERS_PER_SLOT; n++)
+                uniforms.samplers[slot][n] = samplerLocation(program, textureSlotType((TextureSlot)slot), n + 1);
+        }
+        uniforms.model = glGetUniformLocation(program, "model");
+        uniforms.normalMatrix = glGetUniformLocation(program, "normalMatrix");
+        uniforms.positionOffset = glGetUniformLocation(program, "positionOffset");
+        uniforms.positionScale = glGetUniformLocation(program, "positionScale");
+        return uniforms;
+    }
+
+private:
+    // the Nth sampler of a type, either inside a "material" struct or at the top level of the shader (modelShaders.fts
+    // has texture_diffuse1 and texture_specular1 at the top). The first sampler may also go without its number.
+    static GLint samplerLocation(unsigned int program, const string& type, unsigned int number) {
+        string names[4] = { "material." + type + to_string(number), type + to_string(number), "material." + type, type };
+        for (unsigned int i = 0; i < (number == 1 ? 4u : 2u); i++) {
+            GLint location = glGetUniformLocation(program, names[i].c_str());
+            if (location >= 0)
+                return location;
+        }
+        return -1;
+    }
+};
+
+// the textures of a mesh compiled for drawing. compile() turns the type strings into slots once and gives every texture
+// its texture unit and the index of its sampler (the N in texture_diffuseN), so bind() is nothing but GL calls: the
+// sampler locations come from the MeshUniforms of the shader, which are looked up again only when the program changes.
+class Material {
+public:
+    void compile(const vector<Texture>& textures) {
+        count = 0;
+        unsigned int perSlot[TEXTURE_SLOT_COUNT] = {};
+        for (unsigned int i = 0; i < textures.size(); i++) {
+            if (count == MATERIAL_MAX_TEXTURES) {
+                std::cout << "WARNING::MATERIAL::MORE THAN " << MATERIAL_MAX_TEXTURES << " TEXTURES, THE REST ARE NOT BOUND" << std::endl;
+                break;
+            }
+
+            TextureSlot slot = textureSlotFromType(textures[i].type);
+            if (slot == TEXTURE_SLOT_COUNT)
+                std::cout << "WARNING::MATERIAL::UNKNOWN TEXTURE TYPE " << textures[i].type << std::endl;
+
+            Binding& binding = bindings[count++];
+            binding.texture = textures[i].id;
+            binding.slot = (uint8_t)slot;
+            binding.sampler = slot < TEXTURE_SLOT_COUNT ? (uint8_t)perSlot[slot]++ : 0;
+        }
+        uniforms = NULL;
+        bindingsKey = hashBindings();
+    }
+
+    // binds every texture to its unit and points its sampler at it, returns the locations of the shader's other uniforms
+    const MeshUniforms& bind(const Shader& shader) {
+        if (!uniforms || uniforms->program != shader.ID)
+            uniforms = &MeshUniforms::of(shader.ID);
+
+        // meshes sharing a texture find it already bound, the state cache drops those binds
+        GLStateCache& state = GLStateCache::instance();
+        for (unsigned int i = 0; i < count; i++) {
+            const Binding& binding = bindings[i];
+            state.bindTexture(GL_TEXTURE0 + i, GL_TEXTURE_2D, binding.texture);
+            if (binding.slot < TEXTURE_SLOT_COUNT && binding.sampler < MATERIAL_MAX_SAMPLERS_PER_SLOT)
+                glUniform1i(uniforms->samplers[binding.slot][binding.sampler], (GLint)i);
+        }
+        return *uniforms;
+    }
+
+    unsigned int textureCount() const { return count; }
+
+    // true if binding the other material would bind the same textures to the same units and samplers
+    bool sameTextures(const Material& other) const {
+        if (count != other.count)
+            return false;
+        for (unsigned int i = 0; i < count; i++) {
+            if (bindings[i].texture != other.bindings[i].texture || bindings[i].slot != other.bindings[i].slot
+                || bindings[i].sampler != other.bindings[i].sampler)
+                return false;
+        }
+        return true;
+    }
+
+    // hash of the bindings, equal for materials with sameTextures(). For sorting draws so those sharing textures line up.
+    uint64_t key() const { return bindingsKey; }
+
+private:
+    // texture unit = index in bindings
+    struct Binding {
+        unsigned int texture;
+        uint8_t slot;       // TextureSlot, TEXTURE_SLOT_COUNT if no sampler takes it
+        uint8_t sampler;    // N - 1 in texture_diffuseN
+    };
+
+    Binding bindings[MATERIAL_MAX_TEXTURES];
+    unsigned int count = 0;
+    const MeshUniforms* uniforms = NULL;    // of the program bind() saw last
+    uint64_t bindingsKey = 0;
+
+    uint64_t hashBindings() const {
+        uint64_t hash = 14695981039346656037ull;    // FNV-1a
+        for (unsigned int i = 0; i < count; i++) {
+            uint64_t value = ((uint64_t)bindings[i].texture << 16) | ((uint64_t)bindings[i].slot << 8) | bindings[i].sampler;
+            for (int b = 0; b < 8; b++) {
+                hash ^= (value >> (b * 8)) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+};
+
+#endif // !MATERIAL_H
@@ -4,10 +4,15 @@
 
 #include <glm/glm.hpp>
 
+#include "GeometryHeap.h"
+#include "Material.h"
+#include "Meshlets.h"
 #include "Shaders.h"
+#include "VertexCompression.h"
 
 #include <vector>
 #include <string>
+#include <utility>
 
 using namespace std;
 
@@ -18,89 +23,220 @@ struct Vertex {
     glm::vec2 TexCoords;
 };
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// one level of detail: a range of the mesh's index buffer plus the geometric error (model units) of drawing that range
+// instead of the full mesh. Level 0 is always the full resolution mesh with an error of 0.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+// how a mesh stores its vertices on the GPU. The CPU side copy is always the full Vertex.
+enum VertexFormat {
+    VERTEX_FORMAT_FULL,     // 32 byte Vertex, 32 bit indices, drawn with modelShaders.vts
+    VERTEX_FORMAT_COMPACT   // 16 byte CompactVertex, 16 bit indices when possible, drawn with modelShadersCompact.vts
 };
 
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
-    vector<unsigned int> indices;
+    vector<unsigned int> indices;   // every level of detail back to back, see lods
     vector<Texture>      textures;
+    Material             material;  // the textures compiled for drawing, call compileMaterial() after changing them
+    vector<MeshLod>      lods;      // at least one entry, finest first
+    vector<Meshlet>      meshlets;  // clusters of the full detail level for culling, empty if none were built
+    unsigned int         node = 0;  // the node of the owning model's TransformGraph this mesh is attached to
+
+    // axis aligned bounding box of the vertex positions, in model space
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // GPU side layout and size
+    VertexFormat format;
+    size_t vertexBufferBytes = 0;
+    size_t indexBufferBytes = 0;
+
+    // constructor, takes over the arrays. Pass them with std::move and nothing gets copied on the way in.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VERTEX_FORMAT_FULL)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->format = format;
+        this->lods.assign(1, MeshLod{ 0, (unsigned int)this->indices.size(), 0.0f });
+
+        computeBounds();
+        compileMaterial();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // a Mesh owns its ranges of the geometry heap, so it can only be moved. The moved from Mesh is left without any.
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) = default;
+
+    // frees this mesh's own ranges first, while format still says which heap they came from, then takes other's
+    Mesh& operator=(Mesh&& other) noexcept
     {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++) {
+        if (this == &other)
+            return *this;
+        release();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        material = std::move(other.material);
+        lods = std::move(other.lods);
+        meshlets = std::move(other.meshlets);
+        node = other.node;
+        boundsMin = other.boundsMin;
+        boundsMax = other.boundsMax;
+        format = other.format;
+        vertexBufferBytes = other.vertexBufferBytes;
+        indexBufferBytes = other.indexBufferBytes;
+        vertexAllocation = std::move(other.vertexAllocation);
+        indexAllocation = std::move(other.indexAllocation);
+        indexCount = other.indexCount;
+        indexType = other.indexType;
+        rangeOffsets = std::move(other.rangeOffsets);
+        rangeBaseVertices = std::move(other.rangeBaseVertices);
+        return *this;
+    }
 
-            glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
+    ~Mesh()
+    {
+        release();
+    }
 
+    // bounding box of a vertex array, all zero if it's empty
+    static void computeBounds(const Vertex* vertexData, size_t vertexCount, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        if (vertexCount == 0)
+            return;
 
-           if (name == "texture_diffuse") {
-               number = std::to_string(diffuseNr++);
+        boundsMin = boundsMax = vertexData[0].Position;
+        for (size_t i = 1; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = glm::max(boundsMax, vertexData[i].Position);
+        }
+    }
 
-              // std::cout << "MESH::CLASS CURRENT TEXTURE NAME: " << name << diffuseNr << std::endl;
+    // resolves the texture types into the material, done by the constructors. Only needed again if textures change.
+    void compileMaterial()
+    {
+        material.compile(textures);
+    }
 
-           } 
-           else if (name == "texture_specular") {
-               number = std::to_string(specularNr++);
+    // number of triangles drawn at the given level of detail
+    unsigned int triangleCount(unsigned int lod = 0) const
+    {
+        return lods[lod < lods.size() ? lod : lods.size() - 1].indexCount / 3;
+    }
 
-               // std::cout << "MESH::CLASS CURRENT TEXTURE NAME: " << name << specularNr << std::endl;
+    // render the mesh, lod picks the level of detail (clamped to the coarsest one available)
+    void Draw(Shader& shader, unsigned int lod = 0)
+    {
+        bindMaterial(shader);
 
-            } 
+        // draw mesh, the shared VAO of our vertex format stays bound for whatever mesh comes next
+        const MeshLod& level = lods[lod < lods.size() ? lod : lods.size() - 1];
+        GeometryHeap& heap = GeometryHeap::instance();
+        heap.bind(format);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)level.indexCount, indexType,
+            (void*)(heap.indexByteOffset(indexAllocation) + level.firstIndex * indexSize()), heap.baseVertex(format, vertexAllocation));
+        heap.countDraws();
 
-            shader.setInt(("material." + name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
 
-        }
+    // where a level of detail sits in the geometry heap, the way an indirect draw command wants it: the first index counted
+    // in indices of elementType() from the start of the shared index buffer, the index count and the base vertex
+    void heapRange(unsigned int lod, GLuint& firstIndex, GLuint& count, GLint& baseVertex) const
+    {
+        const MeshLod& level = lods[lod < lods.size() ? lod : lods.size() - 1];
+        GeometryHeap& heap = GeometryHeap::instance();
+        firstIndex = (GLuint)(heap.indexByteOffset(indexAllocation) / indexSize() + level.firstIndex);
+        count = (GLuint)level.indexCount;
+        baseVertex = heap.baseVertex(format, vertexAllocation);
+    }
 
-        glActiveTexture(GL_TEXTURE0);
+    // GL_UNSIGNED_INT, or GL_UNSIGNED_SHORT for compact meshes with few enough vertices
+    GLenum elementType() const
+    {
+        return indexType;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // render several index ranges with one call, e.g. the meshlets that survived culling
+    void DrawRanges(Shader& shader, const vector<GLsizei>& counts, const vector<unsigned int>& firstIndices)
+    {
+        if (counts.empty())
+            return;
 
-    }
+        bindMaterial(shader);
 
-private:
-    // render data 
-    unsigned int VAO, VBO, EBO;
+        GeometryHeap& heap = GeometryHeap::instance();
+        size_t indexOffset = heap.indexByteOffset(indexAllocation);
+        GLint baseVertex = heap.baseVertex(format, vertexAllocation);
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+        rangeOffsets.resize(firstIndices.size());
+        rangeBaseVertices.assign(firstIndices.size(), baseVertex);
+        for (unsigned int i = 0; i < firstIndices.size(); i++)
+            rangeOffsets[i] = (const void*)(indexOffset + firstIndices[i] * indexSize());
+
+        heap.bind(format);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, rangeOffsets.data(), (GLsizei)counts.size(), rangeBaseVertices.data());
+        heap.countDraws();
+    }
+
+    // frees the CPU side vertices and indices and the texture paths once the GPU has its copy. Drawing only needs the
+    // material, the bounds, lods and meshlets. Returns the number of bytes given back.
+    size_t releaseCpuData()
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+
+        for (unsigned int i = 0; i < textures.size(); i++) {
+            bytes += textures[i].path.capacity() > 15 ? textures[i].path.capacity() + 1 : 0;
+            string().swap(textures[i].path);
+        }
+        return bytes;
+    }
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    // gives the vertex and index ranges back to the geometry heap. The destructor does it too, calling it earlier (e.g.
+    // while the GL context is still current) is fine.
+    void release()
+    {
+        if (vertexAllocation == TlsfAllocator::INVALID && indexAllocation == TlsfAllocator::INVALID)
+            return;
 
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        GeometryHeap& heap = GeometryHeap::instance();
+        if (vertexAllocation != TlsfAllocator::INVALID)
+            heap.freeVertices(format, vertexAllocation);
+        if (indexAllocation != TlsfAllocator::INVALID)
+            heap.freeIndices(indexAllocation);
+        vertexAllocation = TlsfAllocator::INVALID;
+        indexAllocation = TlsfAllocator::INVALID;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-            &indices[0], GL_STATIC_DRAW);
+    // attribute layout of each vertex format, relative to the start of the shared vertex buffer (baseVertex does the rest)
+    static void setupAttributes(unsigned int format)
+    {
+        if (format == VERTEX_FORMAT_COMPACT) {
+            // positions: 0..65535 -> 0..1
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Position));
+            // octahedral normals: -32767..32767 -> -1..1
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
+            // texture coords as half floats
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords));
+            return;
+        }
 
         // vertex positions
         glEnableVertexAttribArray(0);
@@ -111,8 +247,105 @@ private:
         // vertex texture coords
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    }
+
+private:
+    // handle of a geometry heap range that moves with its Mesh and leaves INVALID behind. Assigning one overwrites the
+    // old value, the Mesh releases its range before that.
+    struct GeometryHandle {
+        uint32_t value = TlsfAllocator::INVALID;
+
+        GeometryHandle() {}
+        GeometryHandle(GeometryHandle&& other) noexcept : value(other.value) { other.value = TlsfAllocator::INVALID; }
+        GeometryHandle& operator=(GeometryHandle&& other) noexcept {
+            value = other.value;
+            other.value = TlsfAllocator::INVALID;
+            return *this;
+        }
+        GeometryHandle& operator=(uint32_t handle) {
+            value = handle;
+            return *this;
+        }
+        operator uint32_t() const { return value; }
+    };
+
+    // render data, ranges in the shared GeometryHeap buffers
+    GeometryHandle vertexAllocation;
+    GeometryHandle indexAllocation;
+    size_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    vector<const void*> rangeOffsets;   // scratch space for DrawRanges
+    vector<GLint> rangeBaseVertices;
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+
+    // binds the textures to their samplers and sets the per mesh uniforms, all locations come precompiled from the material
+    void bindMaterial(Shader& shader)
+    {
+        const MeshUniforms& uniforms = material.bind(shader);
+
+        // compact positions are stored in [0,1] across the bounding box, the vertex shader scales them back
+        if (format == VERTEX_FORMAT_COMPACT) {
+            glm::vec3 positionScale = boundsMax - boundsMin;
+            glUniform3fv(uniforms.positionOffset, 1, &boundsMin[0]);
+            glUniform3fv(uniforms.positionScale, 1, &positionScale[0]);
+        }
+    }
 
-        glBindVertexArray(0);
+    // calculates the bounding box from the vertex positions
+    void computeBounds()
+    {
+        computeBounds(vertices.data(), vertices.size(), boundsMin, boundsMax);
+    }
+
+    // copies the vertices and indices into the shared geometry heap
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
+    {
+        this->indexCount = indexCount;
+
+        GeometryHeap& heap = GeometryHeap::instance();
+        heap.registerFormat(VERTEX_FORMAT_FULL, sizeof(Vertex), &Mesh::setupAttributes);
+        heap.registerFormat(VERTEX_FORMAT_COMPACT, sizeof(CompactVertex), &Mesh::setupAttributes);
+
+        if (format == VERTEX_FORMAT_COMPACT) {
+            setupCompactBuffers(vertexData, vertexCount, indexData, indexCount);
+            return;
+        }
+
+        vertexBufferBytes = vertexCount * sizeof(Vertex);
+        indexBufferBytes = indexCount * sizeof(unsigned int);
+        indexType = GL_UNSIGNED_INT;
+
+        vertexAllocation = heap.allocateVertices(format, vertexData, (uint32_t)vertexCount);
+        indexAllocation = heap.allocateIndices(indexData, indexBufferBytes);
+    }
+
+    // packs the vertices into CompactVertex and the indices into 16 bit if they fit. The normalized attribute formats
+    // modelShadersCompact.vts expects are set up once for the whole format by setupAttributes.
+    void setupCompactBuffers(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
+    {
+        GeometryHeap& heap = GeometryHeap::instance();
+
+        vector<CompactVertex> compact;
+        compressVertices(vertexData, vertexCount, boundsMin, boundsMax, compact);
+
+        vertexBufferBytes = compact.size() * sizeof(CompactVertex);
+        vertexAllocation = heap.allocateVertices(format, compact.data(), (uint32_t)compact.size());
+
+        if (vertexCount < 65536) {
+            vector<uint16_t> shortIndices(indexData, indexData + indexCount);
+            indexType = GL_UNSIGNED_SHORT;
+            indexBufferBytes = indexCount * sizeof(uint16_t);
+            indexAllocation = heap.allocateIndices(shortIndices.data(), indexBufferBytes);
+        }
+        else {
+            indexType = GL_UNSIGNED_INT;
+            indexBufferBytes = indexCount * sizeof(unsigned int);
+            indexAllocation = heap.allocateIndices(indexData, indexBufferBytes);
+        }
     }
 };
 
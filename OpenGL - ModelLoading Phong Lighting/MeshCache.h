@@ -0,0 +1,452 @@
+#pragma once
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "TransformGraph.h"
+
+using namespace std;
+
+// binary cache of an imported model, written next to the source asset as "<asset>.meshcache".
+//
+// file layout (all offsets are in bytes from the start of the file):
+//   MeshCacheHeader
+//   MeshCacheEntry      [meshCount]
+//   MeshCacheTextureRef [textureCount]
+//   MeshCacheLod        [lodCount]
+//   Meshlet             [meshletCount]
+//   MeshCacheNode       [nodeCount]     (parent before child, as in TransformGraph)
+//   MeshCacheDependency [dependencyCount]
+//   string data         (texture types and paths, node names and dependency paths, not null terminated)
+//   vertex data         (Vertex [totalVertices], 16 byte aligned, exactly the layout Mesh::setupMesh uploads)
+//   index data          (unsigned int [totalIndices], 4 byte aligned, every level of detail of a mesh back to back)
+//
+// the file is memory mapped on load so the vertex and index ranges can be passed to glBufferData without any parsing.
+//
+// besides the source asset itself the cache depends on the files it pulls in (the .mtl libraries of an .obj, which
+// decide the texture references stored here). Their content hashes are recorded too, and open() rejects the cache as
+// soon as one of them changed or disappeared.
+
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 6;        // bump whenever the layout below or the Vertex/Meshlet structs change
+
+// bits for MeshCacheHeader::processingFlags
+const uint32_t MESH_PROCESS_OPTIMIZED = 1u << 0; // MeshOptimizer::optimize ran on every mesh
+const uint32_t MESH_PROCESS_LODS = 1u << 1;      // MeshSimplifier::generateLods ran on every mesh
+const uint32_t MESH_PROCESS_MESHLETS = 1u << 2;  // MeshletBuilder::build ran on the full detail level of every mesh
+const uint32_t MESH_PROCESS_LOD_LEVELS_SHIFT = 8; // the requested number of lod levels is stored from this bit up
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t importFlags;       // the aiPostProcessSteps the meshes were imported with
+    uint32_t processingFlags;   // our own import steps that ran on top of assimp (MESH_PROCESS_* bits)
+    uint32_t vertexStride;      // sizeof(Vertex) when the cache was written
+    uint32_t lodCount;
+    uint64_t sourceHash;        // content hash of the source asset
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint64_t meshTableOffset;
+    uint64_t textureTableOffset;
+    uint64_t lodTableOffset;
+    uint32_t meshletCount;
+    uint32_t nodeCount;
+    uint64_t meshletTableOffset;
+    uint64_t nodeTableOffset;
+    uint32_t dependencyCount;
+    uint32_t reserved;
+    uint64_t dependencyTableOffset;
+    uint64_t stringDataOffset;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    uint64_t fileSize;
+};
+
+struct MeshCacheEntry {
+    uint64_t firstVertex;       // index into the vertex data
+    uint64_t vertexCount;
+    uint64_t firstIndex;        // index into the index data
+    uint64_t indexCount;
+    uint32_t firstTexture;      // index into the texture table
+    uint32_t textureCount;
+    uint32_t firstLod;          // index into the lod table
+    uint32_t lodCount;
+    uint32_t firstMeshlet;      // index into the meshlet table
+    uint32_t meshletCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t node;              // index into the node table
+    uint32_t reserved;
+};
+
+struct MeshCacheLod {
+    uint32_t firstIndex;        // relative to the mesh's first index
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshCacheNode {
+    int32_t parent;             // TransformGraph::NO_PARENT for a root
+    uint32_t nameOffset;        // relative to the string data
+    uint32_t nameLength;
+    uint32_t reserved;
+    float transform[16];        // local matrix, column major like glm
+};
+
+struct MeshCacheDependency {
+    uint64_t contentHash;       // hashFileContents() of the file when the cache was written, 0 if it didn't exist
+    uint32_t pathOffset;        // relative to the string data, the path itself is relative to the cache's directory
+    uint32_t pathLength;
+};
+
+struct MeshCacheTextureRef {
+    uint32_t typeOffset;        // relative to the string data
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+class MeshCache {
+public:
+    static string cachePathFor(const string& sourcePath) {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache file and checks that it was built from the same source contents with the same import and processing flags,
+    // and that none of the files it depends on changed since. Returns false (and the caller should re-import) if the file
+    // is missing, stale or damaged.
+    bool open(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t processingFlags) {
+        if (!file.open(cachePath))
+            return false;
+
+        if (file.size() < sizeof(MeshCacheHeader))
+            return fail();
+
+        const MeshCacheHeader* h = header();
+        if (h->magic != MESH_CACHE_MAGIC || h->version != MESH_CACHE_VERSION || h->vertexStride != sizeof(Vertex))
+            return fail();
+        if (h->sourceHash != sourceHash || h->importFlags != importFlags || h->processingFlags != processingFlags)
+            return fail();
+        if (h->fileSize != file.size() || h->indexDataOffset > file.size() || h->vertexDataOffset > h->indexDataOffset)
+            return fail();
+        if (h->meshTableOffset + (uint64_t)h->meshCount * sizeof(MeshCacheEntry) > h->textureTableOffset)
+            return fail();
+        if (h->textureTableOffset + (uint64_t)h->textureCount * sizeof(MeshCacheTextureRef) > h->lodTableOffset)
+            return fail();
+        if (h->lodTableOffset + (uint64_t)h->lodCount * sizeof(MeshCacheLod) > h->meshletTableOffset)
+            return fail();
+        if (h->meshletTableOffset + (uint64_t)h->meshletCount * sizeof(Meshlet) > h->nodeTableOffset)
+            return fail();
+        if (h->nodeTableOffset + (uint64_t)h->nodeCount * sizeof(MeshCacheNode) > h->dependencyTableOffset)
+            return fail();
+        if (h->dependencyTableOffset + (uint64_t)h->dependencyCount * sizeof(MeshCacheDependency) > h->stringDataOffset)
+            return fail();
+
+        // make sure every range stays inside the file before anyone dereferences it
+        uint64_t totalVertices = (h->indexDataOffset - h->vertexDataOffset) / sizeof(Vertex);
+        uint64_t totalIndices = (h->fileSize - h->indexDataOffset) / sizeof(unsigned int);
+        for (uint32_t i = 0; i < h->meshCount; i++) {
+            const MeshCacheEntry& e = entry(i);
+            if (e.firstVertex + e.vertexCount > totalVertices || e.firstIndex + e.indexCount > totalIndices)
+                return fail();
+            if ((uint64_t)e.firstTexture + e.textureCount > h->textureCount)
+                return fail();
+            if (e.lodCount == 0 || (uint64_t)e.firstLod + e.lodCount > h->lodCount)
+                return fail();
+            for (uint32_t l = 0; l < e.lodCount; l++) {
+                const MeshCacheLod& lod = this->lod(e.firstLod + l);
+                if ((uint64_t)lod.firstIndex + lod.indexCount > e.indexCount)
+                    return fail();
+            }
+            if ((uint64_t)e.firstMeshlet + e.meshletCount > h->meshletCount)
+                return fail();
+            if (h->nodeCount > 0 && e.node >= h->nodeCount)
+                return fail();
+            for (uint32_t m = 0; m < e.meshletCount; m++) {
+                const Meshlet& meshlet = meshlets(e)[m];
+                if ((uint64_t)meshlet.firstIndex + (uint64_t)meshlet.triangleCount * 3 > e.indexCount)
+                    return fail();
+            }
+        }
+        for (uint32_t i = 0; i < h->textureCount; i++) {
+            const MeshCacheTextureRef& t = textureRef(i);
+            if (h->stringDataOffset + t.typeOffset + t.typeLength > h->vertexDataOffset ||
+                h->stringDataOffset + t.pathOffset + t.pathLength > h->vertexDataOffset)
+                return fail();
+        }
+        for (uint32_t i = 0; i < h->nodeCount; i++) {
+            const MeshCacheNode& n = node(i);
+            if (n.parent >= (int32_t)i || n.parent < TransformGraph::NO_PARENT)
+                return fail();
+            if (h->stringDataOffset + n.nameOffset + n.nameLength > h->vertexDataOffset)
+                return fail();
+        }
+
+        // last, it's the only check that reads other files
+        for (uint32_t i = 0; i < h->dependencyCount; i++) {
+            const MeshCacheDependency& d = ((const MeshCacheDependency*)(file.data() + h->dependencyTableOffset))[i];
+            if (h->stringDataOffset + d.pathOffset + d.pathLength > h->vertexDataOffset)
+                return fail();
+            string path((const char*)file.data() + h->stringDataOffset + d.pathOffset, d.pathLength);
+            if (hashFileContents(dependencyPath(cachePath, path)) != d.contentHash)
+                return fail();
+        }
+
+        return true;
+    }
+
+    unsigned int meshCount() const { return header()->meshCount; }
+
+    const MeshCacheEntry& entry(unsigned int i) const {
+        return ((const MeshCacheEntry*)(file.data() + header()->meshTableOffset))[i];
+    }
+
+    const Vertex* vertices(const MeshCacheEntry& e) const {
+        return (const Vertex*)(file.data() + header()->vertexDataOffset) + e.firstVertex;
+    }
+
+    const unsigned int* indices(const MeshCacheEntry& e) const {
+        return (const unsigned int*)(file.data() + header()->indexDataOffset) + e.firstIndex;
+    }
+
+    const MeshCacheTextureRef& textureRef(unsigned int i) const {
+        return ((const MeshCacheTextureRef*)(file.data() + header()->textureTableOffset))[i];
+    }
+
+    const MeshCacheLod& lod(unsigned int i) const {
+        return ((const MeshCacheLod*)(file.data() + header()->lodTableOffset))[i];
+    }
+
+    // the levels of detail of one mesh in the form Mesh::lods uses
+    vector<MeshLod> lods(const MeshCacheEntry& e) const {
+        vector<MeshLod> result(e.lodCount);
+        for (uint32_t l = 0; l < e.lodCount; l++) {
+            const MeshCacheLod& c = lod(e.firstLod + l);
+            result[l] = MeshLod{ c.firstIndex, c.indexCount, c.error };
+        }
+        return result;
+    }
+
+    const Meshlet* meshlets(const MeshCacheEntry& e) const {
+        return (const Meshlet*)(file.data() + header()->meshletTableOffset) + e.firstMeshlet;
+    }
+
+    const MeshCacheNode& node(unsigned int i) const {
+        return ((const MeshCacheNode*)(file.data() + header()->nodeTableOffset))[i];
+    }
+
+    // rebuilds the model's node hierarchy, a cache without one gives a single identity root
+    void nodes(TransformGraph& graph) const {
+        graph.clear();
+        graph.reserve(header()->nodeCount);
+        for (uint32_t i = 0; i < header()->nodeCount; i++) {
+            const MeshCacheNode& n = node(i);
+            glm::mat4 local;
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++)
+                    local[c][r] = n.transform[c * 4 + r];
+            }
+            graph.addNode(n.parent, local, string((const char*)file.data() + header()->stringDataOffset + n.nameOffset, n.nameLength));
+        }
+        if (graph.empty())
+            graph.addNode(TransformGraph::NO_PARENT, glm::mat4(1.0f));
+    }
+
+    string textureType(const MeshCacheTextureRef& t) const {
+        return string((const char*)file.data() + header()->stringDataOffset + t.typeOffset, t.typeLength);
+    }
+
+    string texturePath(const MeshCacheTextureRef& t) const {
+        return string((const char*)file.data() + header()->stringDataOffset + t.pathOffset, t.pathLength);
+    }
+
+    void close() { file.close(); }
+
+    // writes the meshes of a freshly imported model. The file is written under a temporary name first and renamed at the end
+    // so a crash half way through never leaves a truncated cache behind. MeshT is Mesh or anything with the same
+    // vertices/indices/textures/lods/boundsMin/boundsMax/node members (e.g. ImportedMesh, which has no GL objects yet).
+    // dependencies are the other files the import read, relative to the cache's directory (see ObjLoader::materialLibraries).
+    template <typename MeshT>
+    static bool write(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t processingFlags, const vector<MeshT>& meshes,
+                      const TransformGraph& graph, const vector<string>& dependencies = vector<string>()) {
+
+        vector<MeshCacheEntry> entries(meshes.size());
+        vector<MeshCacheTextureRef> textureRefs;
+        vector<MeshCacheLod> lodTable;
+        vector<Meshlet> meshletTable;
+        vector<MeshCacheNode> nodeTable(graph.size());
+        vector<MeshCacheDependency> dependencyTable(dependencies.size());
+        string strings;
+        uint64_t totalVertices = 0, totalIndices = 0;
+
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            const MeshT& mesh = meshes[i];
+            MeshCacheEntry& e = entries[i];
+
+            e.firstVertex = totalVertices;
+            e.vertexCount = mesh.vertices.size();
+            e.firstIndex = totalIndices;
+            e.indexCount = mesh.indices.size();
+            e.firstTexture = (uint32_t)textureRefs.size();
+            e.textureCount = (uint32_t)mesh.textures.size();
+            e.firstLod = (uint32_t)lodTable.size();
+            e.lodCount = mesh.lods.empty() ? 1 : (uint32_t)mesh.lods.size();
+            e.firstMeshlet = (uint32_t)meshletTable.size();
+            e.meshletCount = (uint32_t)mesh.meshlets.size();
+            meshletTable.insert(meshletTable.end(), mesh.meshlets.begin(), mesh.meshlets.end());
+            for (int k = 0; k < 3; k++) {
+                e.boundsMin[k] = mesh.boundsMin[k];
+                e.boundsMax[k] = mesh.boundsMax[k];
+            }
+            e.node = mesh.node;
+            e.reserved = 0;
+
+            for (unsigned int j = 0; j < mesh.textures.size(); j++) {
+                MeshCacheTextureRef t;
+                t.typeOffset = (uint32_t)strings.size();
+                t.typeLength = (uint32_t)mesh.textures[j].type.size();
+                strings += mesh.textures[j].type;
+                t.pathOffset = (uint32_t)strings.size();
+                t.pathLength = (uint32_t)mesh.textures[j].path.size();
+                strings += mesh.textures[j].path;
+                textureRefs.push_back(t);
+            }
+
+            // an ImportedMesh without generated levels of detail still gets level 0, the whole index list, like every Mesh
+            // has. open() rejects entries without any
+            for (unsigned int l = 0; l < e.lodCount; l++) {
+                MeshCacheLod lod;
+                lod.firstIndex = mesh.lods.empty() ? 0 : mesh.lods[l].firstIndex;
+                lod.indexCount = mesh.lods.empty() ? (uint32_t)mesh.indices.size() : mesh.lods[l].indexCount;
+                lod.error = mesh.lods.empty() ? 0.0f : mesh.lods[l].error;
+                lod.reserved = 0;
+                lodTable.push_back(lod);
+            }
+
+            totalVertices += e.vertexCount;
+            totalIndices += e.indexCount;
+        }
+
+        for (unsigned int i = 0; i < graph.size(); i++) {
+            MeshCacheNode& n = nodeTable[i];
+            n.parent = graph.parent(i);
+            n.nameOffset = (uint32_t)strings.size();
+            n.nameLength = (uint32_t)graph.name(i).size();
+            n.reserved = 0;
+            strings += graph.name(i);
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++)
+                    n.transform[c * 4 + r] = graph.local(i)[c][r];
+            }
+        }
+
+        for (unsigned int i = 0; i < dependencies.size(); i++) {
+            MeshCacheDependency& d = dependencyTable[i];
+            d.contentHash = hashFileContents(dependencyPath(cachePath, dependencies[i]));
+            d.pathOffset = (uint32_t)strings.size();
+            d.pathLength = (uint32_t)dependencies[i].size();
+            strings += dependencies[i];
+        }
+
+        MeshCacheHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = MESH_CACHE_MAGIC;
+        h.version = MESH_CACHE_VERSION;
+        h.importFlags = importFlags;
+        h.processingFlags = processingFlags;
+        h.vertexStride = sizeof(Vertex);
+        h.sourceHash = sourceHash;
+        h.meshCount = (uint32_t)entries.size();
+        h.textureCount = (uint32_t)textureRefs.size();
+        h.lodCount = (uint32_t)lodTable.size();
+        h.meshletCount = (uint32_t)meshletTable.size();
+        h.nodeCount = (uint32_t)nodeTable.size();
+        h.dependencyCount = (uint32_t)dependencyTable.size();
+        h.meshTableOffset = sizeof(MeshCacheHeader);
+        h.textureTableOffset = h.meshTableOffset + entries.size() * sizeof(MeshCacheEntry);
+        h.lodTableOffset = h.textureTableOffset + textureRefs.size() * sizeof(MeshCacheTextureRef);
+        h.meshletTableOffset = h.lodTableOffset + lodTable.size() * sizeof(MeshCacheLod);
+        h.nodeTableOffset = h.meshletTableOffset + meshletTable.size() * sizeof(Meshlet);
+        h.dependencyTableOffset = h.nodeTableOffset + nodeTable.size() * sizeof(MeshCacheNode);
+        h.stringDataOffset = h.dependencyTableOffset + dependencyTable.size() * sizeof(MeshCacheDependency);
+        h.vertexDataOffset = alignUp(h.stringDataOffset + strings.size(), 16);
+        h.indexDataOffset = alignUp(h.vertexDataOffset + totalVertices * sizeof(Vertex), 4);
+        h.fileSize = h.indexDataOffset + totalIndices * sizeof(unsigned int);
+
+        string tempPath = cachePath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+
+            out.write((const char*)&h, sizeof(h));
+            out.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+            out.write((const char*)textureRefs.data(), textureRefs.size() * sizeof(MeshCacheTextureRef));
+            out.write((const char*)lodTable.data(), lodTable.size() * sizeof(MeshCacheLod));
+            out.write((const char*)meshletTable.data(), meshletTable.size() * sizeof(Meshlet));
+            out.write((const char*)nodeTable.data(), nodeTable.size() * sizeof(MeshCacheNode));
+            out.write((const char*)dependencyTable.data(), dependencyTable.size() * sizeof(MeshCacheDependency));
+            out.write(strings.data(), strings.size());
+            writePadding(out, h.vertexDataOffset - (h.stringDataOffset + strings.size()));
+
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                out.write((const char*)meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+            writePadding(out, h.indexDataOffset - (h.vertexDataOffset + totalVertices * sizeof(Vertex)));
+
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                out.write((const char*)meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+
+            if (!out) {
+                out.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        std::remove(cachePath.c_str()); // rename doesn't overwrite on windows
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+
+    const MeshCacheHeader* header() const {
+        return (const MeshCacheHeader*)file.data();
+    }
+
+    bool fail() {
+        file.close();
+        return false;
+    }
+
+    // a dependency path is relative to the directory the cache (and its source) sits in
+    static string dependencyPath(const string& cachePath, const string& path) {
+        size_t slash = cachePath.find_last_of("/\\");
+        return slash == string::npos ? path : cachePath.substr(0, slash + 1) + path;
+    }
+
+    static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static void writePadding(ofstream& out, uint64_t count) {
+        static const char zeros[16] = {};
+        out.write(zeros, (std::streamsize)count);
+    }
+};
+
+#endif // !MESH_CACHE_H
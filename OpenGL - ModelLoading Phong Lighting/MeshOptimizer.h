@@ -0,0 +1,379 @@
+#pragma once
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "ImportArena.h"
+#include "Mesh.h"
+
+using namespace std;
+
+// before/after numbers for one mesh. ACMR = average cache miss ratio, i.e. vertex shader invocations per triangle with a
+// simulated FIFO post-transform cache. 3.0 is the worst case, ~0.5-0.7 is about as good as it gets for regular meshes.
+struct MeshOptimizationReport {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t triangles = 0;
+    size_t clusters = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+// import time optimization of indexed triangle lists. optimize() runs all the steps in order:
+//   1. vertex welding          - merge vertices whose position, normal and uv are bit-identical
+//   2. vertex cache reordering - Tipsify (Sander, Nehab & Barczak 2007) to maximize post-transform cache hits
+//   3. overdraw ordering       - sort the Tipsify clusters so outward facing ones are drawn first, if that doesn't cost
+//                                more than `overdrawThreshold` times the ACMR of step 2
+//   4. vertex fetch reordering - renumber the vertices in the order the index buffer first uses them
+// all functions are pure CPU code and safe to run on worker threads.
+class MeshOptimizer {
+public:
+    static const unsigned int CACHE_SIZE = 16;
+
+    // scratch memory comes from `scratch` if given (see ImportArena), otherwise from an arena of its own. Either way the
+    // only heap allocations are the arena's blocks: vertices and indices are rewritten in place.
+    static MeshOptimizationReport optimize(vector<Vertex>& vertices, vector<unsigned int>& indices, float overdrawThreshold = 1.05f,
+                                           ImportArena* scratch = NULL) {
+        ImportArena local;
+        ImportArena& arena = scratch ? *scratch : local;
+
+        MeshOptimizationReport report;
+        report.verticesBefore = vertices.size();
+        report.triangles = indices.size() / 3;
+        report.acmrBefore = computeACMR(indices.data(), indices.size(), vertices.size(), CACHE_SIZE, arena);
+
+        // the passes below only understand triangle lists
+        if (indices.size() % 3 != 0 || indices.empty()) {
+            report.verticesAfter = vertices.size();
+            report.acmrAfter = report.acmrBefore;
+            return report;
+        }
+
+        weldVertices(vertices, indices, &arena);
+
+        ArenaVector<unsigned int> clusters{ ArenaAllocator<unsigned int>(arena) };
+        optimizeVertexCache(indices.data(), indices.size(), vertices.size(), &clusters, CACHE_SIZE, arena);
+        optimizeOverdraw(indices, vertices, clusters.data(), clusters.size(), overdrawThreshold, arena);
+        report.clusters = clusters.size();
+
+        optimizeVertexFetch(vertices, indices, &arena);
+
+        report.verticesAfter = vertices.size();
+        report.acmrAfter = computeACMR(indices.data(), indices.size(), vertices.size(), CACHE_SIZE, arena);
+        return report;
+    }
+
+    // simulates a FIFO cache of the given size and returns cache misses per triangle
+    static float computeACMR(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE) {
+        ImportArena arena(vertexCount * sizeof(size_t) + 64);
+        return computeACMR(indices.data(), indices.size(), vertexCount, cacheSize, arena);
+    }
+
+    static float computeACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize, ImportArena& arena) {
+        if (indexCount < 3)
+            return 0.0f;
+
+        // a vertex is in the cache if it was inserted less than cacheSize insertions ago
+        size_t* insertedAt = arenaArray<size_t>(arena, vertexCount, 0);
+        size_t insertions = 0;
+        size_t misses = 0;
+
+        for (size_t i = 0; i < indexCount; i++) {
+            unsigned int v = indices[i];
+            if (insertedAt[v] == 0 || insertions - (insertedAt[v] - 1) >= cacheSize) {
+                misses++;
+                insertedAt[v] = ++insertions;
+            }
+        }
+
+        return (float)misses / (float)(indexCount / 3);
+    }
+
+    // merges bit-identical vertices and rewrites the indices to match. The unique vertices are compacted to the front of
+    // the array in order of first appearance, through an open addressing table of vertex numbers.
+    static void weldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices, ImportArena* scratch = NULL) {
+        ImportArena local;
+        ImportArena& arena = scratch ? *scratch : local;
+
+        size_t capacity = 16;
+        while (capacity < vertices.size() * 2)
+            capacity *= 2;
+        const unsigned int empty = 0xFFFFFFFFu;
+        unsigned int* table = arenaArray<unsigned int>(arena, capacity, empty);
+        unsigned int* remap = arena.allocate<unsigned int>(vertices.size());
+
+        VertexHash hash;
+        VertexEqual equal;
+        unsigned int welded = 0;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            size_t slot = hash(vertices[i]) & (capacity - 1);
+            while (table[slot] != empty && !equal(vertices[table[slot]], vertices[i]))
+                slot = (slot + 1) & (capacity - 1);
+
+            if (table[slot] == empty) {
+                // welded <= i, so this never overwrites a vertex that hasn't been looked at yet
+                vertices[welded] = vertices[i];
+                table[slot] = welded++;
+            }
+            remap[i] = table[slot];
+        }
+
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+
+        vertices.resize(welded);
+    }
+
+    // Tipsify. Walks the mesh fanning around one vertex at a time and picks the next fanning vertex among the ones that are
+    // still in the cache. `clusters` (optional) receives the first triangle of every run that had to start from a vertex
+    // outside the cache; those are the points where reordering whole runs costs (almost) nothing in cache efficiency.
+    static void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE) {
+        ImportArena arena;
+        optimizeVertexCache(indices.data(), indices.size(), vertexCount, NULL, cacheSize, arena);
+    }
+
+    static void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount, ArenaVector<unsigned int>* clusters,
+                                    unsigned int cacheSize, ImportArena& arena) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        // vertex -> triangles adjacency in compressed row form
+        unsigned int* liveTriangles = arenaArray<unsigned int>(arena, vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++)
+            liveTriangles[indices[i]]++;
+
+        unsigned int* adjacencyOffset = arena.allocate<unsigned int>(vertexCount + 1);
+        unsigned int maxValence = 0;
+        adjacencyOffset[0] = 0;
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+            maxValence = std::max(maxValence, liveTriangles[v]);
+        }
+
+        unsigned int* adjacency = arena.allocate<unsigned int>(indexCount);
+        unsigned int* fill = arena.allocate<unsigned int>(vertexCount);
+        memcpy(fill, adjacencyOffset, vertexCount * sizeof(unsigned int));
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+        // every triangle pushes its 3 corners onto the dead end stack once, one fan adds at most 3 * valence candidates
+        unsigned int* cacheTime = arenaArray<unsigned int>(arena, vertexCount, 0);
+        char* emitted = arenaArray<char>(arena, triangleCount, 0);
+        unsigned int* deadEnd = arena.allocate<unsigned int>(indexCount);
+        unsigned int* candidates = arena.allocate<unsigned int>((size_t)maxValence * 3);
+        unsigned int* output = arena.allocate<unsigned int>(indexCount);
+        size_t deadEndSize = 0, outputSize = 0;
+
+        unsigned int timestamp = cacheSize + 1;
+        size_t cursor = 0;
+        long long fanning = 0;
+        bool newCluster = true;
+
+        while (fanning >= 0) {
+            size_t candidateCount = 0;
+            unsigned int f = (unsigned int)fanning;
+
+            for (unsigned int a = adjacencyOffset[f]; a < adjacencyOffset[f + 1]; a++) {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+
+                if (newCluster && clusters) {
+                    clusters->push_back((unsigned int)(outputSize / 3));
+                    newCluster = false;
+                }
+
+                for (int k = 0; k < 3; k++) {
+                    unsigned int v = indices[t * 3 + k];
+                    output[outputSize++] = v;
+                    deadEnd[deadEndSize++] = v;
+                    candidates[candidateCount++] = v;
+                    liveTriangles[v]--;
+                    if (timestamp - cacheTime[v] > cacheSize)
+                        cacheTime[v] = timestamp++;
+                }
+                emitted[t] = 1;
+            }
+
+            // next fanning vertex: the candidate that will still be in the cache after its remaining triangles are emitted,
+            // preferring the oldest one
+            long long best = -1;
+            int bestPriority = -1;
+            for (size_t c = 0; c < candidateCount; c++) {
+                unsigned int v = candidates[c];
+                if (liveTriangles[v] == 0)
+                    continue;
+
+                int priority = 0;
+                if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = (int)(timestamp - cacheTime[v]);
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+
+            if (best < 0) {
+                best = skipDeadEnd(liveTriangles, vertexCount, deadEnd, deadEndSize, cursor);
+                newCluster = true;
+            }
+
+            fanning = best;
+        }
+
+        memcpy(indices, output, indexCount * sizeof(unsigned int));
+    }
+
+    // reorders the clusters found by optimizeVertexCache so the ones facing away from the mesh center come first, which
+    // lets the depth test reject more of the inner/back geometry. Falls back to the input order if that would push the
+    // ACMR above threshold * the current ACMR.
+    static void optimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, const unsigned int* clusters, size_t clusterCount,
+                                 float threshold, ImportArena& arena) {
+        size_t triangleCount = indices.size() / 3;
+        if (clusterCount < 2 || triangleCount == 0)
+            return;
+
+        // area weighted centroid of the whole mesh
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            float area;
+            glm::vec3 normal;
+            glm::vec3 center = triangleInfo(indices, vertices, t, area, normal);
+            meshCenter += center * area;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+
+        struct ClusterSort {
+            unsigned int first, last; // triangle range [first, last)
+            float key;
+        };
+        ClusterSort* sorted = arena.allocate<ClusterSort>(clusterCount);
+
+        for (size_t c = 0; c < clusterCount; c++) {
+            ClusterSort& cs = sorted[c];
+            cs.first = clusters[c];
+            cs.last = c + 1 < clusterCount ? clusters[c + 1] : (unsigned int)triangleCount;
+
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (unsigned int t = cs.first; t < cs.last; t++) {
+                float a;
+                glm::vec3 n;
+                glm::vec3 centroid = triangleInfo(indices, vertices, t, a, n);
+                center += centroid * a;
+                normal += n * a;
+                area += a;
+            }
+            if (area > 0.0f)
+                center /= area;
+            float normalLength = glm::length(normal);
+            if (normalLength > 0.0f)
+                normal /= normalLength;
+
+            cs.key = glm::dot(center - meshCenter, normal);
+        }
+
+        // ties keep the input order, same result as a stable sort without its temporary buffer
+        std::sort(sorted, sorted + clusterCount, [](const ClusterSort& a, const ClusterSort& b) {
+            return a.key > b.key || (a.key == b.key && a.first < b.first);
+        });
+
+        unsigned int* reordered = arena.allocate<unsigned int>(indices.size());
+        size_t n = 0;
+        for (size_t c = 0; c < clusterCount; c++) {
+            for (unsigned int i = sorted[c].first * 3; i < sorted[c].last * 3; i++)
+                reordered[n++] = indices[i];
+        }
+
+        float before = computeACMR(indices.data(), indices.size(), vertices.size(), CACHE_SIZE, arena);
+        float after = computeACMR(reordered, indices.size(), vertices.size(), CACHE_SIZE, arena);
+        if (after <= before * threshold)
+            memcpy(indices.data(), reordered, indices.size() * sizeof(unsigned int));
+    }
+
+    // renumbers the vertices in order of first use so the vertex fetch walks the buffer front to back. Unused vertices are
+    // dropped.
+    static void optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices, ImportArena* scratch = NULL) {
+        ImportArena local;
+        ImportArena& arena = scratch ? *scratch : local;
+
+        const unsigned int unused = 0xFFFFFFFFu;
+        unsigned int* remap = arenaArray<unsigned int>(arena, vertices.size(), unused);
+        Vertex* reordered = arena.allocate<Vertex>(vertices.size());
+        unsigned int count = 0;
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            unsigned int& r = remap[indices[i]];
+            if (r == unused) {
+                r = count;
+                reordered[count++] = vertices[indices[i]];
+            }
+            indices[i] = r;
+        }
+
+        memcpy(vertices.data(), reordered, count * sizeof(Vertex));
+        vertices.resize(count);
+    }
+
+private:
+    struct VertexHash {
+        size_t operator()(const Vertex& v) const {
+            // FNV-1a over the raw bytes, Vertex is tightly packed floats
+            const unsigned char* bytes = (const unsigned char*)&v;
+            size_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+
+    struct VertexEqual {
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    static long long skipDeadEnd(const unsigned int* liveTriangles, size_t vertexCount, const unsigned int* deadEnd, size_t& deadEndSize, size_t& cursor) {
+        // recently used vertices first, they might still be in the cache
+        while (deadEndSize > 0) {
+            unsigned int v = deadEnd[--deadEndSize];
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+
+        // otherwise the next vertex in input order that still has triangles left
+        while (cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0)
+                return (long long)cursor;
+            cursor++;
+        }
+
+        return -1;
+    }
+
+    static glm::vec3 triangleInfo(const vector<unsigned int>& indices, const vector<Vertex>& vertices, size_t t, float& area, glm::vec3& normal) {
+        const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+        const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        area = length * 0.5f;
+        normal = length > 0.0f ? n / length : glm::vec3(0.0f);
+        return (p0 + p1 + p2) / 3.0f;
+    }
+};
+
+#endif // !MESH_OPTIMIZER_H
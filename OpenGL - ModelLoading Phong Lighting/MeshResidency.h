@@ -0,0 +1,147 @@
+#pragma once
+#ifndef MESH_RESIDENCY_H
+#define MESH_RESIDENCY_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "VertexCompression.h"
+
+using namespace std;
+
+// what happens to the CPU side copy of a model's geometry once it's on the GPU. Drawing only needs the GPU buffers plus
+// the bounds, levels of detail and meshlets, which every policy keeps.
+enum MeshResidency {
+    MESH_RESIDENCY_KEEP,        // every Mesh keeps its full vertices/indices vectors and texture records
+    MESH_RESIDENCY_DISCARD,     // the vectors are freed, nothing is left to query on the CPU
+    MESH_RESIDENCY_SPILL        // the vectors are freed after copying positions and indices into a MeshDataArena
+};
+
+inline const char* meshResidencyName(MeshResidency residency) {
+    switch (residency) {
+    case MESH_RESIDENCY_DISCARD: return "discard";
+    case MESH_RESIDENCY_SPILL: return "spill";
+    default: return "keep";
+    }
+}
+
+// heap memory held by a string, 0 while it fits the small string buffer inside the object
+inline size_t stringHeapBytes(const string& s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+// where the memory of a model goes, in bytes
+struct ModelMemoryReport {
+    size_t cpuVertexBytes = 0;      // Mesh::vertices of every mesh
+    size_t cpuIndexBytes = 0;       // Mesh::indices of every mesh
+    size_t textureRecordBytes = 0;  // Texture structs and their strings, per mesh and in the model's texture list
+    size_t arenaBytes = 0;          // the MeshDataArena of a spilled model
+    size_t gpuGeometryBytes = 0;    // the model's ranges of the shared geometry heap
+    size_t releasedBytes = 0;       // CPU memory the residency policy gave back after the upload
+
+    size_t cpuBytes() const {
+        return cpuVertexBytes + cpuIndexBytes + textureRecordBytes + arenaBytes;
+    }
+};
+
+// compact, read only CPU copy of the geometry of a model's meshes, for picking, collision and the like once the Mesh
+// vectors are gone. Everything lives in one allocation, sized exactly by reserve() before the meshes are added:
+//   positions - 3 x 16 bit per vertex, quantized across the mesh's bounding box (the same quantization the compact GPU
+//               vertex format uses, so the error is at most 1/131070 of the box per axis)
+//   indices   - 16 bit if the mesh has less than 65536 vertices, 32 bit otherwise
+// 6 bytes per vertex instead of the 32 of a Vertex; normals and texture coordinates aren't kept.
+class MeshDataArena {
+public:
+    // bytes one mesh takes up in the arena
+    static size_t bytesFor(size_t vertexCount, size_t indexCount) {
+        return align(vertexCount * POSITION_BYTES) + align(indexCount * (vertexCount < 65536 ? sizeof(uint16_t) : sizeof(uint32_t)));
+    }
+
+    void reserve(size_t bytes, size_t meshCount) {
+        data.reserve(bytes);
+        entries.reserve(meshCount);
+    }
+
+    // appends a mesh, returns its slot
+    unsigned int add(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+                     const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        Entry e;
+        e.vertexCount = (uint32_t)vertexCount;
+        e.indexCount = (uint32_t)indexCount;
+        e.shortIndices = vertexCount < 65536;
+        e.boundsMin = boundsMin;
+        e.boundsMax = boundsMax;
+
+        e.positionOffset = data.size();
+        data.resize(data.size() + align(vertexCount * POSITION_BYTES));
+        uint16_t* positions = (uint16_t*)(data.data() + e.positionOffset);
+        for (size_t i = 0; i < vertexCount; i++)
+            quantizePosition(vertices[i].Position, boundsMin, boundsMax, positions + i * 3);
+
+        e.indexOffset = data.size();
+        data.resize(data.size() + align(indexCount * (e.shortIndices ? sizeof(uint16_t) : sizeof(uint32_t))));
+        if (e.shortIndices) {
+            uint16_t* out = (uint16_t*)(data.data() + e.indexOffset);
+            for (size_t i = 0; i < indexCount; i++)
+                out[i] = (uint16_t)indices[i];
+        }
+        else {
+            memcpy(data.data() + e.indexOffset, indices, indexCount * sizeof(uint32_t));
+        }
+
+        entries.push_back(e);
+        return (unsigned int)entries.size() - 1;
+    }
+
+    unsigned int meshCount() const { return (unsigned int)entries.size(); }
+    unsigned int vertexCount(unsigned int slot) const { return entries[slot].vertexCount; }
+    unsigned int indexCount(unsigned int slot) const { return entries[slot].indexCount; }
+
+    glm::vec3 position(unsigned int slot, unsigned int vertex) const {
+        const Entry& e = entries[slot];
+        const uint16_t* p = (const uint16_t*)(data.data() + e.positionOffset) + vertex * 3;
+        return e.boundsMin + glm::vec3(p[0], p[1], p[2]) * ((e.boundsMax - e.boundsMin) / 65535.0f);
+    }
+
+    unsigned int index(unsigned int slot, unsigned int i) const {
+        const Entry& e = entries[slot];
+        if (e.shortIndices)
+            return ((const uint16_t*)(data.data() + e.indexOffset))[i];
+        return ((const uint32_t*)(data.data() + e.indexOffset))[i];
+    }
+
+    // memory held by the arena, including the per mesh table
+    size_t bytes() const {
+        return data.capacity() + entries.capacity() * sizeof(Entry);
+    }
+
+    void clear() {
+        vector<uint8_t>().swap(data);
+        vector<Entry>().swap(entries);
+    }
+
+private:
+    static const size_t POSITION_BYTES = 3 * sizeof(uint16_t);
+
+    struct Entry {
+        size_t positionOffset, indexOffset;
+        uint32_t vertexCount, indexCount;
+        bool shortIndices;
+        glm::vec3 boundsMin, boundsMax;
+    };
+
+    vector<uint8_t> data;
+    vector<Entry> entries;
+
+    // keeps every array 4 byte aligned so the 32 bit indices can be read in place
+    static size_t align(size_t bytes) {
+        return (bytes + 3) & ~(size_t)3;
+    }
+};
+
+#endif // !MESH_RESIDENCY_H
@@ -0,0 +1,350 @@
+#pragma once
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ImportArena.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+using namespace std;
+
+// quadric error metric edge collapse simplification (Garland & Heckbert 1997).
+//
+// only the index buffer is rewritten: every collapse moves a vertex onto one of its neighbours (a half edge collapse),
+// so all levels of detail keep sharing the original vertex buffer and every surviving vertex keeps its exact normal and
+// uv. Vertices on uv/normal seams (several vertices at one position) and on open borders are never moved, which keeps
+// the texture layout and the silhouette of open meshes intact.
+class MeshSimplifier {
+public:
+    // simplifies the triangle list towards targetIndexCount indices. `error` receives the largest geometric error
+    // introduced, as a distance in model units (the area weighted RMS distance of a collapsed vertex to the planes of
+    // the triangles it stood for). The result may have more indices than requested if the mesh runs out of
+    // vertices that can be collapsed safely.
+    static vector<unsigned int> simplify(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount,
+                                         float& error) {
+        ImportArena arena;
+        unsigned int* result = arena.allocate<unsigned int>(indices.size());
+        size_t count = simplify(vertices, indices.data(), indices.size(), targetIndexCount, error, result, arena);
+        return vector<unsigned int>(result, result + count);
+    }
+
+    // same, writing into `result` (room for indexCount indices) and taking every scratch array from the arena. Returns
+    // the number of indices written.
+    static size_t simplify(const vector<Vertex>& vertices, const unsigned int* indices, size_t indexCount, size_t targetIndexCount,
+                           float& error, unsigned int* result, ImportArena& arena) {
+        error = 0.0f;
+        memcpy(result, indices, indexCount * sizeof(unsigned int));
+        size_t resultCount = indexCount;
+        size_t vertexCount = vertices.size();
+        if (resultCount <= targetIndexCount || resultCount % 3 != 0)
+            return resultCount;
+
+        char* locked = arenaArray<char>(arena, vertexCount, 0);
+        findLockedVertices(vertices, result, resultCount, locked, arena);
+
+        // one area weighted plane quadric per triangle, summed at its corners
+        Quadric* quadrics = arenaArray<Quadric>(arena, vertexCount, Quadric());
+        for (size_t t = 0; t < resultCount / 3; t++) {
+            Quadric q = Quadric::fromTriangle(vertices[result[t * 3 + 0]].Position, vertices[result[t * 3 + 1]].Position,
+                                              vertices[result[t * 3 + 2]].Position);
+            for (int k = 0; k < 3; k++)
+                quadrics[result[t * 3 + k]].add(q);
+        }
+
+        // the index list only ever shrinks, so everything sized for the first pass fits every later one
+        double maxCost = 0.0;
+        unsigned int* adjacencyOffset = arena.allocate<unsigned int>(vertexCount + 1);
+        unsigned int* adjacency = arena.allocate<unsigned int>(indexCount);
+        unsigned int* fill = arena.allocate<unsigned int>(vertexCount);
+        Collapse* candidates = arena.allocate<Collapse>(indexCount * 2);
+        unsigned int* remap = arena.allocate<unsigned int>(vertexCount);
+        char* touched = arena.allocate<char>(vertexCount);
+
+        // each pass collapses a set of independent edges, cheapest first, then compacts the index list
+        while (resultCount > targetIndexCount) {
+            size_t triangleCount = resultCount / 3;
+            buildAdjacency(result, resultCount, vertexCount, adjacencyOffset, adjacency, fill);
+
+            size_t candidateCount = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    unsigned int a = result[t * 3 + k];
+                    unsigned int b = result[t * 3 + (k + 1) % 3];
+                    if (!locked[a])
+                        candidates[candidateCount++] = Collapse{ a, b, quadrics[a].error(vertices[b].Position) };
+                    if (!locked[b])
+                        candidates[candidateCount++] = Collapse{ b, a, quadrics[b].error(vertices[a].Position) };
+                }
+            }
+            if (candidateCount == 0)
+                break;
+
+            std::sort(candidates, candidates + candidateCount, [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+            for (size_t v = 0; v < vertexCount; v++)
+                remap[v] = (unsigned int)v;
+            memset(touched, 0, vertexCount);
+
+            size_t remainingTriangles = triangleCount;
+            size_t collapses = 0;
+
+            for (size_t c = 0; c < candidateCount && remainingTriangles * 3 > targetIndexCount; c++) {
+                const Collapse& col = candidates[c];
+                if (touched[col.from] || touched[col.to])
+                    continue;
+                if (flipsTriangle(vertices, result, adjacencyOffset, adjacency, col.from, col.to))
+                    continue;
+
+                remap[col.from] = col.to;
+                quadrics[col.to].add(quadrics[col.from]);
+                maxCost = std::max(maxCost, col.cost);
+                collapses++;
+
+                // lock everything around the collapse for the rest of this pass so the flip checks stay valid
+                for (unsigned int a = adjacencyOffset[col.from]; a < adjacencyOffset[col.from + 1]; a++) {
+                    unsigned int t = adjacency[a];
+                    bool degenerate = false;
+                    for (int k = 0; k < 3; k++) {
+                        touched[result[t * 3 + k]] = 1;
+                        if (result[t * 3 + k] == col.to)
+                            degenerate = true;
+                    }
+                    if (degenerate)
+                        remainingTriangles--;
+                }
+            }
+
+            if (collapses == 0)
+                break;
+
+            // apply the collapses and drop the triangles that lost an edge
+            size_t write = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                unsigned int i0 = remap[result[t * 3 + 0]];
+                unsigned int i1 = remap[result[t * 3 + 1]];
+                unsigned int i2 = remap[result[t * 3 + 2]];
+                if (i0 == i1 || i1 == i2 || i0 == i2)
+                    continue;
+                result[write++] = i0;
+                result[write++] = i1;
+                result[write++] = i2;
+            }
+            resultCount = write;
+        }
+
+        error = (float)std::sqrt(maxCost);
+        return resultCount;
+    }
+
+    // appends up to maxLevels - 1 simplified versions of the mesh to `indices`, each aiming for half the triangles of the
+    // one before, and fills `lods` with the index range and error of every level (level 0 = the input). Every level is
+    // simplified from the full mesh so its error is measured against the original surface. Stops early once a level
+    // can't get meaningfully smaller. The levels are built in the arena (a local one if none is given) and appended with
+    // a single resize of `indices`.
+    static void generateLods(const vector<Vertex>& vertices, vector<unsigned int>& indices, vector<MeshLod>& lods, unsigned int maxLevels = 5,
+                             size_t minIndexCount = 96, ImportArena* scratch = NULL) {
+        ImportArena local;
+        ImportArena& arena = scratch ? *scratch : local;
+
+        lods.clear();
+        lods.reserve(maxLevels);
+        lods.push_back(MeshLod{ 0, (unsigned int)indices.size(), 0.0f });
+        if (indices.size() % 3 != 0)
+            return;
+
+        size_t baseCount = indices.size();
+        size_t previousCount = baseCount;
+        size_t totalCount = baseCount;
+        unsigned int** levels = arena.allocate<unsigned int*>(maxLevels);
+
+        for (unsigned int level = 1; level < maxLevels; level++) {
+            size_t target = (previousCount / 2) / 3 * 3;
+            if (target < minIndexCount)
+                break;
+
+            // only the level itself outlives this iteration, the scratch arrays are reused by the next one
+            float error = 0.0f;
+            unsigned int* simplified = arena.allocate<unsigned int>(baseCount);
+            ImportArena::Mark scratchStart = arena.mark();
+            size_t simplifiedCount = simplify(vertices, indices.data(), baseCount, target, error, simplified, arena);
+            if (simplifiedCount == 0 || simplifiedCount > previousCount * 85 / 100)
+                break;
+
+            MeshOptimizer::optimizeVertexCache(simplified, simplifiedCount, vertices.size(), NULL, MeshOptimizer::CACHE_SIZE, arena);
+            arena.rewind(scratchStart);
+
+            // a coarser level never claims to be more accurate than a finer one
+            error = std::max(error, lods.back().error);
+
+            levels[lods.size()] = simplified;
+            lods.push_back(MeshLod{ (unsigned int)totalCount, (unsigned int)simplifiedCount, error });
+            totalCount += simplifiedCount;
+            previousCount = simplifiedCount;
+        }
+
+        indices.resize(totalCount);
+        for (size_t l = 1; l < lods.size(); l++)
+            memcpy(indices.data() + lods[l].firstIndex, levels[l], lods[l].indexCount * sizeof(unsigned int));
+    }
+
+private:
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+    };
+
+    // symmetric 4x4 matrix stored as its upper triangle: a2 ab ac ad b2 bc bd c2 cd d2, plus the total weight (area)
+    // of the planes summed into it
+    struct Quadric {
+        double m[10] = {};
+        double weight = 0.0;
+
+        static Quadric fromTriangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+            Quadric q;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                return q;
+            n /= length;
+
+            double w = length * 0.5; // triangle area
+            double a = n.x, b = n.y, c = n.z, d = -glm::dot(n, p0);
+            q.m[0] = w * a * a; q.m[1] = w * a * b; q.m[2] = w * a * c; q.m[3] = w * a * d;
+            q.m[4] = w * b * b; q.m[5] = w * b * c; q.m[6] = w * b * d;
+            q.m[7] = w * c * c; q.m[8] = w * c * d;
+            q.m[9] = w * d * d;
+            q.weight = w;
+            return q;
+        }
+
+        void add(const Quadric& o) {
+            for (int i = 0; i < 10; i++)
+                m[i] += o.m[i];
+            weight += o.weight;
+        }
+
+        // mean squared distance from p to the planes in the quadric
+        double error(const glm::vec3& p) const {
+            return weight > 0.0 ? evaluate(p) / weight : 0.0;
+        }
+
+        // area weighted sum of squared distances from p to the planes in the quadric
+        double evaluate(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double r = m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x
+                     + m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y
+                     + m[7] * z * z + 2.0 * m[8] * z
+                     + m[9];
+            return r > 0.0 ? r : 0.0;
+        }
+    };
+
+    static size_t hashPosition(const glm::vec3& p) {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+    }
+
+    static size_t hashEdge(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDull;
+        key ^= key >> 33;
+        return (size_t)key;
+    }
+
+    // seam vertices (another vertex shares the position) and vertices on open or non-manifold edges stay put. Both
+    // lookups are open addressing tables in the arena.
+    static void findLockedVertices(const vector<Vertex>& vertices, const unsigned int* indices, size_t indexCount, char* locked, ImportArena& arena) {
+        const unsigned int empty = 0xFFFFFFFFu;
+        size_t capacity = 16;
+        while (capacity < vertices.size() * 2)
+            capacity *= 2;
+        unsigned int* firstAtPosition = arenaArray<unsigned int>(arena, capacity, empty);
+        for (size_t v = 0; v < vertices.size(); v++) {
+            const glm::vec3& p = vertices[v].Position;
+            size_t slot = hashPosition(p) & (capacity - 1);
+            while (firstAtPosition[slot] != empty && vertices[firstAtPosition[slot]].Position != p)
+                slot = (slot + 1) & (capacity - 1);
+
+            if (firstAtPosition[slot] == empty) {
+                firstAtPosition[slot] = (unsigned int)v;
+            }
+            else {
+                locked[v] = 1;
+                locked[firstAtPosition[slot]] = 1;
+            }
+        }
+
+        // an interior edge is used exactly twice, once in each direction. A mesh has at most indexCount distinct edges.
+        const uint64_t noEdge = ~0ull;
+        size_t edgeCapacity = 16;
+        while (edgeCapacity < indexCount * 2)
+            edgeCapacity *= 2;
+        uint64_t* edges = arenaArray<uint64_t>(arena, edgeCapacity, noEdge);
+        int* edgeUse = arenaArray<int>(arena, edgeCapacity, 0);
+        for (size_t t = 0; t < indexCount / 3; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = indices[t * 3 + k];
+                unsigned int b = indices[t * 3 + (k + 1) % 3];
+                uint64_t key = a < b ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+                size_t slot = hashEdge(key) & (edgeCapacity - 1);
+                while (edges[slot] != noEdge && edges[slot] != key)
+                    slot = (slot + 1) & (edgeCapacity - 1);
+                edges[slot] = key;
+                edgeUse[slot]++;
+            }
+        }
+        for (size_t slot = 0; slot < edgeCapacity; slot++) {
+            if (edges[slot] != noEdge && edgeUse[slot] != 2) {
+                locked[(unsigned int)(edges[slot] >> 32)] = 1;
+                locked[(unsigned int)(edges[slot] & 0xFFFFFFFFu)] = 1;
+            }
+        }
+    }
+
+    static void buildAdjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int* offset, unsigned int* adjacency,
+                               unsigned int* fill) {
+        memset(offset, 0, (vertexCount + 1) * sizeof(unsigned int));
+        for (size_t i = 0; i < indexCount; i++)
+            offset[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offset[v + 1] += offset[v];
+
+        memcpy(fill, offset, vertexCount * sizeof(unsigned int));
+        for (size_t i = 0; i < indexCount; i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    // true if moving `from` onto `to` would turn any of the surviving triangles around `from` upside down
+    static bool flipsTriangle(const vector<Vertex>& vertices, const unsigned int* indices, const unsigned int* offset,
+                              const unsigned int* adjacency, unsigned int from, unsigned int to) {
+        for (unsigned int a = offset[from]; a < offset[from + 1]; a++) {
+            unsigned int t = adjacency[a];
+            unsigned int i0 = indices[t * 3 + 0], i1 = indices[t * 3 + 1], i2 = indices[t * 3 + 2];
+            if (i0 == to || i1 == to || i2 == to)
+                continue; // this one collapses away
+
+            glm::vec3 p0 = vertices[i0].Position, p1 = vertices[i1].Position, p2 = vertices[i2].Position;
+            glm::vec3 before = glm::cross(p1 - p0, p2 - p0);
+
+            if (i0 == from) p0 = vertices[to].Position;
+            if (i1 == from) p1 = vertices[to].Position;
+            if (i2 == from) p2 = vertices[to].Position;
+            glm::vec3 after = glm::cross(p1 - p0, p2 - p0);
+
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif // !MESH_SIMPLIFIER_H
@@ -0,0 +1,215 @@
+#pragma once
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ImportArena.h"
+
+using namespace std;
+
+// limits of a single meshlet, the usual sizes for mesh shading hardware
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// a small cluster of triangles that can be culled on its own. The triangles are a contiguous run of the mesh's index
+// buffer, so a meshlet can be drawn straight from the existing EBO. All bounds are in model space.
+struct Meshlet {
+    unsigned int firstIndex;
+    unsigned int triangleCount;
+    unsigned int vertexCount;   // unique vertices referenced, at most MESHLET_MAX_VERTICES
+    float radius;               // bounding sphere
+    glm::vec3 center;
+    float coneCutoff;           // sine of the normal cone half angle, 1 means the cone is too wide to ever cull
+    glm::vec3 coneAxis;
+    float padding;
+};
+
+// the six planes of a view frustum (left, right, bottom, top, near, far), normals pointing inwards
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // extracts the planes from a projection * view (* model) matrix (Gribb & Hartmann). With the model matrix included the
+    // planes are in model space.
+    static Frustum fromMatrix(const glm::mat4& m) {
+        Frustum f;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        f.planes[0] = row3 + row0;
+        f.planes[1] = row3 - row0;
+        f.planes[2] = row3 + row1;
+        f.planes[3] = row3 - row1;
+        f.planes[4] = row3 + row2;
+        f.planes[5] = row3 - row2;
+
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(glm::vec3(f.planes[i]));
+            if (length > 0.0f)
+                f.planes[i] /= length;
+        }
+        return f;
+    }
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for (int i = 0; i < 6; i++) {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// how many meshlets the last culling pass looked at and why the rejected ones were dropped
+struct ClusterCullStats {
+    unsigned int total = 0;
+    unsigned int frustumCulled = 0;
+    unsigned int backfaceCulled = 0;
+
+    void add(const ClusterCullStats& o) {
+        total += o.total;
+        frustumCulled += o.frustumCulled;
+        backfaceCulled += o.backfaceCulled;
+    }
+
+    float culledRatio() const {
+        return total > 0 ? (float)(frustumCulled + backfaceCulled) / (float)total : 0.0f;
+    }
+};
+
+class MeshletBuilder {
+public:
+    // splits the triangles in indices[firstIndex, firstIndex + indexCount) into meshlets, in order. T is anything with
+    // Position/Normal members, i.e. Vertex. Run it on a vertex cache optimized index buffer: consecutive triangles then
+    // share most of their vertices, so filling meshlets greedily front to back already gives compact clusters. The
+    // meshlets are collected in the arena (a local one if none is given) and copied into `out` with one allocation.
+    template <typename T>
+    static void build(const T* vertices, size_t vertexCount, const unsigned int* indices, size_t firstIndex, size_t indexCount,
+                      vector<Meshlet>& out, ImportArena* scratch = NULL) {
+        ImportArena local;
+        ImportArena& arena = scratch ? *scratch : local;
+        ArenaVector<Meshlet> meshlets{ ArenaAllocator<Meshlet>(arena) };
+        meshlets.reserve(indexCount / 3 / MESHLET_MAX_TRIANGLES + 1);
+
+        // which vertices the current meshlet already uses, stamped with the meshlet number so it never needs clearing
+        unsigned int* usedBy = arenaArray<unsigned int>(arena, vertexCount, ~0u);
+
+        Meshlet current = Meshlet();
+        current.firstIndex = (unsigned int)firstIndex;
+        size_t triangleCount = indexCount / 3;
+
+        for (size_t t = 0; t < triangleCount; t++) {
+            const unsigned int* tri = indices + firstIndex + t * 3;
+            unsigned int stamp = (unsigned int)meshlets.size();
+
+            unsigned int newVertices = 0;
+            for (int k = 0; k < 3; k++) {
+                if (usedBy[tri[k]] != stamp && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]))
+                    newVertices++;
+            }
+
+            if (current.vertexCount + newVertices > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES) {
+                finish(vertices, indices, current);
+                meshlets.push_back(current);
+                stamp = (unsigned int)meshlets.size();
+
+                current = Meshlet();
+                current.firstIndex = (unsigned int)(firstIndex + t * 3);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                if (usedBy[tri[k]] != stamp) {
+                    usedBy[tri[k]] = stamp;
+                    current.vertexCount++;
+                }
+            }
+            current.triangleCount++;
+        }
+
+        if (current.triangleCount > 0) {
+            finish(vertices, indices, current);
+            meshlets.push_back(current);
+        }
+
+        out.assign(meshlets.begin(), meshlets.end());
+    }
+
+    // true if the meshlet can be skipped: it's completely outside the frustum or every triangle in it faces away from the
+    // camera. frustum and cameraPosition have to be in the same (model) space as the meshlet bounds.
+    static bool isCulled(const Meshlet& m, const Frustum& frustum, const glm::vec3& cameraPosition, ClusterCullStats& stats) {
+        if (!frustum.intersectsSphere(m.center, m.radius)) {
+            stats.frustumCulled++;
+            return true;
+        }
+
+        // the whole normal cone points away from every point of the bounding sphere
+        glm::vec3 toCenter = m.center - cameraPosition;
+        if (glm::dot(toCenter, m.coneAxis) >= m.coneCutoff * glm::length(toCenter) + m.radius) {
+            stats.backfaceCulled++;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    // bounding sphere around the box of the meshlet's vertices, normal cone around the average triangle normal
+    template <typename T>
+    static void finish(const T* vertices, const unsigned int* indices, Meshlet& m) {
+        const unsigned int* tri = indices + m.firstIndex;
+
+        glm::vec3 boxMin = vertices[tri[0]].Position, boxMax = boxMin;
+        for (unsigned int i = 1; i < m.triangleCount * 3; i++) {
+            boxMin = glm::min(boxMin, vertices[tri[i]].Position);
+            boxMax = glm::max(boxMax, vertices[tri[i]].Position);
+        }
+        m.center = (boxMin + boxMax) * 0.5f;
+        m.radius = 0.0f;
+        for (unsigned int i = 0; i < m.triangleCount * 3; i++)
+            m.radius = std::max(m.radius, glm::length(vertices[tri[i]].Position - m.center));
+
+        // face normals, degenerate triangles don't get a say
+        glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+        unsigned int normalCount = 0;
+        glm::vec3 axis(0.0f);
+        for (unsigned int t = 0; t < m.triangleCount; t++) {
+            glm::vec3 p0 = vertices[tri[t * 3 + 0]].Position;
+            glm::vec3 p1 = vertices[tri[t * 3 + 1]].Position;
+            glm::vec3 p2 = vertices[tri[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                continue;
+            n /= length;
+            normals[normalCount++] = n;
+            axis += n;
+        }
+
+        m.coneAxis = glm::vec3(0.0f);
+        m.coneCutoff = 1.0f;
+        m.padding = 0.0f;
+
+        float axisLength = glm::length(axis);
+        if (normalCount == 0 || axisLength <= 0.0f)
+            return;
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (unsigned int i = 0; i < normalCount; i++)
+            minDot = std::min(minDot, glm::dot(axis, normals[i]));
+
+        // a cone wider than ~85 degrees half angle always has some triangle facing the camera, keep it unculled
+        if (minDot <= 0.1f)
+            return;
+
+        m.coneAxis = axis;
+        m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+};
+
+#endif // !MESHLETS_H
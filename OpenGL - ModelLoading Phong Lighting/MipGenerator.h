@@ -0,0 +1,417 @@
+#pragma once
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// SSE2 is part of every x86-64 target, AVX2 only when the compiler was told to use it (-mavx2 -mfma, /arch:AVX2)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_GENERATOR_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2 1
+#endif
+
+#include "GLStateCache.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+enum MipFilter {
+    MIP_FILTER_BOX,     // average of the source pixels a mip pixel covers (2x2, up to 3x3 for odd sizes)
+    MIP_FILTER_KAISER   // Kaiser windowed sinc over 3 mip pixels: sharper than the box and without its aliasing
+};
+
+enum TextureColorSpace {
+    TEXTURE_COLOR_SPACE_SRGB,   // colour images: the colour channels are filtered in linear light, alpha as stored
+    TEXTURE_COLOR_SPACE_LINEAR  // normal maps, height maps, masks: every channel is filtered as stored
+};
+
+struct MipLevel {
+    int width, height;
+    size_t offset;  // into MipChain::data
+    size_t size;
+};
+
+// an 8 bit image and all of its mip levels down to 1x1, largest first, tightly packed one after the other
+struct MipChain {
+    int width = 0, height = 0, channels = 0;
+    vector<MipLevel> levels;
+    vector<uint8_t> data;
+};
+
+// builds mip chains on the CPU instead of leaving it to glGenerateMipmap, so the work can happen on worker threads (or
+// once, offline, see TextureCooker) and the result doesn't depend on whatever filter the driver picks.
+//
+// every level is filtered from the one above it. The filter is separable: a band of source rows is converted to linear
+// float RGBA (sRGB decoded through a table), filtered vertically and then horizontally with SSE2/AVX2, and encoded back
+// to 8 bits. Textures in this project use GL_REPEAT, so the filter wraps around the edges as well.
+class MipGenerator {
+public:
+    static const char* simdName() {
+#if defined(MIP_GENERATOR_AVX2)
+        return "avx2";
+#elif defined(MIP_GENERATOR_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    static int levelCount(int width, int height) {
+        int count = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            count++;
+        }
+        return count;
+    }
+
+    // copies the image (1 to 4 channels) into level 0 and filters every level below it. The rows of each level are spread
+    // over the pool if one is given.
+    static void generate(const uint8_t* pixels, int width, int height, int channels, MipChain& out,
+                         TextureColorSpace colorSpace = TEXTURE_COLOR_SPACE_SRGB, MipFilter filter = MIP_FILTER_KAISER, ThreadPool* pool = NULL) {
+        out.width = width;
+        out.height = height;
+        out.channels = channels;
+        out.levels.clear();
+
+        // every level is laid out up front, the data never moves while the levels are filtered into it
+        size_t total = 0;
+        int w = width, h = height;
+        while (true) {
+            MipLevel level;
+            level.width = w;
+            level.height = h;
+            level.offset = total;
+            level.size = (size_t)w * h * channels;
+            out.levels.push_back(level);
+            total += level.size;
+            if (w == 1 && h == 1)
+                break;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        out.data.resize(total);
+        memcpy(out.data.data(), pixels, out.levels[0].size);
+
+        for (unsigned int l = 1; l < out.levels.size(); l++) {
+            const MipLevel& src = out.levels[l - 1];
+            const MipLevel& dst = out.levels[l];
+            downsample(out.data.data() + src.offset, src.width, src.height, out.data.data() + dst.offset, dst.width, dst.height,
+                       channels, colorSpace, filter, pool);
+        }
+    }
+
+    // uploads every level into textureID and leaves it bound. pixels is chain.data.data(), or NULL when the chain has been
+    // copied to offset 0 of the bound GL_PIXEL_UNPACK_BUFFER. GL thread only.
+    static void upload(const MipChain& chain, unsigned int textureID, const uint8_t* pixels) {
+        GLenum format = GL_RGB;
+        if (chain.channels == 1)
+            format = GL_RED;
+        else if (chain.channels == 2)
+            format = GL_RG;
+        else if (chain.channels == 4)
+            format = GL_RGBA;
+
+        // rows of 1, 2 and 3 channel levels aren't 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GLStateCache::instance().bindTexture(GL_TEXTURE_2D, textureID);
+        for (unsigned int l = 0; l < chain.levels.size(); l++) {
+            const MipLevel& level = chain.levels[l];
+            const void* data = (const void*)((uintptr_t)pixels + level.offset);
+            glTexImage2D(GL_TEXTURE_2D, (GLint)l, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, data);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)chain.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // filters one level into the next (dstWidth x dstHeight, normally half the size)
+    static void downsample(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int dstHeight, int channels,
+                           TextureColorSpace colorSpace, MipFilter filter, ThreadPool* pool = NULL) {
+        FilterTaps horizontal, vertical;
+        buildTaps(srcWidth, dstWidth, filter, horizontal);
+        buildTaps(srcHeight, dstHeight, filter, vertical);
+
+        // how many channels go through the sRGB curve: colour, never alpha
+        int colorChannels = 0;
+        if (colorSpace == TEXTURE_COLOR_SPACE_SRGB)
+            colorChannels = channels >= 3 ? 3 : (channels == 2 ? 1 : channels);
+
+        size_t bandCount = ((size_t)dstHeight + BAND_ROWS - 1) / BAND_ROWS;
+        auto filterBand = [&](size_t band) {
+            int y0 = (int)band * BAND_ROWS, y1 = std::min(dstHeight, y0 + BAND_ROWS);
+
+            // the source rows this band reads, converted once. first is increasing, so they are one contiguous range.
+            int lo = vertical.first[y0], hi = vertical.first[y1 - 1] + vertical.taps;
+            size_t rowFloats = (size_t)srcWidth * 4;
+            vector<float> rows((size_t)(hi - lo) * rowFloats), column(rowFloats), filtered((size_t)dstWidth * 4);
+            for (int r = lo; r < hi; r++)
+                toLinear(src + (size_t)wrap(r, srcHeight) * srcWidth * channels, srcWidth, channels, colorChannels, &rows[(size_t)(r - lo) * rowFloats]);
+
+            for (int y = y0; y < y1; y++) {
+                filterRows(&rows[(size_t)(vertical.first[y] - lo) * rowFloats], rowFloats, &vertical.weights[(size_t)y * vertical.taps],
+                           vertical.taps, column.data());
+                filterRow(column.data(), srcWidth, horizontal, filtered.data());
+                fromLinear(filtered.data(), dstWidth, channels, colorChannels, dst + (size_t)y * dstWidth * channels);
+            }
+        };
+
+        if (pool && bandCount > 1)
+            pool->parallelFor(bandCount, filterBand);
+        else {
+            for (size_t band = 0; band < bandCount; band++)
+                filterBand(band);
+        }
+    }
+
+private:
+    static const int BAND_ROWS = 16;            // destination rows per task
+    static constexpr double KAISER_RADIUS = 3.0;    // in destination pixels
+    static constexpr double KAISER_ALPHA = 4.0;
+    static constexpr double PI = 3.14159265358979323846;
+
+    // the weights of a separable filter, one set of taps per destination pixel along one axis. The taps of pixel x read
+    // the source pixels first[x] .. first[x] + taps - 1 (before wrapping), unused taps have a weight of 0.
+    struct FilterTaps {
+        int taps = 0;
+        vector<int> first;
+        vector<float> weights;      // taps per destination pixel
+        vector<float> weights4;     // the same, every weight repeated 4 times to multiply whole RGBA pixels
+    };
+
+    struct Tables {
+        float srgbToLinear[256];
+        float unormToFloat[256];
+        uint8_t linearToSrgb[65536];    // indexed by the linear value * 65535, fine enough to round exactly near black
+
+        Tables() {
+            for (int i = 0; i < 256; i++) {
+                double c = i / 255.0;
+                srgbToLinear[i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+                unormToFloat[i] = (float)c;
+            }
+            for (int i = 0; i < 65536; i++) {
+                double l = i / 65535.0;
+                double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+                linearToSrgb[i] = (uint8_t)std::min(255.0, std::floor(c * 255.0 + 0.5));
+            }
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables t; // built once, thread safe
+        return t;
+    }
+
+#if defined(MIP_GENERATOR_AVX2)
+    // a * b + c, fused when the compiler was allowed to use FMA
+    static __m256 multiplyAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+#endif
+
+    static int wrap(int i, int size) {
+        i %= size;
+        return i < 0 ? i + size : i;
+    }
+
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (x * 0.5 / k) * (x * 0.5 / k);
+            sum += term;
+            if (term < sum * 1e-12)
+                break;
+        }
+        return sum;
+    }
+
+    static double kaiser(double t) {
+        if (std::fabs(t) >= KAISER_RADIUS)
+            return 0.0;
+        double sinc = t == 0.0 ? 1.0 : std::sin(PI * t) / (PI * t);
+        double r = t / KAISER_RADIUS;
+        return sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+    }
+
+    static void buildTaps(int srcSize, int dstSize, MipFilter filter, FilterTaps& out) {
+        double scale = (double)srcSize / dstSize;
+        double support = filter == MIP_FILTER_BOX ? scale * 0.5 : KAISER_RADIUS * scale; // half width in source pixels
+
+        out.first.resize(dstSize);
+        int taps = 1;
+        for (int x = 0; x < dstSize; x++) {
+            double center = (x + 0.5) * scale;
+            int first = (int)std::floor(center - support);
+            int last = (int)std::ceil(center + support) - 1;
+            out.first[x] = first;
+            taps = std::max(taps, last - first + 1);
+        }
+        taps += taps & 1; // the AVX2 path reads two pixels at a time
+
+        out.taps = taps;
+        out.weights.assign((size_t)dstSize * taps, 0.0f);
+        out.weights4.resize(out.weights.size() * 4);
+        for (int x = 0; x < dstSize; x++) {
+            double center = (x + 0.5) * scale;
+            double w[64] = {};
+            double sum = 0.0;
+            for (int k = 0; k < taps && k < 64; k++) {
+                int i = out.first[x] + k;
+                if (filter == MIP_FILTER_BOX) {
+                    // how much of source pixel [i, i + 1) lies inside the destination pixel
+                    w[k] = std::max(0.0, std::min(i + 1.0, center + support) - std::max((double)i, center - support));
+                }
+                else {
+                    w[k] = kaiser((i + 0.5 - center) / scale);
+                }
+                sum += w[k];
+            }
+            for (int k = 0; k < taps; k++) {
+                float weight = (float)(sum != 0.0 ? w[k] / sum : 0.0);
+                out.weights[(size_t)x * taps + k] = weight;
+                for (int c = 0; c < 4; c++)
+                    out.weights4[((size_t)x * taps + k) * 4 + c] = weight;
+            }
+        }
+    }
+
+    // 8 bit pixels -> linear float RGBA, missing channels are 0
+    static void toLinear(const uint8_t* src, int width, int channels, int colorChannels, float* dst) {
+        const Tables& t = tables();
+        const float* lut[4];
+        for (int c = 0; c < 4; c++)
+            lut[c] = c < colorChannels ? t.srgbToLinear : t.unormToFloat;
+
+        if (channels == 3) {
+            for (int x = 0; x < width; x++, src += 3, dst += 4) {
+                dst[0] = lut[0][src[0]];
+                dst[1] = lut[1][src[1]];
+                dst[2] = lut[2][src[2]];
+                dst[3] = 0.0f;
+            }
+        }
+        else if (channels == 4) {
+            for (int x = 0; x < width; x++, src += 4, dst += 4) {
+                dst[0] = lut[0][src[0]];
+                dst[1] = lut[1][src[1]];
+                dst[2] = lut[2][src[2]];
+                dst[3] = lut[3][src[3]];
+            }
+        }
+        else {
+            for (int x = 0; x < width; x++, src += channels, dst += 4) {
+                for (int c = 0; c < 4; c++)
+                    dst[c] = c < channels ? lut[c][src[c]] : 0.0f;
+            }
+        }
+    }
+
+    // linear float RGBA -> 8 bit pixels, clamped since the sinc lobes overshoot at hard edges
+    static void fromLinear(const float* src, int width, int channels, int colorChannels, uint8_t* dst) {
+        const Tables& t = tables();
+        float scale[4];
+        for (int c = 0; c < 4; c++)
+            scale[c] = c < colorChannels ? 65535.0f : 255.0f;
+
+        for (int x = 0; x < width; x++) {
+            int index[4];
+#if defined(MIP_GENERATOR_SSE2)
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + x * 4), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            _mm_storeu_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(v, _mm_loadu_ps(scale))));
+#else
+            for (int c = 0; c < 4; c++)
+                index[c] = (int)(std::min(std::max(src[x * 4 + c], 0.0f), 1.0f) * scale[c] + 0.5f);
+#endif
+            for (int c = 0; c < channels; c++)
+                dst[x * channels + c] = c < colorChannels ? t.linearToSrgb[index[c]] : (uint8_t)index[c];
+        }
+    }
+
+    // dst[i] = sum over k of weights[k] * rows[k * count + i], the vertical pass over whole rows of floats
+    static void filterRows(const float* rows, size_t count, const float* weights, int taps, float* dst) {
+        size_t i = 0;
+#if defined(MIP_GENERATOR_AVX2)
+        for (; i + 8 <= count; i += 8) {
+            __m256 sum = _mm256_setzero_ps();
+            for (int k = 0; k < taps; k++)
+                sum = multiplyAdd(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows + k * count + i), sum);
+            _mm256_storeu_ps(dst + i, sum);
+        }
+#endif
+#if defined(MIP_GENERATOR_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < taps; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows + k * count + i)));
+            _mm_storeu_ps(dst + i, sum);
+        }
+#endif
+        for (; i < count; i++) {
+            float sum = 0.0f;
+            for (int k = 0; k < taps; k++)
+                sum += weights[k] * rows[k * count + i];
+            dst[i] = sum;
+        }
+    }
+
+    // the horizontal pass: one RGBA pixel per SSE register, two neighbouring taps per AVX2 register
+    static void filterRow(const float* src, int srcWidth, const FilterTaps& f, float* dst) {
+        int taps = f.taps;
+        for (int x = 0; x < (int)f.first.size(); x++) {
+            const float* w4 = &f.weights4[(size_t)x * taps * 4];
+            int first = f.first[x];
+            bool inside = first >= 0 && first + taps <= srcWidth;
+
+#if defined(MIP_GENERATOR_SSE2)
+            __m128 sum = _mm_setzero_ps();
+            if (inside) {
+                const float* p = src + (size_t)first * 4;
+#if defined(MIP_GENERATOR_AVX2)
+                __m256 sum8 = _mm256_setzero_ps();
+                for (int k = 0; k < taps; k += 2)
+                    sum8 = multiplyAdd(_mm256_loadu_ps(w4 + k * 4), _mm256_loadu_ps(p + k * 4), sum8);
+                sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+#else
+                for (int k = 0; k < taps; k++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w4 + k * 4), _mm_loadu_ps(p + k * 4)));
+#endif
+            }
+            else {
+                for (int k = 0; k < taps; k++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w4 + k * 4), _mm_loadu_ps(src + (size_t)wrap(first + k, srcWidth) * 4)));
+            }
+            _mm_storeu_ps(dst + (size_t)x * 4, sum);
+#else
+            float sum[4] = {};
+            for (int k = 0; k < taps; k++) {
+                const float* p = src + (size_t)(inside ? first + k : wrap(first + k, srcWidth)) * 4;
+                for (int c = 0; c < 4; c++)
+                    sum[c] += w4[k * 4 + c] * p[c];
+            }
+            memcpy(dst + (size_t)x * 4, sum, sizeof(sum));
+#endif
+        }
+    }
+};
+
+#endif // !MIP_GENERATOR_H
@@ -2,7 +2,10 @@
 #ifndef MODEL_H  
 #define MODEL_H 
 
+#include <chrono>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "src/stb_image.h" 
@@ -11,82 +14,732 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "AsyncTextureLoader.h"
+#include "Camera.h"
+#include "ImportArena.h"
+#include "IndirectRenderer.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshResidency.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "ObjLoader.h"
 #include "Shaders.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+#include "TransformGraph.h"
 
 using namespace std;
 
+// post processing steps every model is imported with. Part of the mesh cache key, so changing them invalidates old caches.
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+// settings for how a model gets imported
+struct ModelLoadOptions {
+    bool parallelImport = false;    // convert the aiMesh vertex/index arrays on a thread pool instead of one by one
+    unsigned int numThreads = 0;    // worker count for the parallel import, 0 means one per hardware core
+    bool useMeshCache = true;       // load from / write to "<path>.meshcache" so warm starts skip assimp entirely
+    AsyncTextureLoader* textureLoader = NULL; // if set, textures are decoded in the background and show a placeholder until uploaded
+    bool optimizeMeshes = true;     // weld vertices and reorder triangles/vertices for the post-transform cache (see MeshOptimizer)
+    VertexFormat vertexFormat = VERTEX_FORMAT_FULL; // GPU vertex layout, VERTEX_FORMAT_COMPACT needs modelShadersCompact.vts
+    bool generateLods = true;       // build a chain of simplified index buffers per mesh (see MeshSimplifier)
+    unsigned int lodLevels = 4;     // levels including the full mesh, a mesh gets fewer if it can't be simplified that far
+    bool buildMeshlets = true;      // split the full detail level into small clusters that can be culled on their own
+    TextureCompressionMode textureCompression = TEXTURE_COMPRESSION_OFF; // cook textures into BCn with mips on first load
+    MipFilter mipFilter = MIP_FILTER_KAISER;    // how the CPU built mip chains are filtered, colour maps in linear light
+    bool fastObjLoader = true;      // read .obj/.mtl files with ObjLoader instead of assimp, assimp is still the fallback
+    MeshResidency residency = MESH_RESIDENCY_KEEP;  // what happens to the CPU copy of the geometry once it's uploaded
+};
+
+// wall time of every step of a model load, in milliseconds. Steps that didn't run (parsing on a mesh cache hit, texture
+// decoding when the registry already had the file or an AsyncTextureLoader does it) stay at 0.
+struct ModelLoadTimings {
+    double parseMs = 0.0;           // assimp ReadFile, ObjLoader's parse, or reading the mesh cache
+    double convertMs = 0.0;         // aiMesh -> Vertex/index arrays (convertMeshGeometry), ObjLoader's merge
+    double processMs = 0.0;         // optimizer, level of detail chain and meshlets
+    double textureDecodeMs = 0.0;   // stbi_load + mip chain, or reading/cooking the compressed texture
+    double textureUploadMs = 0.0;   // glTexImage2D / glCompressedTexImage2D per level
+    double geometryUploadMs = 0.0;  // copying the vertices and indices into the geometry heap
+    double totalMs = 0.0;           // the whole load, including whatever isn't listed above
+    bool fromCache = false;
+};
+
+// CPU side result of importing one mesh, everything that can be done without the GL context. ModelLoader builds these on
+// a worker thread and turns them into Meshes on the GL thread.
+struct ImportedMesh {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<MeshLod> lods;           // empty if no levels of detail were generated
+    vector<Meshlet> meshlets;
+    vector<Texture> textures;       // type and path only, the ids are filled in once the textures get loaded
+    glm::vec3 boundsMin, boundsMax;
+    unsigned int node = 0;          // index into the TransformGraph the import filled in
+};
+
 class Model
 {
+    friend class ModelLoader;
+
 public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
 
     // constructor, expects a filepath to a 3D model.
-    Model(string path){
+    Model(string path, ModelLoadOptions options = ModelLoadOptions()) : options(options) {
+        auto start = std::chrono::steady_clock::now();
         loadModel(path);
+        timings.totalMs = millisecondsSince(start);
         std::cout << "MODEL CONSTRUCTOR CALLED SUCCESS" << std::endl;
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader) {
+    // gives the model's texture references back to the registry, textures no other model uses get deleted. The meshes
+    // hand their geometry heap ranges back themselves.
+    ~Model() {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureRegistry::instance().release(textures_loaded[i].id);
+    }
+
+    // a copy would release the same texture references and geometry ranges twice, moving leaves the source empty
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&& other) = default;
+
+    // size of all vertex and index buffers of the model on the GPU
+    size_t gpuGeometryBytes() const {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertexBufferBytes + meshes[i].indexBufferBytes;
+        return bytes;
+    }
+
+    // false while a ModelLoader is still importing or uploading the model, drawing it does nothing until then
+    bool isReady() const {
+        return ready;
+    }
+
+    // draws the model, and thus all its meshes. If any node of the model has a transform of its own, the "model" and
+    // "normalMatrix" uniforms are set per mesh for modelMatrix times the node's world matrix, which is what view is needed
+    // for. Otherwise the uniforms are left as the caller set them.
+    void Draw(Shader& shader, const glm::mat4& view, const glm::mat4& modelMatrix) {
+        drawnTriangles = 0;
+        if (!ready)
+            return;
+        updateTransforms();
+        const MeshUniforms& uniforms = MeshUniforms::of(shader.ID);
         for (unsigned int i = 0; i < meshes.size(); i++) {
+            if (nodeTransforms)
+                setMeshMatrix(uniforms, view, meshMatrix(meshes[i], modelMatrix));
             meshes[i].Draw(shader);
+            drawnTriangles += meshes[i].triangleCount();
             //std::cout << "MESH " << i << " Drawn" << std::endl;
         }
     }
 
+    // draws every mesh at the coarsest level of detail whose error, projected onto the screen, stays below maxPixelError.
+    // modelMatrix has to be the same one the shader uses, viewportHeight is in pixels.
+    void Draw(Shader& shader, const Camera& camera, const glm::mat4& modelMatrix, float viewportHeight, float maxPixelError = 1.0f) {
+        drawnTriangles = 0;
+        if (!ready)
+            return;
+        updateTransforms();
+        glm::mat4 view = nodeTransforms ? glm::lookAt(camera.Position, camera.Position + camera.Front, camera.Up) : glm::mat4(1.0f);
+        const MeshUniforms& uniforms = MeshUniforms::of(shader.ID);
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            glm::mat4 matrix = meshMatrix(meshes[i], modelMatrix);
+            if (nodeTransforms)
+                setMeshMatrix(uniforms, view, matrix);
+            unsigned int lod = selectLod(meshes[i], camera, matrix, viewportHeight, maxPixelError);
+            meshes[i].Draw(shader, lod);
+            drawnTriangles += meshes[i].triangleCount(lod);
+        }
+    }
+
+    // same as above, and meshes drawn at full detail are culled per meshlet as well: clusters outside the view frustum or
+    // facing away from the camera are skipped, the rest go out in one glMultiDrawElements per mesh. projection and view
+    // have to be the matrices the shader uses.
+    void Draw(Shader& shader, const Camera& camera, const glm::mat4& projection, const glm::mat4& view, const glm::mat4& modelMatrix,
+              float viewportHeight, float maxPixelError = 1.0f) {
+        drawnTriangles = 0;
+        cullStats = ClusterCullStats();
+        if (!ready)
+            return;
+
+        updateTransforms();
+
+        // cull in model space, so the meshlet bounds can be used as they are. Meshes on their own node have their own model
+        // space, the frustum and camera position get redone for each of them.
+        Frustum frustum = Frustum::fromMatrix(projection * view * modelMatrix);
+        glm::vec3 cameraPosition = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(camera.Position, 1.0f));
+        const MeshUniforms& uniforms = MeshUniforms::of(shader.ID);
+
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            Mesh& mesh = meshes[i];
+            glm::mat4 matrix = meshMatrix(mesh, modelMatrix);
+            if (nodeTransforms) {
+                setMeshMatrix(uniforms, view, matrix);
+                frustum = Frustum::fromMatrix(projection * view * matrix);
+                cameraPosition = glm::vec3(glm::inverse(matrix) * glm::vec4(camera.Position, 1.0f));
+            }
+
+            unsigned int lod = selectLod(mesh, camera, matrix, viewportHeight, maxPixelError);
+            if (lod != 0 || mesh.meshlets.empty()) {
+                mesh.Draw(shader, lod);
+                drawnTriangles += mesh.triangleCount(lod);
+                continue;
+            }
+
+            // compact the surviving meshlets into a draw list, neighbours in the index buffer become one range
+            drawCounts.clear();
+            drawFirstIndices.clear();
+            for (unsigned int m = 0; m < mesh.meshlets.size(); m++) {
+                const Meshlet& meshlet = mesh.meshlets[m];
+                cullStats.total++;
+                if (MeshletBuilder::isCulled(meshlet, frustum, cameraPosition, cullStats))
+                    continue;
+
+                if (!drawCounts.empty() && drawFirstIndices.back() + (unsigned int)drawCounts.back() == meshlet.firstIndex)
+                    drawCounts.back() += (GLsizei)(meshlet.triangleCount * 3);
+                else {
+                    drawFirstIndices.push_back(meshlet.firstIndex);
+                    drawCounts.push_back((GLsizei)(meshlet.triangleCount * 3));
+                }
+                drawnTriangles += meshlet.triangleCount;
+            }
+
+            mesh.DrawRanges(shader, drawCounts, drawFirstIndices);
+        }
+    }
+
+    // draws the meshes inside the view frustum with glMultiDrawElementsIndirect, one call per material instead of one per
+    // mesh (see IndirectRenderer). indirectShader is the indirect variant of shader (modelShadersIndirect.vts), both read
+    // the camera from the Camera uniform block (see CameraUniforms). Without GL 4.3 and GL_ARB_shader_draw_parameters this
+    // is Draw(shader, view, modelMatrix) and the "model" / "normalMatrix" uniforms have to be set like for that one.
+    void DrawIndirect(Shader& indirectShader, Shader& shader, const glm::mat4& projection, const glm::mat4& view, const glm::mat4& modelMatrix) {
+        if (!IndirectRenderer::supported()) {
+            Draw(shader, view, modelMatrix);
+            return;
+        }
+
+        drawnTriangles = 0;
+        if (!ready)
+            return;
+        updateTransforms();
+
+        IndirectRenderer& renderer = IndirectRenderer::instance();
+        renderer.clear();
+        Frustum frustum = Frustum::fromMatrix(projection * view * modelMatrix);
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            Mesh& mesh = meshes[i];
+            glm::mat4 matrix = meshMatrix(mesh, modelMatrix);
+            if (nodeTransforms)
+                frustum = Frustum::fromMatrix(projection * view * matrix);
+
+            // bounding sphere of the mesh against the frustum in its model space
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            if (!frustum.intersectsSphere(center, glm::length(mesh.boundsMax - center)))
+                continue;
+
+            renderer.add(mesh, matrix, view);
+            drawnTriangles += mesh.triangleCount();
+        }
+        renderer.submit(indirectShader);
+    }
+
+    // meshlets looked at and rejected by the last culled Draw call
+    const ClusterCullStats& lastCullStats() const {
+        return cullStats;
+    }
+
+    // triangles submitted by the last Draw call
+    unsigned int lastDrawTriangles() const {
+        return drawnTriangles;
+    }
+
+    // where the load spent its time. For models from a ModelLoader it's filled in once the model is ready.
+    const ModelLoadTimings& loadTimings() const {
+        return timings;
+    }
+
+    unsigned int meshCount() const {
+        return (unsigned int)meshes.size();
+    }
+
+    const Mesh& mesh(unsigned int index) const {
+        return meshes[index];
+    }
+
+    // triangles of the model at full detail
+    unsigned int fullDetailTriangles() const {
+        unsigned int triangles = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            triangles += meshes[i].triangleCount();
+        return triangles;
+    }
+
+    // the model's node hierarchy. Change a node with nodes().setLocal(), the world matrices follow on the next Draw.
+    TransformGraph& nodes() {
+        return transformGraph;
+    }
+
+    const TransformGraph& nodes() const {
+        return transformGraph;
+    }
+
+    // the spilled geometry of a model loaded with MESH_RESIDENCY_SPILL (slot i is mesh i), empty otherwise
+    const MeshDataArena& cpuGeometry() const {
+        return cpuArena;
+    }
+
+    // CPU and GPU memory of the model as it is right now, plus what the residency policy released after loading
+    ModelMemoryReport memoryReport() const {
+        ModelMemoryReport report;
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            const Mesh& mesh = meshes[i];
+            report.cpuVertexBytes += mesh.vertices.capacity() * sizeof(Vertex);
+            report.cpuIndexBytes += mesh.indices.capacity() * sizeof(unsigned int);
+            report.textureRecordBytes += textureRecordBytes(mesh.textures);
+            report.gpuGeometryBytes += mesh.vertexBufferBytes + mesh.indexBufferBytes;
+        }
+        report.textureRecordBytes += textureRecordBytes(textures_loaded);
+        report.arenaBytes = cpuArena.bytes();
+        report.releasedBytes = releasedCpuBytes;
+        return report;
+    }
+
+    void printMemoryReport() const {
+        ModelMemoryReport r = memoryReport();
+        std::cout << "MODEL::MEMORY residency " << meshResidencyName(options.residency) << ": CPU " << r.cpuBytes() / 1024 << " KB (vertices "
+                  << r.cpuVertexBytes / 1024 << " KB, indices " << r.cpuIndexBytes / 1024 << " KB, texture records " << r.textureRecordBytes / 1024
+                  << " KB, arena " << r.arenaBytes / 1024 << " KB), GPU geometry " << r.gpuGeometryBytes / 1024 << " KB, released "
+                  << r.releasedBytes / 1024 << " KB after upload" << std::endl;
+    }
+
 private:
     // model data
     vector<Mesh> meshes;
+    TransformGraph transformGraph;
     string directory;
+    ModelLoadOptions options;
+    unordered_map<string, unsigned int> texturesByPath; // material texture path -> index into textures_loaded
+    vector<MeshOptimizationReport> optimizationReports;  // filled during the import, printed once it's done
+    MeshDataArena cpuArena;                 // the spilled geometry with MESH_RESIDENCY_SPILL
+    size_t releasedCpuBytes = 0;
+    ModelLoadTimings timings;
+    unsigned int drawnTriangles = 0;
+    bool ready = true;
+    bool nodeTransforms = false;            // some mesh sits on a node whose world matrix isn't the identity
+    ClusterCullStats cullStats;
+    vector<GLsizei> drawCounts;             // per frame meshlet draw list, kept around to avoid reallocating it
+    vector<unsigned int> drawFirstIndices;
+
+    // updates the node world matrices if any node changed and checks whether the meshes still all sit at the origin
+    void updateTransforms() {
+        if (transformGraph.update() == 0)
+            return;
+
+        nodeTransforms = false;
+        for (unsigned int i = 0; i < meshes.size() && !nodeTransforms; i++)
+            nodeTransforms = !transformGraph.isIdentity(meshes[i].node);
+    }
+
+    // the model matrix of one mesh: the caller's model matrix times the world matrix of the mesh's node
+    glm::mat4 meshMatrix(const Mesh& mesh, const glm::mat4& modelMatrix) const {
+        return nodeTransforms ? modelMatrix * transformGraph.world(mesh.node) : modelMatrix;
+    }
+
+    // same uniforms Main.cpp sets for the whole model, just for a single mesh
+    static void setMeshMatrix(const MeshUniforms& uniforms, const glm::mat4& view, const glm::mat4& matrix) {
+        glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * matrix)));
+        glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &matrix[0][0]);
+        glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, &normalMatrix[0][0]);
+    }
+
+    // coarsest level of detail whose error, projected onto the screen, stays below maxPixelError
+    static unsigned int selectLod(const Mesh& mesh, const Camera& camera, const glm::mat4& modelMatrix, float viewportHeight, float maxPixelError) {
+        // world units -> pixels at a distance of 1 for a symmetric perspective projection
+        float pixelsPerUnit = viewportHeight / (2.0f * tanf(glm::radians(camera.Zoom) * 0.5f));
+
+        // the error is in model units, so scale it by the largest axis scale of the model matrix
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+        float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+
+        // distance to the closest point of the bounding sphere, so a camera inside the mesh always gets full detail
+        float distance = glm::length(center - camera.Position) - radius;
+        if (distance <= 0.0f)
+            return 0;
+
+        for (unsigned int l = (unsigned int)mesh.lods.size() - 1; l > 0; l--) {
+            if (mesh.lods[l].error * scale * pixelsPerUnit / distance <= maxPixelError)
+                return l;
+        }
+        return 0;
+    }
+
+    // empty model for ModelLoader to fill in, not ready until it says so
+    Model(const string& path, ModelLoadOptions options, bool ready) : directory(directoryOf(path)), options(options), ready(ready) {}
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static string directoryOf(const string& path) {
+        return path.substr(0, path.find_last_of('/'));
+    }
 
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector. The
+    // same importGeometry a ModelLoader runs on its worker, followed right away by the GL part of finalizeMesh.
     void loadModel(string path) {
-        Assimp::Importer import;
-        const aiScene * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
+        directory = directoryOf(path);
+
+        vector<ImportedMesh> imported;
+        if (!importGeometry(path, options, imported, transformGraph, &timings, &optimizationReports))
+            return;
+
+        meshes.reserve(imported.size());
+        for (unsigned int i = 0; i < imported.size(); i++)
+            finalizeMesh(imported[i]);
+
+        if (!timings.fromCache) {
+            if (options.optimizeMeshes)
+                printOptimizationReports();
+            if (options.generateLods)
+                printLodReport();
+        }
+        applyResidency();
+    }
+
+    // drops (or spills) the CPU copies of the geometry according to options.residency. Runs once the whole model is
+    // uploaded and the mesh cache written, which are the last things that read the Mesh vectors.
+    void applyResidency() {
+        if (options.residency == MESH_RESIDENCY_KEEP)
+            return;
+
+        if (options.residency == MESH_RESIDENCY_SPILL) {
+            size_t bytes = 0;
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                bytes += MeshDataArena::bytesFor(meshes[i].vertices.size(), meshes[i].indices.size());
+            cpuArena.reserve(bytes, meshes.size());
+            for (unsigned int i = 0; i < meshes.size(); i++) {
+                const Mesh& mesh = meshes[i];
+                cpuArena.add(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.boundsMin, mesh.boundsMax);
+            }
+        }
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            releasedCpuBytes += meshes[i].releaseCpuData();
+
+        // the path lookup only dedupes textures while loading, the ids in textures_loaded are all the destructor needs
+        releasedCpuBytes += textureRecordBytes(textures_loaded);
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            string().swap(textures_loaded[i].path);
+        releasedCpuBytes -= textureRecordBytes(textures_loaded);
+        for (unordered_map<string, unsigned int>::const_iterator it = texturesByPath.begin(); it != texturesByPath.end(); ++it)
+            releasedCpuBytes += sizeof(*it) + stringHeapBytes(it->first);
+        unordered_map<string, unsigned int>().swap(texturesByPath);
+    }
+
+    static size_t textureRecordBytes(const vector<Texture>& textures) {
+        size_t bytes = textures.capacity() * sizeof(Texture);
+        for (unsigned int i = 0; i < textures.size(); i++)
+            bytes += stringHeapBytes(textures[i].type) + stringHeapBytes(textures[i].path);
+        return bytes;
+    }
+
+    // the GL free part of loading a model: reads the mesh cache, or imports with ObjLoader / assimp, runs our own processing
+    // and writes the cache for next time. Touches no members so it can run on any thread. Returns false if the import
+    // failed. The parse, convert and process steps are added to timings if given, and reports (if given) gets one
+    // optimization report per mesh appended when the meshes were imported rather than read from the cache.
+    static bool importGeometry(const string& path, const ModelLoadOptions& options, vector<ImportedMesh>& out, TransformGraph& graph,
+                               ModelLoadTimings* timings = NULL, vector<MeshOptimizationReport>* reports = NULL) {
+
+        ModelLoadTimings local;
+        if (!timings)
+            timings = &local;
+        auto start = std::chrono::steady_clock::now();
+
+        uint64_t sourceHash = 0;
+        if (options.useMeshCache) {
+            sourceHash = hashFileContents(path);
+            MeshCache cache;
+            if (sourceHash != 0 && cache.open(MeshCache::cachePathFor(path), sourceHash, MODEL_IMPORT_FLAGS, processingFlags(options))) {
+                cache.nodes(graph);
+                out.resize(cache.meshCount());
+                for (unsigned int i = 0; i < cache.meshCount(); i++) {
+                    const MeshCacheEntry& e = cache.entry(i);
+                    ImportedMesh& mesh = out[i];
+                    mesh.vertices.assign(cache.vertices(e), cache.vertices(e) + e.vertexCount);
+                    mesh.indices.assign(cache.indices(e), cache.indices(e) + e.indexCount);
+                    mesh.lods = cache.lods(e);
+                    mesh.meshlets.assign(cache.meshlets(e), cache.meshlets(e) + e.meshletCount);
+                    mesh.boundsMin = glm::vec3(e.boundsMin[0], e.boundsMin[1], e.boundsMin[2]);
+                    mesh.boundsMax = glm::vec3(e.boundsMax[0], e.boundsMax[1], e.boundsMax[2]);
+                    mesh.node = e.node;
+                    for (unsigned int j = 0; j < e.textureCount; j++) {
+                        const MeshCacheTextureRef& ref = cache.textureRef(e.firstTexture + j);
+                        Texture texture;
+                        texture.id = 0;
+                        texture.type = cache.textureType(ref);
+                        texture.path = cache.texturePath(ref);
+                        mesh.textures.push_back(texture);
+                    }
+                }
+                timings->parseMs += millisecondsSince(start);
+                timings->fromCache = true;
+                std::cout << "MESH_CACHE::SUCCESS MODEL LOADED " << MeshCache::cachePathFor(path) << std::endl;
+                return true;
+            }
+        }
+
+        if (options.fastObjLoader && ObjLoader::canLoad(path) && importObj(path, options, out, graph, timings, reports)) {
+            writeImportCache(path, options, sourceHash, out, graph);
+            return true;
+        }
+
+        start = std::chrono::steady_clock::now();
+        Assimp::Importer import;
+        const aiScene* scene = import.ReadFile(path, MODEL_IMPORT_FLAGS);
+        timings->parseMs += millisecondsSince(start);
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
-            return;
+            return false;
+        }
+        std::cout << "ASSIMP::SUCCESS MODEL LOADED " << path << std::endl;
+
+        vector<aiMesh*> sceneMeshes;
+        vector<unsigned int> meshNodes;
+        graph.clear();
+        collectMeshes(scene->mRootNode, scene, TransformGraph::NO_PARENT, graph, sceneMeshes, meshNodes);
+        out.resize(sceneMeshes.size());
+        size_t firstReport = 0;
+        if (reports && options.optimizeMeshes) {
+            firstReport = reports->size();
+            reports->resize(firstReport + out.size());
+        }
+
+        // converted in one pass and processed in a second one, so each step gets a wall time of its own
+        auto convertMesh = [&](size_t i) {
+            ImportedMesh& mesh = out[i];
+            mesh.node = meshNodes[i];
+            convertMeshGeometry(sceneMeshes[i], mesh.vertices, mesh.indices);
+            collectMaterialTextures(scene->mMaterials[sceneMeshes[i]->mMaterialIndex], mesh.textures);
+        };
+        auto processMesh = [&](size_t i, ImportArena& arena) {
+            ImportedMesh& mesh = out[i];
+            MeshOptimizationReport report;
+            processGeometry(options, mesh, reports && options.optimizeMeshes ? &(*reports)[firstReport + i] : &report, arena);
+            Mesh::computeBounds(mesh.vertices.data(), mesh.vertices.size(), mesh.boundsMin, mesh.boundsMax);
+        };
+
+        if (options.parallelImport) {
+            ThreadPool pool(options.numThreads);
+            auto phaseStart = std::chrono::steady_clock::now();
+            pool.parallelFor(sceneMeshes.size(), convertMesh);
+            timings->convertMs += millisecondsSince(phaseStart);
+            phaseStart = std::chrono::steady_clock::now();
+            processInParallel(pool, sceneMeshes.size(), processMesh);
+            timings->processMs += millisecondsSince(phaseStart);
         }
         else {
-            std::cout << "ASSIMP::SUCCESS MODEL LOADED " << path << std::endl;
+            auto phaseStart = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+                convertMesh(i);
+            timings->convertMs += millisecondsSince(phaseStart);
+            phaseStart = std::chrono::steady_clock::now();
+            ImportArena arena;
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+                processMesh(i, arena);
+            timings->processMs += millisecondsSince(phaseStart);
+        }
+
+        writeImportCache(path, options, sourceHash, out, graph);
+        return true;
+    }
 
+    static void writeImportCache(const string& path, const ModelLoadOptions& options, uint64_t sourceHash, const vector<ImportedMesh>& meshes,
+                                 const TransformGraph& graph) {
+        if (options.useMeshCache && sourceHash != 0 && !meshes.empty()) {
+            if (!MeshCache::write(MeshCache::cachePathFor(path), sourceHash, MODEL_IMPORT_FLAGS, processingFlags(options), meshes, graph,
+                                  cacheDependencies(path)))
+                std::cout << "WARNING::MESH_CACHE::COULD NOT WRITE " << MeshCache::cachePathFor(path) << std::endl;
         }
+    }
 
-        directory = path.substr(0, path.find_last_of('/'));
+    // imports an .obj file with ObjLoader and runs our own processing on it, the same result importGeometry gets from
+    // assimp. Returns false if ObjLoader couldn't read the file, the caller falls back to assimp then. GL free like
+    // importGeometry, reports (if given) gets one optimization report per mesh appended.
+    static bool importObj(const string& path, const ModelLoadOptions& options, vector<ImportedMesh>& out, TransformGraph& graph,
+                          ModelLoadTimings* timings, vector<MeshOptimizationReport>* reports) {
+        vector<ObjMesh> objMeshes;
+        ObjLoadStats stats;
+        if (!ObjLoader::load(path, objMeshes, graph, options.parallelImport ? options.numThreads : 1, &stats)) {
+            graph.clear();
+            std::cout << "WARNING::OBJ_LOADER::FALLING BACK TO ASSIMP FOR " << path << std::endl;
+            return false;
+        }
+        std::cout << "OBJ_LOADER::SUCCESS MODEL LOADED " << path << " (" << stats.triangles << " triangles, " << stats.chunks << " chunks)" << std::endl;
+        timings->parseMs += stats.parseMs;
+        timings->convertMs += stats.mergeMs;
+
+        out.resize(objMeshes.size());
+        for (size_t i = 0; i < objMeshes.size(); i++) {
+            out[i].vertices.swap(objMeshes[i].vertices);
+            out[i].indices.swap(objMeshes[i].indices);
+            out[i].textures.swap(objMeshes[i].textures);
+            out[i].node = objMeshes[i].node;
+        }
+
+        size_t firstReport = 0;
+        if (reports && options.optimizeMeshes) {
+            firstReport = reports->size();
+            reports->resize(firstReport + out.size());
+        }
+        auto processMesh = [&](size_t i, ImportArena& arena) {
+            MeshOptimizationReport report;
+            processGeometry(options, out[i], reports && options.optimizeMeshes ? &(*reports)[firstReport + i] : &report, arena);
+            Mesh::computeBounds(out[i].vertices.data(), out[i].vertices.size(), out[i].boundsMin, out[i].boundsMax);
+        };
+
+        auto phaseStart = std::chrono::steady_clock::now();
+        if (options.parallelImport && out.size() > 1) {
+            ThreadPool pool(options.numThreads);
+            processInParallel(pool, out.size(), processMesh);
+        }
+        else {
+            ImportArena arena;
+            for (size_t i = 0; i < out.size(); i++)
+                processMesh(i, arena);
+        }
+        timings->processMs += millisecondsSince(phaseStart);
+        return true;
+    }
 
-        processNode(scene->mRootNode, scene);
+    // turns an imported mesh into a GL mesh and loads its textures. Must run on the thread that owns the GL context.
+    void finalizeMesh(ImportedMesh& imported) {
+        vector<Texture> textures;
+        textures.reserve(imported.textures.size());
+        for (unsigned int i = 0; i < imported.textures.size(); i++)
+            textures.push_back(loadTexture(imported.textures[i].path.c_str(), imported.textures[i].type));
+
+        // the arrays move into the Mesh, ImportedMesh is left empty
+        auto uploadStart = std::chrono::steady_clock::now();
+        meshes.push_back(Mesh(std::move(imported.vertices), std::move(imported.indices), std::move(textures), options.vertexFormat));
+        timings.geometryUploadMs += millisecondsSince(uploadStart);
+        applyImportedData(meshes.back(), imported);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene) {
+    // hands the per mesh results of the import steps to a freshly created Mesh
+    static void applyImportedData(Mesh& mesh, ImportedMesh& imported) {
+        if (!imported.lods.empty())
+            mesh.lods.swap(imported.lods);
+        mesh.meshlets.swap(imported.meshlets);
+        mesh.node = imported.node;
+    }
 
-        // process all the node's meshes (if any)
-        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+    // the other files an import of path reads, so the mesh cache is rebuilt when one of them changes. Only the .mtl
+    // libraries of an .obj for now, assimp and ObjLoader both take its texture references from them.
+    static vector<string> cacheDependencies(const string& path) {
+        if (!ObjLoader::canLoad(path))
+            return vector<string>();
+        return ObjLoader::materialLibraries(path);
+    }
+
+    // which of our own import steps are enabled, stored in the mesh cache so toggling one rebuilds the cache
+    static uint32_t processingFlags(const ModelLoadOptions& options) {
+        uint32_t flags = 0;
+        if (options.optimizeMeshes)
+            flags |= MESH_PROCESS_OPTIMIZED;
+        if (options.generateLods)
+            flags |= MESH_PROCESS_LODS | (options.lodLevels << MESH_PROCESS_LOD_LEVELS_SHIFT);
+        if (options.buildMeshlets)
+            flags |= MESH_PROCESS_MESHLETS;
+        return flags;
+    }
+
+    void printOptimizationReports() {
+        for (unsigned int i = 0; i < optimizationReports.size(); i++) {
+            const MeshOptimizationReport& r = optimizationReports[i];
+            std::cout << "MESH_OPTIMIZER::MESH " << i << ": " << r.triangles << " triangles, vertices " << r.verticesBefore << " -> " << r.verticesAfter
+                      << ", ACMR " << r.acmrBefore << " -> " << r.acmrAfter << " (" << r.clusters << " clusters)" << std::endl;
         }
+        optimizationReports.clear();
+    }
 
-        // then do the same for each of its children
-        for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+    void printLodReport() {
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            std::cout << "MESH_SIMPLIFIER::MESH " << i << ":";
+            for (unsigned int l = 0; l < meshes[i].lods.size(); l++)
+                std::cout << " LOD" << l << " " << meshes[i].lods[l].indexCount / 3 << " tris (error " << meshes[i].lods[l].error << ")";
+            std::cout << std::endl;
         }
+    }
 
+    // optional import steps that only touch the geometry, safe to run on worker threads. All their scratch memory comes
+    // from the arena, which is reset at the end, so an arena reused for every mesh of a load only allocates while it grows
+    // to the size the biggest mesh needs. The vertices and indices are rewritten in place, only the index buffer grows once
+    // when levels of detail are appended.
+    static void processGeometry(const ModelLoadOptions& options, ImportedMesh& mesh, MeshOptimizationReport* report, ImportArena& arena) {
+        if (options.optimizeMeshes)
+            *report = MeshOptimizer::optimize(mesh.vertices, mesh.indices, 1.05f, &arena);
+        if (options.generateLods)
+            MeshSimplifier::generateLods(mesh.vertices, mesh.indices, mesh.lods, options.lodLevels, 96, &arena);
+        if (options.buildMeshlets) {
+            // only the full detail level, it's the one that gets close enough to the camera for culling to pay off
+            size_t fullDetailIndices = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+            MeshletBuilder::build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), 0, fullDetailIndices, mesh.meshlets, &arena);
+        }
+        arena.reset();
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene) {
+    // runs process(i, arena) for every mesh on the pool. Every job gets an arena of its own and keeps it for all the meshes
+    // it picks up, so the arenas are per worker rather than per mesh.
+    template <typename Fn>
+    static void processInParallel(ThreadPool& pool, size_t count, Fn process) {
+        size_t jobs = std::min<size_t>(std::max(1u, pool.size()), count);
+        std::unique_ptr<ImportArena[]> arenas(new ImportArena[jobs]);
+        pool.parallelForJobs(count, [&](size_t i, unsigned int job) {
+            process(i, arenas[job]);
+        });
+    }
 
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+    // gathers all meshes referenced by a node and its children, depth first. Every node is added to the graph on the way
+    // down (so parents always come first) and meshNodes gets the node of each mesh.
+    static void collectMeshes(aiNode* node, const aiScene* scene, int parent, TransformGraph& graph, vector<aiMesh*>& out, vector<unsigned int>& meshNodes) {
+
+        unsigned int index = graph.addNode(parent, toGlm(node->mTransformation), node->mName.C_Str());
+
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+            out.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(index);
+        }
+
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            collectMeshes(node->mChildren[i], scene, (int)index, graph, out, meshNodes);
+    }
+
+    // assimp matrices are row major, glm is column major
+    static glm::mat4 toGlm(const aiMatrix4x4& m) {
+        glm::mat4 result;
+        result[0][0] = m.a1; result[1][0] = m.a2; result[2][0] = m.a3; result[3][0] = m.a4;
+        result[0][1] = m.b1; result[1][1] = m.b2; result[2][1] = m.b3; result[3][1] = m.b4;
+        result[0][2] = m.c1; result[1][2] = m.c2; result[2][2] = m.c3; result[3][2] = m.c4;
+        result[0][3] = m.d1; result[1][3] = m.d2; result[2][3] = m.d3; result[3][3] = m.d4;
+        return result;
+    }
+
+    // converts the vertex and index arrays of an aiMesh into our own format. The output vectors are sized up front and then
+    // written by index, and nothing in here touches OpenGL or the model's members so it is safe to call from worker threads.
+    static void convertMeshGeometry(const aiMesh* mesh, vector<Vertex>& vertices, vector<unsigned int>& indices) {
+
+        vertices.resize(mesh->mNumVertices);
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
 
-            Vertex vertex;
+            Vertex& vertex = vertices[i];
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
            
             // positions
@@ -101,7 +754,7 @@ private:
                 vector.y = mesh->mNormals[i].y;
                 vector.z = mesh->mNormals[i].z;
                 vertex.Normal = vector;
-            }
+            } else vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
             
             // texture coordinates
             // does the mesh contain texture coordinates?
@@ -116,23 +769,30 @@ private:
                 vertex.TexCoords = vec;
                
             } else  vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
 
+        // count the indices first so the index array is allocated exactly once
+        size_t indexCount = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+
+        indices.resize(indexCount);
+
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        size_t n = 0;
         for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
 
-            aiFace face = mesh->mFaces[i];
+            const aiFace& face = mesh->mFaces[i];
 
             // retrieve all indices of the face and store them in the indices vector
             for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+                indices[n++] = face.mIndices[j];
         }
+    }
 
+    // lists the texture files a material uses (type and path, no id) without loading anything, so it's safe on any thread
+    static void collectMaterialTextures(aiMaterial* material, vector<Texture>& textures) {
 
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
@@ -141,96 +801,64 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // appends all material textures of a given type, the textures themselves are loaded later by loadTexture
+    static void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, vector<Texture>& textures)
     {
-
-        vector<Texture> textures;
-
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
 
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-
-            for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-
-            if (!skip) {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
+    }
 
-        return textures;
+    // returns the texture for the given path, loading it only if it hasn't been loaded before
+    Texture loadTexture(const char* path, const string& typeName)
+    {
+        // check if this model already uses the texture and if so skip asking the registry again
+        unordered_map<string, unsigned int>::iterator it = texturesByPath.find(path);
+        if (it != texturesByPath.end())
+            return textures_loaded[it->second]; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+
+        // if texture hasn't been loaded already, get it from the shared registry (which only loads it if no other model has)
+        TextureRegistryStats before = TextureRegistry::instance().loadTimes();
+        Texture texture;
+        texture.id = TextureFromFile(path, directory, typeName);
+        TextureRegistryStats after = TextureRegistry::instance().loadTimes();
+        timings.textureDecodeMs += after.decodeMs - before.decodeMs;
+        timings.textureUploadMs += after.uploadMs - before.uploadMs;
+        texture.type = typeName;
+        texture.path = path;
+        texturesByPath[texture.path] = (unsigned int)textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+        return texture;
     }
 
-    unsigned int TextureFromFile(const char* path, const string& directory)
+    // takes a reference on the texture in the process wide registry, released again in the destructor
+    unsigned int TextureFromFile(const char* path, const string& directory, const string& typeName)
     {
         string filename = string(path);
         filename = directory + '/' + filename;
         std::cout << filename << std::endl;
 
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-
-        int width, height, nrComponents;
-        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
-
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Texture failed to load at path: " << path << std::endl;
-            stbi_image_free(data);
-        }
-
-        return textureID;
+        TextureLoadParams params;
+        params.format = TextureCooker::chooseFormat(options.textureCompression, typeName, filename);
+        params.colorSpace = TextureCooker::chooseColorSpace(typeName);
+        params.mipFilter = options.mipFilter;
+        return TextureRegistry::instance().acquire(filename, options.textureLoader, params);
     }
 
 };
@@ -0,0 +1,1522 @@
+// load-time benchmark for the Model class. Build it as its own executable next to Main.cpp (same libraries: glad, glfw,
+// assimp, stb_image, plus AllocationCounter.cpp for --allocations) and run it from the project directory:
+//
+//     ModelBenchmark [path/to/model] [runs]
+//     ModelBenchmark --lod [path/to/model] [frames]
+//     ModelBenchmark --async [path/to/model] [models]
+//     ModelBenchmark --residency [path/to/model]
+//     ModelBenchmark --transforms [nodes] [frames]
+//     ModelBenchmark --bcn [path/to/image]
+//     ModelBenchmark --mips [path/to/image] [runs]
+//     ModelBenchmark --allocations [meshes]
+//     ModelBenchmark --materials [meshes] [frames]
+//     ModelBenchmark --queue [packets] [frames]
+//     ModelBenchmark --instancing [instances] [frames]
+//     ModelBenchmark --indirect [meshes] [materials] [frames]
+//     ModelBenchmark --ring [instances] [frames]
+//     ModelBenchmark --import [runs] [path/to/model ...] [--synthetic triangles[,triangles...]] [--json report.json] [--parallel] [--assimp]
+//
+// one benchmark per run. The modes are listed in benchmarkModes above main(), each with the function that reads its
+// arguments and runs it, and main() only parses the command line and creates the context the mode asks for.
+//
+// the model is loaded once serially and then with the parallel import using 1, 2, 4 ... up to one thread per core, and the
+// average load time and speedup over the serial path is printed for each thread count. The mesh cache is switched off so
+// every run really parses the file.
+//
+// with --lod a dense scene (a grid of copies of the model running away from the camera) is rendered offscreen with and
+// without level of detail selection, and the triangles per frame and average frame time are printed for both.
+//
+// with --async the model is queued `models` times and the time until the first frame could be shown is compared between
+// constructing the models directly and loading them through ModelLoader with a 2 ms per frame upload budget.
+//
+// with --residency the model is loaded once with every MeshResidency policy and the CPU memory left after the upload is
+// printed for each, along with the worst position error of the spilled copy against the kept one.
+//
+// with --transforms a random node hierarchy is built in a TransformGraph and the world matrix update is timed when every
+// node is dirty, when a few nodes are animated each frame and when only the root moves.
+//
+// with --bcn the image is block compressed into every BCn format TextureCooker can produce, decoded again and the PSNR
+// against the original and the encode speed are printed. Exits with an error if a format falls below its quality bar.
+//
+// with --mips the full mip chain of the image is built with each MipGenerator filter, on one thread and on the pool, and
+// the throughput in source megapixels per second is printed.
+//
+// with --import every model (the backpack if none is given, plus generated grid OBJs with the requested triangle counts,
+// 100k and 1M by default) is loaded `runs` times without the mesh cache, and the wall time of each load phase (assimp
+// parse, aiMesh conversion, our mesh processing, texture decode, texture and geometry upload, glFinish) is written as a
+// JSON report with mean/min/percentiles/max and the raw samples, so two builds of the loader can be compared run to run.
+// .obj files go through ObjLoader unless --assimp is given, running both and comparing the reports shows what it saves.
+//
+// with --allocations OBJs of `meshes` grids (8 by default) of 1k, 10k and 100k triangles each are generated and loaded, and
+// the heap allocations per mesh are counted (see AllocationCounter). They have to stay the same whatever the mesh size.
+//
+// with --materials a scene of `meshes` (1000 by default) small textured meshes is submitted for `frames` frames, and the
+// CPU time per frame of binding materials by uniform name is compared with the compiled Material (see Material.h).
+//
+// with --queue 1k, 10k and up to `packets` (100k by default) random draw packets are submitted to a RenderQueue, sorted
+// and executed each frame, and the time per packet of every step is printed so you can see it stays flat as the count grows.
+//
+// with --instancing 1k, 10k and up to `instances` (100k by default) cubes are drawn with a draw call per cube and with one
+// instanced draw (see InstanceBuffer.h), once with instances that stay put and once rewriting all of them every frame.
+//
+// with --indirect `meshes` (4096 by default) meshes sharing `materials` (16) texture sets are drawn with a Mesh::Draw per
+// mesh and with one glMultiDrawElementsIndirect per material (see IndirectRenderer.h), and the CPU time of both is printed.
+//
+// with --ring `instances` (10k by default) cubes are moved every frame and drawn instanced, their matrices uploaded by an
+// InstanceBuffer into its own orphaned buffer and into the persistently mapped RingBuffer with 3, 2 and 1 frames in flight. The
+// CPU time per frame and the fence waits of each are printed, waits show the GPU holding the CPU back.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/matrix_transform.hpp>
+
+#include "AllocationCounter.h"
+#include "Shaders.h"
+#include "Camera.h"
+#include "CameraUniforms.h"
+#include "Model.h"
+#include "ModelLoader.h"
+#include "RenderQueue.h"
+#include "RingBuffer.h"
+#include "InstanceBuffer.h"
+#include "MipGenerator.h"
+#include "TextureCompression.h"
+#include "TransformGraph.h"
+#include "src/stb_image.h"
+
+// loads the model `runs` times with the given options and returns the average wall time in milliseconds
+double timeModelLoad(const std::string& path, const ModelLoadOptions& options, int runs)
+{
+    double totalMs = 0.0;
+
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            Model model(path, options);
+            glFinish(); // make sure the buffer uploads are part of the measurement
+        }
+        auto end = std::chrono::steady_clock::now();
+        totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    return totalMs / runs;
+}
+
+// renders a LOD_GRID x LOD_GRID grid of the model `frames` times and returns the average frame time in milliseconds
+const int LOD_GRID = 24;
+const float LOD_GRID_SPACING = 4.0f;
+const unsigned int LOD_VIEWPORT_WIDTH = 1280;
+const unsigned int LOD_VIEWPORT_HEIGHT = 720;
+
+double timeLodScene(Model& model, Shader& shader, const Camera& camera, bool useLods, int frames, unsigned long long& trianglesPerFrame)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)LOD_VIEWPORT_WIDTH / (float)LOD_VIEWPORT_HEIGHT, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(camera.Position, camera.Position + camera.Front, camera.Up);
+
+    CameraUniforms::instance().update(view, projection, camera.Position, 0.0f);
+    shader.use();
+
+    double totalMs = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        trianglesPerFrame = 0;
+        for (int x = 0; x < LOD_GRID; x++) {
+            for (int z = 0; z < LOD_GRID; z++) {
+                glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3((x - LOD_GRID / 2) * LOD_GRID_SPACING, 0.0f, -z * LOD_GRID_SPACING));
+                shader.setMat4("model", modelMatrix);
+                if (useLods)
+                    model.Draw(shader, camera, modelMatrix, (float)LOD_VIEWPORT_HEIGHT);
+                else
+                    model.Draw(shader, view, modelMatrix);
+                trianglesPerFrame += model.lastDrawTriangles();
+            }
+        }
+        glFinish(); // wait for the GPU so the frame time includes the actual rendering
+
+        totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return totalMs / frames;
+}
+
+int runLodBenchmark(const std::string& path, int frames)
+{
+    ModelLoadOptions options;
+    Model model(path, options);
+    Shader shader("modelShaders.vts", "modelShaders.fts");
+    CameraUniforms::instance().attach(shader.ID);
+
+    // offscreen target, the hidden window's default framebuffer isn't guaranteed to be rendered at all
+    unsigned int fbo, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, LOD_VIEWPORT_WIDTH, LOD_VIEWPORT_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, LOD_VIEWPORT_WIDTH, LOD_VIEWPORT_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+
+    glViewport(0, 0, LOD_VIEWPORT_WIDTH, LOD_VIEWPORT_HEIGHT);
+    glEnable(GL_DEPTH_TEST);
+
+    // standing in front of the first row, looking down the grid
+    Camera camera(glm::vec3(0.0f, 2.0f, 6.0f));
+
+    unsigned long long fullTriangles = 0, lodTriangles = 0;
+    timeLodScene(model, shader, camera, false, 2, fullTriangles); // warm up
+    double fullMs = timeLodScene(model, shader, camera, false, frames, fullTriangles);
+    double lodMs = timeLodScene(model, shader, camera, true, frames, lodTriangles);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &fbo);
+    CameraUniforms::instance().shutdown();
+
+    std::cout << "\n-- lod benchmark: " << path << ", " << LOD_GRID * LOD_GRID << " instances, " << frames << " frames --" << std::endl;
+    std::cout << "full detail   " << fullTriangles << " triangles/frame   " << fullMs << " ms/frame" << std::endl;
+    std::cout << "lod (1 px)    " << lodTriangles << " triangles/frame   " << lodMs << " ms/frame   speedup " << fullMs / lodMs << std::endl;
+    return 0;
+}
+
+int runAsyncBenchmark(const std::string& path, int models)
+{
+    // warm up the file cache (and write the mesh cache) so both sides start from the same place
+    {
+        Model warmup(path);
+    }
+
+    // synchronous: nothing can be drawn until every constructor has returned
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::unique_ptr<Model>> loaded;
+        for (int i = 0; i < models; i++)
+            loaded.push_back(std::unique_ptr<Model>(new Model(path)));
+        glFinish();
+    }
+    double syncMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // asynchronous: queue everything, then run "frames" of one 2 ms update each until all models are ready
+    double firstFrameMs = 0.0, worstFrameMs = 0.0;
+    int frames = 0;
+    start = std::chrono::steady_clock::now();
+    {
+        ModelLoader loader(std::max(1u, std::thread::hardware_concurrency() / 2));
+        std::vector<shared_ptr<Model>> loaded;
+        for (int i = 0; i < models; i++)
+            loaded.push_back(loader.load(path));
+
+        while (loader.pendingCount() > 0) {
+            auto frameStart = std::chrono::steady_clock::now();
+            loader.update(2.0);
+            glFinish();
+            double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+            if (frames == 0)
+                firstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            worstFrameMs = std::max(worstFrameMs, frameMs);
+            frames++;
+        }
+    }
+    double asyncMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\n-- async load benchmark: " << path << " x" << models << " --" << std::endl;
+    std::cout << "constructor   first frame after " << syncMs << " ms" << std::endl;
+    std::cout << "ModelLoader   first frame after " << firstFrameMs << " ms, all ready after " << asyncMs << " ms (" << frames
+              << " frames, longest " << worstFrameMs << " ms)" << std::endl;
+    return 0;
+}
+
+int runResidencyBenchmark(const std::string& path)
+{
+    const MeshResidency policies[] = { MESH_RESIDENCY_KEEP, MESH_RESIDENCY_DISCARD, MESH_RESIDENCY_SPILL };
+    ModelMemoryReport reports[3];
+    double loadMs[3];
+
+    ModelLoadOptions options;
+    options.residency = MESH_RESIDENCY_KEEP;
+    Model kept(path, options);
+    reports[0] = kept.memoryReport();
+    loadMs[0] = kept.loadTimings().totalMs;
+
+    float worstError = 0.0f, worstExtent = 0.0f;
+    for (int p = 1; p < 3; p++) {
+        options.residency = policies[p];
+        Model model(path, options);
+        reports[p] = model.memoryReport();
+        loadMs[p] = model.loadTimings().totalMs;
+        if (policies[p] != MESH_RESIDENCY_SPILL)
+            continue;
+
+        // the spilled positions against the full precision ones, and the indices have to match exactly
+        const MeshDataArena& arena = model.cpuGeometry();
+        for (unsigned int m = 0; m < arena.meshCount(); m++) {
+            const Mesh& mesh = kept.mesh(m);
+            worstExtent = std::max(worstExtent, glm::length(mesh.boundsMax - mesh.boundsMin));
+            for (unsigned int v = 0; v < arena.vertexCount(m); v++)
+                worstError = std::max(worstError, glm::length(arena.position(m, v) - mesh.vertices[v].Position));
+            for (unsigned int i = 0; i < arena.indexCount(m); i++) {
+                if (arena.index(m, i) != mesh.indices[i]) {
+                    std::cout << "ERROR::BENCHMARK::SPILLED INDEX MISMATCH mesh " << m << " index " << i << std::endl;
+                    return -1;
+                }
+            }
+        }
+    }
+
+    std::cout << "\n-- residency benchmark: " << path << " --" << std::endl;
+    for (int p = 0; p < 3; p++) {
+        const ModelMemoryReport& r = reports[p];
+        std::cout << meshResidencyName(policies[p]) << "   CPU " << r.cpuBytes() / 1024 << " KB (vertices " << r.cpuVertexBytes / 1024
+                  << " KB, indices " << r.cpuIndexBytes / 1024 << " KB, texture records " << r.textureRecordBytes / 1024 << " KB, arena "
+                  << r.arenaBytes / 1024 << " KB)   GPU " << r.gpuGeometryBytes / 1024 << " KB   released " << r.releasedBytes / 1024
+                  << " KB   load " << loadMs[p] << " ms   saving " << 100.0 * (1.0 - (double)r.cpuBytes() / std::max<size_t>(1, reports[0].cpuBytes())) << "%" << std::endl;
+    }
+    std::cout << "spilled positions off by at most " << worstError << " (bounding box diagonal up to " << worstExtent << ")" << std::endl;
+    return 0;
+}
+
+// average time of graph.update() over `frames` frames, touch() runs before each update and isn't measured
+template <typename Touch>
+double timeTransformUpdate(TransformGraph& graph, int frames, Touch touch, unsigned int& recomputed)
+{
+    double totalMs = 0.0;
+    recomputed = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        touch(frame);
+        auto start = std::chrono::steady_clock::now();
+        recomputed = graph.update();
+        totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return totalMs / frames;
+}
+
+int runTransformBenchmark(unsigned int nodeCount, int frames)
+{
+    // a bushy random tree: every node hangs off one of the 64 nodes added before it
+    TransformGraph graph;
+    graph.reserve(nodeCount);
+    std::srand(1);
+    for (unsigned int i = 0; i < nodeCount; i++) {
+        int parent = i == 0 ? TransformGraph::NO_PARENT : (int)i - 1 - std::rand() % std::min(i, 64u);
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(0.01f * (std::rand() % 100), 0.1f, 0.0f));
+        graph.addNode(parent, local);
+    }
+
+    std::vector<glm::mat4> animated(nodeCount);
+    for (unsigned int i = 0; i < nodeCount; i++)
+        animated[i] = glm::rotate(graph.local(i), glm::radians(1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    unsigned int fullCount = 0, partialCount = 0, rootCount = 0;
+    double fullMs = timeTransformUpdate(graph, frames, [&](int) {
+        for (unsigned int i = 0; i < nodeCount; i++)
+            graph.setLocal(i, animated[i]);
+    }, fullCount);
+
+    // a handful of animated nodes spread over the second half of the graph, like a few moving parts in a large scene
+    double partialMs = timeTransformUpdate(graph, frames, [&](int frame) {
+        for (unsigned int k = 0; k < 16; k++) {
+            unsigned int node = nodeCount / 2 + (unsigned int)((frame * 16 + k) * 2654435761u % (nodeCount - nodeCount / 2));
+            graph.setLocal(node, animated[node]);
+        }
+    }, partialCount);
+
+    double rootMs = timeTransformUpdate(graph, frames, [&](int) {
+        graph.setLocal(0, animated[0]);
+    }, rootCount);
+
+    std::cout << "\n-- transform graph benchmark: " << nodeCount << " nodes, " << frames << " frames --" << std::endl;
+    std::cout << "all nodes dirty   " << fullMs << " ms/update (" << fullCount << " world matrices)" << std::endl;
+    std::cout << "16 nodes dirty    " << partialMs << " ms/update (" << partialCount << " world matrices)" << std::endl;
+    std::cout << "root dirty        " << rootMs << " ms/update (" << rootCount << " world matrices)" << std::endl;
+    return 0;
+}
+
+int runCompressionBenchmark(const std::string& path)
+{
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        std::cout << "ERROR::BENCHMARK::FAILED_TO_LOAD " << path << std::endl;
+        return -1;
+    }
+    size_t pixelCount = (size_t)width * height;
+
+    // lowest PSNR (dB) each format has to reach, roughly what the reference encoders get on ordinary photo textures
+    struct FormatBar { TextureFormat format; double minPsnr; };
+    const FormatBar formats[] = {
+        { TEXTURE_FORMAT_BC1, 30.0 }, { TEXTURE_FORMAT_BC3, 30.0 }, { TEXTURE_FORMAT_BC5, 38.0 }, { TEXTURE_FORMAT_BC7, 36.0 },
+    };
+
+    ThreadPool pool;
+    std::cout << "\n-- block compression benchmark: " << path << " " << width << "x" << height << ", "
+              << pool.size() << " threads --" << std::endl;
+
+    bool passed = true;
+    for (const FormatBar& bar : formats) {
+        std::vector<unsigned char> blocks, decoded;
+        auto start = std::chrono::steady_clock::now();
+        BlockCompressor::compress(bar.format, pixels, width, height, blocks, &pool);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        BlockCompressor::decompress(bar.format, blocks.data(), width, height, decoded);
+        double psnr = BlockCompressor::psnr(bar.format, pixels, decoded.data(), pixelCount);
+        bool ok = psnr >= bar.minPsnr;
+        passed = passed && ok;
+
+        std::cout << textureFormatName(bar.format) << "  " << psnr << " dB (min " << bar.minPsnr << ")  "
+                  << (pixelCount / 1000000.0) / (ms / 1000.0) << " MP/s  " << pixelCount * 4 / blocks.size() << ":1  "
+                  << (ok ? "OK" : "FAIL") << std::endl;
+    }
+
+    stbi_image_free(pixels);
+    return passed ? 0 : 1;
+}
+
+int runMipBenchmark(const std::string& path, int runs)
+{
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (!pixels) {
+        std::cout << "ERROR::BENCHMARK::FAILED_TO_LOAD " << path << std::endl;
+        return -1;
+    }
+    double megapixels = (double)width * height / 1000000.0;
+
+    ThreadPool pool;
+    std::cout << "\n-- mip generation benchmark: " << path << " " << width << "x" << height << "x" << channels << ", " << runs
+              << " runs, " << MipGenerator::simdName() << ", " << pool.size() << " threads --" << std::endl;
+
+    const MipFilter filters[] = { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+    const TextureColorSpace colorSpaces[] = { TEXTURE_COLOR_SPACE_SRGB, TEXTURE_COLOR_SPACE_LINEAR };
+    for (MipFilter filter : filters) {
+        for (TextureColorSpace colorSpace : colorSpaces) {
+            MipChain chain;
+            double ms[2] = {};
+            for (int threaded = 0; threaded < 2; threaded++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int run = 0; run < runs; run++)
+                    MipGenerator::generate(pixels, width, height, channels, chain, colorSpace, filter, threaded ? &pool : NULL);
+                ms[threaded] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+            }
+
+            std::cout << (filter == MIP_FILTER_BOX ? "box    " : "kaiser ") << (colorSpace == TEXTURE_COLOR_SPACE_SRGB ? "srgb   " : "linear ")
+                      << chain.levels.size() << " levels  1 thread " << ms[0] << " ms (" << megapixels / (ms[0] / 1000.0) << " MP/s)  pool "
+                      << ms[1] << " ms (" << megapixels / (ms[1] / 1000.0) << " MP/s)" << std::endl;
+        }
+    }
+
+    stbi_image_free(pixels);
+    return 0;
+}
+
+// writes a wavy square grid with positions, normals and texture coordinates as an OBJ with at least `triangles` triangles.
+// With `objects` > 1 the file holds that many grids side by side, each its own "o" object of `triangles` triangles, which
+// the loaders turn into one mesh each. Skipped if the file is already there, the content only depends on the arguments.
+bool writeSyntheticObj(const std::string& path, unsigned int triangles, unsigned int objects = 1)
+{
+    if (std::ifstream(path).good())
+        return true;
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    unsigned int cells = std::max(1u, (unsigned int)std::ceil(std::sqrt(triangles / 2.0)));
+    unsigned int side = cells + 1;
+    std::fprintf(file, "# synthetic benchmark grid, %u triangles\n", cells * cells * 2 * objects);
+
+    for (unsigned int object = 0; object < objects; object++) {
+        if (objects > 1)
+            std::fprintf(file, "o part_%u\n", object);
+        else
+            std::fprintf(file, "o grid\n");
+
+        float offset = object * 11.0f;
+        for (unsigned int z = 0; z < side; z++) {
+            for (unsigned int x = 0; x < side; x++) {
+                float u = (float)x / cells, v = (float)z / cells;
+                float height = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+                std::fprintf(file, "v %.5f %.5f %.5f\n", u * 10.0f - 5.0f + offset, height, v * 10.0f - 5.0f);
+            }
+        }
+        for (unsigned int z = 0; z < side; z++) {
+            for (unsigned int x = 0; x < side; x++) {
+                float u = (float)x / cells, v = (float)z / cells;
+                // derivative of the height field, scaled from uv to world units
+                float dx = 0.05f * 40.0f * std::cos(u * 40.0f) * std::cos(v * 40.0f) / 10.0f;
+                float dz = -0.05f * 40.0f * std::sin(u * 40.0f) * std::sin(v * 40.0f) / 10.0f;
+                glm::vec3 n = glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+                std::fprintf(file, "vn %.4f %.4f %.4f\n", n.x, n.y, n.z);
+            }
+        }
+        for (unsigned int z = 0; z < side; z++) {
+            for (unsigned int x = 0; x < side; x++)
+                std::fprintf(file, "vt %.5f %.5f\n", (float)x / cells, (float)z / cells);
+        }
+
+        // OBJ indices start at 1 and count through the whole file
+        unsigned int base = object * side * side + 1;
+        for (unsigned int z = 0; z < cells; z++) {
+            for (unsigned int x = 0; x < cells; x++) {
+                unsigned int a = base + z * side + x, b = a + 1, c = a + side, d = c + 1;
+                std::fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, b, b, b);
+                std::fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", b, b, b, c, c, c, d, d, d);
+            }
+        }
+    }
+
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    if (!ok)
+        std::remove(path.c_str());
+    return ok;
+}
+
+// linear interpolation between the closest ranks, p in [0, 100]
+double percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0.0;
+    std::sort(samples.begin(), samples.end());
+    double rank = p / 100.0 * (samples.size() - 1);
+    size_t lower = (size_t)rank;
+    size_t upper = std::min(lower + 1, samples.size() - 1);
+    return samples[lower] + (samples[upper] - samples[lower]) * (rank - lower);
+}
+
+std::string jsonEscape(const std::string& text)
+{
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out;
+}
+
+// names of the phases in the order ImportPhaseSamples stores them, also the keys in the JSON report
+const char* const IMPORT_PHASES[] = { "parse", "convert", "process", "textureDecode", "textureUpload", "geometryUpload", "glFinish", "total" };
+const int IMPORT_PHASE_COUNT = 8;
+
+struct ImportBenchmarkResult {
+    std::string path;
+    unsigned int meshes = 0, triangles = 0, textures = 0;
+    size_t geometryBytes = 0;
+    std::vector<double> samples[IMPORT_PHASE_COUNT]; // one per run and phase, in milliseconds
+};
+
+ImportBenchmarkResult benchmarkImport(const std::string& path, const ModelLoadOptions& options, int runs)
+{
+    ImportBenchmarkResult result;
+    result.path = path;
+
+    // one load up front so the file is in the OS cache and the first measured run doesn't pay for the disk
+    {
+        Model warmup(path, options);
+    }
+
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        Model model(path, options);
+        auto loaded = std::chrono::steady_clock::now();
+        glFinish();
+        auto finished = std::chrono::steady_clock::now();
+
+        const ModelLoadTimings& t = model.loadTimings();
+        double phases[IMPORT_PHASE_COUNT] = {
+            t.parseMs, t.convertMs, t.processMs, t.textureDecodeMs, t.textureUploadMs, t.geometryUploadMs,
+            std::chrono::duration<double, std::milli>(finished - loaded).count(),
+            std::chrono::duration<double, std::milli>(finished - start).count()
+        };
+        for (int p = 0; p < IMPORT_PHASE_COUNT; p++)
+            result.samples[p].push_back(phases[p]);
+
+        result.meshes = model.meshCount();
+        result.triangles = model.fullDetailTriangles();
+        result.textures = (unsigned int)model.textures_loaded.size();
+        result.geometryBytes = model.gpuGeometryBytes();
+    }
+    return result;
+}
+
+bool writeImportReport(const std::string& path, const std::vector<ImportBenchmarkResult>& results, int runs, const ModelLoadOptions& options)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "{\n";
+    out << "  \"benchmark\": \"model_import\",\n";
+    out << "  \"runs\": " << runs << ",\n";
+    out << "  \"parallelImport\": " << (options.parallelImport ? "true" : "false") << ",\n";
+    out << "  \"objLoader\": \"" << (options.fastObjLoader ? "fast" : "assimp") << "\",\n";
+    out << "  \"threads\": " << (options.parallelImport ? (options.numThreads ? options.numThreads : std::max(1u, std::thread::hardware_concurrency())) : 1) << ",\n";
+    out << "  \"models\": [\n";
+    for (size_t m = 0; m < results.size(); m++) {
+        const ImportBenchmarkResult& r = results[m];
+        out << "    {\n";
+        out << "      \"path\": \"" << jsonEscape(r.path) << "\",\n";
+        out << "      \"meshes\": " << r.meshes << ", \"triangles\": " << r.triangles << ", \"textures\": " << r.textures
+            << ", \"geometryBytes\": " << r.geometryBytes << ",\n";
+        out << "      \"phases\": {\n";
+        for (int p = 0; p < IMPORT_PHASE_COUNT; p++) {
+            const std::vector<double>& samples = r.samples[p];
+            double mean = 0.0;
+            for (double sample : samples)
+                mean += sample;
+            mean /= std::max<size_t>(1, samples.size());
+
+            out << "        \"" << IMPORT_PHASES[p] << "\": { \"mean\": " << mean << ", \"min\": " << percentile(samples, 0.0)
+                << ", \"p50\": " << percentile(samples, 50.0) << ", \"p90\": " << percentile(samples, 90.0) << ", \"p99\": " << percentile(samples, 99.0)
+                << ", \"max\": " << percentile(samples, 100.0) << ", \"samples\": [";
+            for (size_t i = 0; i < samples.size(); i++)
+                out << (i ? ", " : "") << samples[i];
+            out << "] }" << (p + 1 < IMPORT_PHASE_COUNT ? "," : "") << "\n";
+        }
+        out << "      }\n";
+        out << "    }" << (m + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return (bool)out;
+}
+
+int runImportBenchmark(const std::vector<std::string>& models, const std::vector<unsigned int>& syntheticTriangles, int runs,
+                       bool parallel, bool assimpOnly, const std::string& jsonPath)
+{
+    std::vector<std::string> paths = models;
+    for (unsigned int triangles : syntheticTriangles) {
+        std::string path = "benchmark_grid_" + std::to_string(triangles) + ".obj";
+        if (!writeSyntheticObj(path, triangles)) {
+            std::cout << "ERROR::BENCHMARK::COULD NOT WRITE " << path << std::endl;
+            return -1;
+        }
+        paths.push_back(path);
+    }
+
+    ModelLoadOptions options;
+    options.useMeshCache = false;   // every run has to parse the file
+    options.parallelImport = parallel;
+    options.fastObjLoader = !assimpOnly;
+
+    std::vector<ImportBenchmarkResult> results;
+    for (const std::string& path : paths)
+        results.push_back(benchmarkImport(path, options, runs));
+
+    // the loader itself is chatty, so print the summary once everything is done
+    std::cout << "\n-- model import benchmark: " << runs << " runs each, " << (parallel ? "parallel" : "serial") << " import, "
+              << (assimpOnly ? "assimp" : "ObjLoader") << " for .obj, median ms --" << std::endl;
+    for (const ImportBenchmarkResult& r : results) {
+        std::cout << r.path << " (" << r.meshes << " meshes, " << r.triangles << " triangles, " << r.textures << " textures)" << std::endl;
+        for (int p = 0; p < IMPORT_PHASE_COUNT; p++)
+            std::cout << "    " << IMPORT_PHASES[p] << " " << percentile(r.samples[p], 50.0) << " (p90 " << percentile(r.samples[p], 90.0) << ")" << std::endl;
+    }
+
+    if (!writeImportReport(jsonPath, results, runs, options)) {
+        std::cout << "ERROR::BENCHMARK::COULD NOT WRITE " << jsonPath << std::endl;
+        return -1;
+    }
+    std::cout << "BENCHMARK::SUCCESS report written to " << jsonPath << std::endl;
+    return 0;
+}
+
+// loads generated OBJs with `objects` grids of 1k, 10k and 100k triangles each and counts the heap allocations the Model
+// makes per mesh on top of parsing the file, with and without the mesh processing. Exits with an error if the count
+// grows with the size of the meshes instead of staying constant.
+int runAllocationBenchmark(unsigned int objects)
+{
+    const unsigned int sizes[] = { 1000, 10000, 100000 };
+    const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    double perMesh[2][sizeCount];
+    unsigned int meshes[sizeCount];
+
+    for (int s = 0; s < sizeCount; s++) {
+        std::string path = "benchmark_parts_" + std::to_string(objects) + "x" + std::to_string(sizes[s]) + ".obj";
+        if (!writeSyntheticObj(path, sizes[s], objects)) {
+            std::cout << "ERROR::BENCHMARK::COULD NOT WRITE " << path << std::endl;
+            return -1;
+        }
+
+        // what ObjLoader needs to parse the file on its own, the same on every run
+        size_t parseAllocations = AllocationCounter::count();
+        {
+            std::vector<ObjMesh> objMeshes;
+            TransformGraph graph;
+            if (!ObjLoader::load(path, objMeshes, graph, 1)) {
+                std::cout << "ERROR::BENCHMARK::COULD NOT PARSE " << path << std::endl;
+                return -1;
+            }
+        }
+        parseAllocations = AllocationCounter::count() - parseAllocations;
+
+        for (int processed = 0; processed < 2; processed++) {
+            ModelLoadOptions options;
+            options.useMeshCache = false;
+            options.optimizeMeshes = processed != 0;
+            options.generateLods = processed != 0;
+            options.buildMeshlets = processed != 0;
+
+            size_t before = AllocationCounter::count();
+            Model model(path, options);
+            size_t allocations = AllocationCounter::count() - before;
+
+            meshes[s] = model.meshCount();
+            perMesh[processed][s] = (double)(allocations - std::min(allocations, parseAllocations)) / std::max(1u, model.meshCount());
+        }
+    }
+
+    std::cout << "\n-- import allocation benchmark: " << objects << " meshes per file, allocations per mesh after parsing --" << std::endl;
+    for (int s = 0; s < sizeCount; s++)
+        std::cout << sizes[s] << " triangles x " << meshes[s] << "   plain " << perMesh[0][s] << "   optimized + lods + meshlets " << perMesh[1][s] << std::endl;
+
+    // a per vertex or per triangle allocation would show up as a factor of 10 between the sizes, allow some slack for
+    // the arena and the vectors growing with the size of the first mesh
+    for (int processed = 0; processed < 2; processed++) {
+        if (perMesh[processed][sizeCount - 1] > 2.0 * perMesh[processed][0] + 8.0) {
+            std::cout << "ERROR::BENCHMARK::ALLOCATIONS GROW WITH THE MESH SIZE" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// what Mesh::Draw did per texture before materials were compiled: build the sampler name, compare the type strings and
+// let setInt look the location up, for every texture of every mesh in every frame
+void bindMaterialByName(Shader& shader, const std::vector<Texture>& textures)
+{
+    unsigned int diffuseNr = 1;
+    unsigned int specularNr = 1;
+    for (unsigned int i = 0; i < textures.size(); i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        std::string number;
+        std::string name = textures[i].type;
+        if (name == "texture_diffuse")
+            number = std::to_string(diffuseNr++);
+        else if (name == "texture_specular")
+            number = std::to_string(specularNr++);
+        shader.setInt(("material." + name + number).c_str(), i);
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// CPU time of submitting a scene of `meshCount` small textured meshes (diffuse + specular + normal map each), averaged
+// over `frames` frames: the material and "model" uniform binding by name as it used to be, the same through the
+// compiled Material and cached MeshUniforms, and complete Mesh::Draw calls along with the state changes the GLStateCache
+// let through and skipped. The GPU is waited for between frames, not inside the measured part.
+int runMaterialBenchmark(unsigned int meshCount, int frames)
+{
+    Shader shader("modelShaders.vts", "modelShaders.fts");
+
+    // 1x1 textures, what is sampled doesn't matter here
+    unsigned int textureIDs[3];
+    glGenTextures(3, textureIDs);
+    const unsigned char texel[4] = { 255, 255, 255, 255 };
+    GLStateCache& state = GLStateCache::instance();
+    for (int i = 0; i < 3; i++) {
+        state.bindTexture(GL_TEXTURE_2D, textureIDs[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+
+    const char* const types[3] = { "texture_diffuse", "texture_specular", "texture_normal" };
+    std::vector<Mesh> meshes;
+    meshes.reserve(meshCount);
+    for (unsigned int m = 0; m < meshCount; m++) {
+        std::vector<Vertex> vertices(4);
+        for (int v = 0; v < 4; v++) {
+            vertices[v].Position = glm::vec3((float)(v & 1), (float)(v >> 1), 0.0f);
+            vertices[v].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+            vertices[v].TexCoords = glm::vec2((float)(v & 1), (float)(v >> 1));
+        }
+        std::vector<unsigned int> indices = { 0, 1, 2, 2, 1, 3 };
+        std::vector<Texture> textures(3);
+        for (int t = 0; t < 3; t++) {
+            textures[t].id = textureIDs[t];
+            textures[t].type = types[t];
+        }
+        meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures)));
+    }
+
+    shader.use();
+    const MeshUniforms& uniforms = MeshUniforms::of(shader.ID);
+    double bindByNameMs = 0.0, bindCompiledMs = 0.0, drawMs = 0.0;
+    GLStateStats drawState = GLStateStats();
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int m = 0; m < meshCount; m++) {
+            glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3((float)(m % 32), (float)(m / 32), 0.0f));
+            shader.setMat4("model", modelMatrix);
+            bindMaterialByName(shader, meshes[m].textures);
+        }
+        bindByNameMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glFinish();
+        state.invalidate(); // the textures were bound behind the cache's back
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int m = 0; m < meshCount; m++) {
+            glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3((float)(m % 32), (float)(m / 32), 0.0f));
+            glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &modelMatrix[0][0]);
+            meshes[m].material.bind(shader);
+        }
+        bindCompiledMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glFinish();
+
+        state.beginFrame();
+        start = std::chrono::steady_clock::now();
+        for (unsigned int m = 0; m < meshCount; m++) {
+            glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3((float)(m % 32), (float)(m / 32), 0.0f));
+            glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &modelMatrix[0][0]);
+            meshes[m].Draw(shader);
+        }
+        drawState = state.frameStats();
+        drawMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glFinish();
+    }
+
+    meshes.clear();
+    glDeleteTextures(3, textureIDs);
+
+    std::cout << "\n-- material benchmark: " << meshCount << " meshes, 3 textures each, " << frames << " frames, CPU ms/frame --" << std::endl;
+    std::cout << "bind by name        " << bindByNameMs / frames << std::endl;
+    std::cout << "compiled material   " << bindCompiledMs / frames << "   speedup " << bindByNameMs / std::max(bindCompiledMs, 1e-9) << std::endl;
+    std::cout << "full Mesh::Draw     " << drawMs / frames << "   GL state changes " << drawState.issued << " issued, " << drawState.elided
+              << " elided per frame" << std::endl;
+    return 0;
+}
+
+// submits `count` random packets (8 programs, 64 textures, 16 VAOs, random depths, one in ten transparent) to a
+// RenderQueue and times the submission, the radix sort and the execution over `frames` frames. The sorted order is checked
+// against std::sort of the same keys. Returns false on a mismatch.
+bool timeRenderQueue(RenderQueue& queue, unsigned int count, int frames, const unsigned int* programs, const unsigned int* textures,
+                     const unsigned int* vaos, double& submitMs, double& sortMs, double& stdSortMs, double& executeMs)
+{
+    submitMs = sortMs = stdSortMs = executeMs = 0.0;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<uint64_t> keys(count);
+    uint32_t seed = 12345;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        queue.clear();
+        for (unsigned int i = 0; i < count; i++) {
+            DrawPacket packet;
+            packet.pass = random() % 10 == 0 ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+            packet.program = programs[random() % 8];
+            packet.texture = textures[random() % 64];
+            packet.vao = vaos[random() % 16];
+            packet.count = 3;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3((random() % 200) * 0.1f - 10.0f, 0.0f, -(random() % 1000) * 0.1f));
+            float depth = RenderQueue::viewDepth(view, model);
+            queue.submit(packet, model, depth);
+            keys[i] = RenderQueue::makeKey(packet.pass, packet.program, packet.texture, packet.vao, depth);
+        }
+        submitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        queue.sort();
+        sortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        std::sort(keys.begin(), keys.end());
+        stdSortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (unsigned int i = 0; i < count; i++) {
+            if (queue.sortedKey(i) != keys[i]) {
+                std::cout << "ERROR::BENCHMARK::RENDER QUEUE ORDER DIFFERS FROM STD::SORT at " << i << " of " << count << std::endl;
+                return false;
+            }
+        }
+
+        glFinish();
+        start = std::chrono::steady_clock::now();
+        queue.execute(view);
+        executeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glFinish(); // the GPU work isn't part of the submit cost
+    }
+
+    submitMs /= frames;
+    sortMs /= frames;
+    stdSortMs /= frames;
+    executeMs /= frames;
+    return true;
+}
+
+// RenderQueue cost per frame at 1k, 10k and 100k (or up to `maxPackets`) packets. The time per packet of each step should
+// stay about the same as the count grows.
+int runRenderQueueBenchmark(unsigned int maxPackets, int frames)
+{
+    // 8 programs from the same source, 64 1x1 textures and 16 VAOs without attributes (each draw is an empty triangle)
+    std::vector<std::unique_ptr<Shader>> shaders;
+    unsigned int programs[8], textures[64], vaos[16];
+    for (int i = 0; i < 8; i++) {
+        shaders.emplace_back(new Shader("modelShaders.vts", "modelShaders.fts"));
+        programs[i] = shaders.back()->ID;
+    }
+    glGenTextures(64, textures);
+    const unsigned char texel[4] = { 255, 255, 255, 255 };
+    for (int i = 0; i < 64; i++) {
+        GLStateCache::instance().bindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+    glGenVertexArrays(16, vaos);
+
+    std::vector<unsigned int> counts;
+    for (unsigned int count = 1000; count < maxPackets; count *= 10)
+        counts.push_back(count);
+    counts.push_back(maxPackets);
+
+    RenderQueue queue;
+    queue.reserve(maxPackets);
+    std::vector<std::string> lines;
+    for (unsigned int count : counts) {
+        double submitMs, sortMs, stdSortMs, executeMs;
+        GLStateCache::instance().beginFrame();
+        if (!timeRenderQueue(queue, count, frames, programs, textures, vaos, submitMs, sortMs, stdSortMs, executeMs))
+            return -1;
+
+        double perPacket = 1e6 / count; // ms -> ns per packet
+        lines.push_back(std::to_string(count) + " packets   submit " + std::to_string(submitMs) + " ms (" + std::to_string(submitMs * perPacket)
+            + " ns/packet)   radix sort " + std::to_string(sortMs) + " ms (" + std::to_string(sortMs * perPacket) + " ns/packet, std::sort "
+            + std::to_string(stdSortMs * perPacket) + ")   execute " + std::to_string(executeMs) + " ms (" + std::to_string(executeMs * perPacket) + " ns/packet)");
+    }
+
+    for (int i = 0; i < 16; i++)
+        GLStateCache::instance().forgetVertexArray(vaos[i]);
+    glDeleteVertexArrays(16, vaos);
+    for (int i = 0; i < 64; i++)
+        GLStateCache::instance().forgetTexture(textures[i]);
+    glDeleteTextures(64, textures);
+
+    std::cout << "\n-- render queue benchmark: " << frames << " frames each, CPU time per frame --" << std::endl;
+    for (unsigned int i = 0; i < lines.size(); i++)
+        std::cout << lines[i] << std::endl;
+    return 0;
+}
+
+// the model matrix of instance i of the instancing benchmark, a grid of cubes spinning at different speeds
+glm::mat4 instanceMatrix(unsigned int i, float time)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 100) * 2.0f - 100.0f, (float)(i / 100 % 100) * 2.0f - 100.0f, -(float)(i / 10000) * 2.0f - 5.0f));
+    return glm::rotate(model, time * (1.0f + (i % 7) * 0.1f), glm::vec3(1.0f, 0.3f, 0.5f));
+}
+
+// CPU time per frame of drawing `count` cubes three ways: a uniform upload and draw per cube, one instanced draw of
+// instances uploaded once, and one instanced draw after rewriting and uploading every instance
+void timeInstancing(unsigned int count, int frames, GLuint vao, GLuint instancedVao, const Shader& perDraw, const Shader& instanced,
+                    InstanceBuffer& instances, double& perDrawMs, double& staticMs, double& dynamicMs)
+{
+    GLStateCache& state = GLStateCache::instance();
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // one draw per cube, like the scenes did
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    state.useProgram(perDraw.ID);
+    state.bindVertexArray(vao);
+    const MeshUniforms& uniforms = MeshUniforms::of(perDraw.ID);
+    for (int frame = 0; frame < frames; frame++) {
+        for (unsigned int i = 0; i < count; i++) {
+            glm::mat4 model = instanceMatrix(i, (float)frame);
+            glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * model)));
+            glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &model[0][0]);
+            glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, &normalMatrix[0][0]);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+    }
+    perDrawMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    glFinish();
+
+    // instances that don't move: uploaded on the first draw, every frame after is one call
+    instances.clear();
+    instances.reserve(count);
+    for (unsigned int i = 0; i < count; i++)
+        instances.add(instanceMatrix(i, 0.0f));
+    state.useProgram(instanced.ID);
+    state.bindVertexArray(instancedVao);
+    instances.upload();
+    glFinish();
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+        instances.drawArrays(GL_TRIANGLES, 0, 36);
+    staticMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    glFinish();
+
+    // instances that all move: every matrix rewritten and uploaded each frame
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (unsigned int i = 0; i < count; i++)
+            instances.set(i, instanceMatrix(i, (float)frame));
+        instances.drawArrays(GL_TRIANGLES, 0, 36);
+    }
+    dynamicMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    glFinish();
+}
+
+// a unit cube with normals and texture coordinates, positions / normals / uvs interleaved like a Mesh, 36 vertices
+std::vector<float> cubeVertices()
+{
+    std::vector<float> cube;
+    const float faces[6][3] = { { 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 } };
+    const float corners[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { 1, 1 }, { -1, 1 }, { -1, -1 } };
+    for (int f = 0; f < 6; f++) {
+        glm::vec3 n(faces[f][0], faces[f][1], faces[f][2]);
+        glm::vec3 u = std::fabs(n.x) > 0.5f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+        glm::vec3 v = glm::cross(n, u);
+        for (int c = 0; c < 6; c++) {
+            glm::vec3 p = 0.5f * (n + corners[c][0] * u + corners[c][1] * v);
+            float vertex[8] = { p.x, p.y, p.z, n.x, n.y, n.z, corners[c][0] * 0.5f + 0.5f, corners[c][1] * 0.5f + 0.5f };
+            cube.insert(cube.end(), vertex, vertex + 8);
+        }
+    }
+    return cube;
+}
+
+// per draw uniforms against instancing at 1k, 10k and 100k (or up to `maxInstances`) cubes
+int runInstancingBenchmark(unsigned int maxInstances, int frames)
+{
+    std::vector<float> cube = cubeVertices();
+    GLuint vbo, vaos[2];
+    glGenBuffers(1, &vbo);
+    glGenVertexArrays(2, vaos);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+    for (int i = 0; i < 2; i++) {
+        glBindVertexArray(vaos[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    }
+    InstanceBuffer instances(INSTANCE_NORMAL_MATRIX);
+    instances.attach(vaos[1]);
+    GLStateCache::instance().invalidate();
+
+    Shader perDraw("modelShaders.vts", "modelShaders.fts");
+    Shader instanced("modelShadersInstanced.vts", "modelShaders.fts");
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    CameraUniforms& cameraUniforms = CameraUniforms::instance();
+    cameraUniforms.attach(perDraw.ID);
+    cameraUniforms.attach(instanced.ID);
+    cameraUniforms.update(view, projection, glm::vec3(0.0f, 0.0f, 10.0f), 0.0f);
+
+    std::vector<unsigned int> counts;
+    for (unsigned int count = 1000; count < maxInstances; count *= 10)
+        counts.push_back(count);
+    counts.push_back(maxInstances);
+
+    std::vector<std::string> lines;
+    for (unsigned int count : counts) {
+        double perDrawMs, staticMs, dynamicMs;
+        timeInstancing(count, frames, vaos[0], vaos[1], perDraw, instanced, instances, perDrawMs, staticMs, dynamicMs);
+        double perInstance = 1e6 / count; // ms -> ns per instance
+        lines.push_back(std::to_string(count) + " cubes   draw per cube " + std::to_string(perDrawMs) + " ms (" + std::to_string(perDrawMs * perInstance)
+            + " ns/cube, " + std::to_string(count) + " draws)   instanced static " + std::to_string(staticMs) + " ms (1 draw)   instanced dynamic "
+            + std::to_string(dynamicMs) + " ms (" + std::to_string(dynamicMs * perInstance) + " ns/cube, 1 draw)");
+    }
+
+    for (int i = 0; i < 2; i++)
+        GLStateCache::instance().forgetVertexArray(vaos[i]);
+    glDeleteVertexArrays(2, vaos);
+    glDeleteBuffers(1, &vbo);
+    cameraUniforms.shutdown();
+
+    std::cout << "\n-- instancing benchmark: " << frames << " frames each, CPU time per frame --" << std::endl;
+    for (unsigned int i = 0; i < lines.size(); i++)
+        std::cout << lines[i] << std::endl;
+    return 0;
+}
+
+// CPU submit time of `meshCount` small meshes sharing `materialCount` texture sets, drawn one by one with Mesh::Draw and
+// with the IndirectRenderer. Without GL 4.3 / GL_ARB_shader_draw_parameters only the command building is timed.
+int runIndirectBenchmark(unsigned int meshCount, unsigned int materialCount, int frames)
+{
+    Shader shader("modelShaders.vts", "modelShaders.fts");
+    bool indirect = IndirectRenderer::supported();
+    std::unique_ptr<Shader> indirectShader;
+    if (indirect)
+        indirectShader.reset(new Shader("modelShadersIndirect.vts", "modelShaders.fts"));
+
+    // 1x1 textures, two per material
+    std::vector<unsigned int> textureIDs(materialCount * 2);
+    glGenTextures((GLsizei)textureIDs.size(), textureIDs.data());
+    const unsigned char texel[4] = { 255, 255, 255, 255 };
+    GLStateCache& state = GLStateCache::instance();
+    for (unsigned int i = 0; i < textureIDs.size(); i++) {
+        state.bindTexture(GL_TEXTURE_2D, textureIDs[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+
+    std::vector<Mesh> meshes;
+    meshes.reserve(meshCount);
+    for (unsigned int m = 0; m < meshCount; m++) {
+        std::vector<Vertex> vertices(4);
+        for (int v = 0; v < 4; v++) {
+            vertices[v].Position = glm::vec3((float)(v & 1), (float)(v >> 1), 0.0f);
+            vertices[v].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+            vertices[v].TexCoords = glm::vec2((float)(v & 1), (float)(v >> 1));
+        }
+        std::vector<unsigned int> indices = { 0, 1, 2, 2, 1, 3 };
+        unsigned int material = (m * 7) % materialCount;   // materials interleaved, so the loop can't rely on neighbours sharing
+        std::vector<Texture> textures(2);
+        textures[0].id = textureIDs[material * 2];
+        textures[0].type = "texture_diffuse";
+        textures[1].id = textureIDs[material * 2 + 1];
+        textures[1].type = "texture_specular";
+        meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures)));
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(16.0f, 16.0f, 40.0f), glm::vec3(16.0f, 16.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<glm::mat4> matrices(meshCount);
+    for (unsigned int m = 0; m < meshCount; m++)
+        matrices[m] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(m % 32), (float)(m / 32 % 32), -(float)(m / 1024)));
+
+    GeometryHeap& heap = GeometryHeap::instance();
+    IndirectRenderer& renderer = IndirectRenderer::instance();
+    const MeshUniforms& uniforms = MeshUniforms::of(shader.ID);
+    double loopMs = 0.0, prepareMs = 0.0, submitMs = 0.0;
+    unsigned int loopDraws = 0, indirectDraws = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        // the current path: matrices as uniforms, a draw per mesh
+        heap.beginFrame();
+        auto start = std::chrono::steady_clock::now();
+        state.useProgram(shader.ID);
+        for (unsigned int m = 0; m < meshCount; m++) {
+            glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * matrices[m])));
+            glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &matrices[m][0][0]);
+            glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, &normalMatrix[0][0]);
+            meshes[m].Draw(shader);
+        }
+        loopMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        loopDraws = heap.stats().drawCalls;
+        glFinish();
+
+        // the indirect path: build the command list, then upload it and draw a batch per material
+        heap.beginFrame();
+        start = std::chrono::steady_clock::now();
+        renderer.clear();
+        for (unsigned int m = 0; m < meshCount; m++)
+            renderer.add(meshes[m], matrices[m], view);
+        renderer.prepare();
+        auto prepared = std::chrono::steady_clock::now();
+        if (indirect)
+            renderer.submit(*indirectShader);
+        prepareMs += std::chrono::duration<double, std::milli>(prepared - start).count();
+        submitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepared).count();
+        indirectDraws = heap.stats().drawCalls;
+        glFinish();
+    }
+
+    // every mesh has to be in exactly one batch, and a batch must not mix materials
+    IndirectDrawStats stats = renderer.lastStats();
+    bool valid = stats.draws == meshCount && stats.batches == std::min(meshCount, materialCount);
+    renderer.clear();
+    meshes.clear();
+    for (unsigned int i = 0; i < textureIDs.size(); i++)
+        state.forgetTexture(textureIDs[i]);
+    glDeleteTextures((GLsizei)textureIDs.size(), textureIDs.data());
+    if (!valid) {
+        std::cout << "ERROR::BENCHMARK::INDIRECT BATCHES " << stats.batches << " FOR " << stats.draws << " DRAWS, EXPECTED "
+                  << std::min(meshCount, materialCount) << " FOR " << meshCount << std::endl;
+        return -1;
+    }
+
+    std::cout << "\n-- indirect benchmark: " << meshCount << " meshes, " << materialCount << " materials, " << frames
+              << " frames, CPU ms/frame --" << std::endl;
+    std::cout << "Mesh::Draw loop        " << loopMs / frames << "   " << loopDraws << " draw calls" << std::endl;
+    std::cout << "indirect, build list   " << prepareMs / frames << "   " << stats.batches << " batches" << std::endl;
+    if (indirect)
+        std::cout << "indirect, submit       " << submitMs / frames << "   " << indirectDraws << " draw calls   speedup "
+                  << loopMs / std::max(prepareMs + submitMs, 1e-9) << std::endl;
+    else
+        std::cout << "indirect, submit       not supported by this context (needs GL 4.3 and GL_ARB_shader_draw_parameters)" << std::endl;
+    return 0;
+}
+
+// CPU time per frame of rewriting `count` instances (model and normal matrix) every frame and drawing them with one
+// instanced draw: uploaded by the InstanceBuffer into its own orphaned buffer, and by the InstanceBuffer into the
+// RingBuffer with 3, 2 and 1 frames in flight, along with how often the ring had to wait for the GPU
+int runRingBenchmark(unsigned int count, int frames)
+{
+    std::vector<float> cube = cubeVertices();
+    GLuint vbo, vao;
+    glGenBuffers(1, &vbo);
+    glGenVertexArrays(1, &vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    InstanceBuffer instances(INSTANCE_NORMAL_MATRIX);
+    instances.attach(vao);
+    GLStateCache& state = GLStateCache::instance();
+    state.invalidate();
+
+    Shader instanced("modelShadersInstanced.vts", "modelShaders.fts");
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    CameraUniforms::instance().attach(instanced.ID);
+    CameraUniforms::instance().update(view, projection, glm::vec3(0.0f, 0.0f, 10.0f), 0.0f);
+    state.useProgram(instanced.ID);
+
+    const size_t instanceBytes = sizeof(glm::mat4) + sizeof(glm::mat3);
+    RingBuffer& ring = RingBuffer::instance();
+    ring.init(count * instanceBytes);
+
+    std::vector<std::string> lines;
+    instances.clear();
+    instances.reserve(count);
+    for (unsigned int i = 0; i < count; i++)
+        instances.add(instanceMatrix(i, 0.0f));
+    state.bindVertexArray(vao);
+
+    // no ring frame open: the matrices go from the CPU copy to fresh buffer storage with glBufferSubData
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (unsigned int i = 0; i < count; i++)
+            instances.set(i, instanceMatrix(i, (float)frame));
+        instances.drawArrays(GL_TRIANGLES, 0, 36);
+    }
+    double orphanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    glFinish();
+    lines.push_back("orphaned InstanceBuffer                        " + std::to_string(orphanMs) + " ms");
+
+    for (unsigned int inFlight = 3; inFlight >= 1; inFlight--) {
+        ring.setFramesInFlight(inFlight);
+        ring.resetStats();
+        glFinish();
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            ring.beginFrame();
+            for (unsigned int i = 0; i < count; i++)
+                instances.set(i, instanceMatrix(i, (float)frame));
+            instances.drawArrays(GL_TRIANGLES, 0, 36);
+            ring.endFrame();
+        }
+        double ringMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+        glFinish();
+
+        const RingBufferStats& stats = ring.stats();
+        lines.push_back("InstanceBuffer through the ring, " + std::to_string(inFlight) + " frame(s) in flight   " + std::to_string(ringMs) + " ms   "
+            + std::to_string(stats.fenceWaits) + " fence waits (" + std::to_string(stats.waitMs / frames) + " ms/frame waiting)");
+    }
+    bool persistent = ring.persistent();
+
+    // the instances leave the ring before it goes away
+    instances.upload();
+    ring.shutdown();
+    instances.shutdown();
+    state.forgetVertexArray(vao);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    CameraUniforms::instance().shutdown();
+
+    std::cout << "\n-- ring buffer benchmark: " << count << " instances rewritten every frame, " << frames << " frames, CPU ms/frame, ring "
+              << (persistent ? "persistently mapped" : "staged (no GL 4.4, copied with glBufferSubData)") << " --" << std::endl;
+    for (unsigned int i = 0; i < lines.size(); i++)
+        std::cout << lines[i] << std::endl;
+    return 0;
+}
+
+// the load benchmark the executable runs without a mode flag, see the top of the file
+int runLoadBenchmark(const std::string& path, int runs)
+{
+    // warm up the file cache so the first measured run isn't paying for the disk
+    ModelLoadOptions warmup;
+    warmup.useMeshCache = false;
+    timeModelLoad(path, warmup, 1);
+
+    ModelLoadOptions serial;
+    serial.useMeshCache = false;
+    double serialMs = timeModelLoad(path, serial, runs);
+
+    std::vector<std::string> lines;
+    lines.push_back("serial        " + std::to_string(serialMs) + " ms");
+
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; ; threads *= 2) {
+        if (threads > maxThreads)
+            threads = maxThreads;
+
+        ModelLoadOptions parallel;
+        parallel.parallelImport = true;
+        parallel.numThreads = threads;
+        parallel.useMeshCache = false;
+        double ms = timeModelLoad(path, parallel, runs);
+
+        lines.push_back("parallel x" + std::to_string(threads) + "   " + std::to_string(ms) + " ms   speedup " + std::to_string(serialMs / ms));
+
+        if (threads == maxThreads)
+            break;
+    }
+
+    // the loader itself is chatty, so print the table once everything is done
+    std::cout << "\n-- model load benchmark: " << path << " (" << runs << " runs each) --" << std::endl;
+    for (unsigned int i = 0; i < lines.size(); i++)
+        std::cout << lines[i] << std::endl;
+    return 0;
+}
+
+// the command line after the mode flag is taken out: the positional arguments, which each mode reads in its own order,
+// and the options only --import looks at
+struct BenchmarkArgs {
+    std::vector<std::string> positional;
+    std::string syntheticSizes = "100000,1000000";
+    std::string jsonPath = "model_import_benchmark.json";
+    bool parallelImport = false;
+    bool assimpOnly = false;
+
+    std::string text(size_t index, const std::string& fallback) const {
+        return index < positional.size() ? positional[index] : fallback;
+    }
+
+    // the positional argument as a number, `fallback` if it isn't given and never less than `minimum`
+    int number(size_t index, int fallback, int minimum = 1) const {
+        int value = index < positional.size() ? std::atoi(positional[index].c_str()) : fallback;
+        return std::max(value, minimum);
+    }
+};
+
+int loadMode(const BenchmarkArgs& args)
+{
+    return runLoadBenchmark(args.text(0, "Libraries/models/backpack.obj"), args.number(1, 5));
+}
+
+int lodMode(const BenchmarkArgs& args)
+{
+    return runLodBenchmark(args.text(0, "Libraries/models/backpack.obj"), args.number(1, 100));
+}
+
+int asyncMode(const BenchmarkArgs& args)
+{
+    return runAsyncBenchmark(args.text(0, "Libraries/models/backpack.obj"), args.number(1, 8));
+}
+
+int residencyMode(const BenchmarkArgs& args)
+{
+    return runResidencyBenchmark(args.text(0, "Libraries/models/backpack.obj"));
+}
+
+int transformsMode(const BenchmarkArgs& args)
+{
+    return runTransformBenchmark((unsigned int)args.number(0, 50000, 2), args.number(1, 100));
+}
+
+int bcnMode(const BenchmarkArgs& args)
+{
+    return runCompressionBenchmark(args.text(0, "Libraries/models/diffuse.jpg"));
+}
+
+int mipsMode(const BenchmarkArgs& args)
+{
+    return runMipBenchmark(args.text(0, "Libraries/models/diffuse.jpg"), args.number(1, 10));
+}
+
+int importMode(const BenchmarkArgs& args)
+{
+    // [runs] [models...], the backpack if no model is given
+    int importRuns = 10;
+    size_t firstModel = 0;
+    const std::vector<std::string>& positional = args.positional;
+    if (!positional.empty() && positional[0].find_first_not_of("0123456789") == std::string::npos) {
+        importRuns = args.number(0, 10);
+        firstModel = 1;
+    }
+    std::vector<std::string> models(positional.begin() + firstModel, positional.end());
+    if (models.empty())
+        models.push_back("Libraries/models/backpack.obj");
+
+    std::vector<unsigned int> synthetic;
+    const std::string& sizes = args.syntheticSizes;
+    size_t position = 0;
+    while (position < sizes.size()) {
+        size_t comma = sizes.find(',', position);
+        if (comma == std::string::npos)
+            comma = sizes.size();
+        unsigned int triangles = (unsigned int)std::strtoul(sizes.substr(position, comma - position).c_str(), NULL, 10);
+        if (triangles > 0)
+            synthetic.push_back(triangles);
+        position = comma + 1;
+    }
+
+    return runImportBenchmark(models, synthetic, importRuns, args.parallelImport, args.assimpOnly, args.jsonPath);
+}
+
+int allocationsMode(const BenchmarkArgs& args)
+{
+    return runAllocationBenchmark((unsigned int)args.number(0, 8));
+}
+
+int materialsMode(const BenchmarkArgs& args)
+{
+    return runMaterialBenchmark((unsigned int)args.number(0, 1000), args.number(1, 200));
+}
+
+int queueMode(const BenchmarkArgs& args)
+{
+    return runRenderQueueBenchmark((unsigned int)args.number(0, 100000, 1000), args.number(1, 20));
+}
+
+int instancingMode(const BenchmarkArgs& args)
+{
+    return runInstancingBenchmark((unsigned int)args.number(0, 100000, 1000), args.number(1, 20));
+}
+
+int indirectMode(const BenchmarkArgs& args)
+{
+    int result = runIndirectBenchmark((unsigned int)args.number(0, 4096), (unsigned int)args.number(1, 16), args.number(2, 100));
+    IndirectRenderer::instance().shutdown();
+    return result;
+}
+
+int ringMode(const BenchmarkArgs& args)
+{
+    return runRingBenchmark((unsigned int)args.number(0, 10000), args.number(1, 200));
+}
+
+struct BenchmarkMode {
+    const char* flag;       // NULL for the load benchmark, which runs when no flag is given
+    const char* usage;      // the arguments after the flag
+    bool needsContext;      // false for the pure CPU ones, they run without a window
+    int (*run)(const BenchmarkArgs& args);
+};
+
+// every benchmark the executable knows, a new one only needs its run function and a line here
+const BenchmarkMode benchmarkModes[] = {
+    { NULL,             "[path/to/model] [runs]",                  true,  loadMode },
+    { "--lod",          "[path/to/model] [frames]",                true,  lodMode },
+    { "--async",        "[path/to/model] [models]",                true,  asyncMode },
+    { "--residency",    "[path/to/model]",                         true,  residencyMode },
+    { "--transforms",   "[nodes] [frames]",                        false, transformsMode },
+    { "--bcn",          "[path/to/image]",                         false, bcnMode },
+    { "--mips",         "[path/to/image] [runs]",                  false, mipsMode },
+    { "--import",       "[runs] [path/to/model ...] [--synthetic triangles[,triangles...]] [--json report.json] [--parallel] [--assimp]",
+                                                                   true,  importMode },
+    { "--allocations",  "[meshes]",                                true,  allocationsMode },
+    { "--materials",    "[meshes] [frames]",                       true,  materialsMode },
+    { "--queue",        "[packets] [frames]",                      true,  queueMode },
+    { "--instancing",   "[instances] [frames]",                    true,  instancingMode },
+    { "--indirect",     "[meshes] [materials] [frames]",           true,  indirectMode },
+    { "--ring",         "[instances] [frames]",                    true,  ringMode }
+};
+const size_t benchmarkModeCount = sizeof(benchmarkModes) / sizeof(benchmarkModes[0]);
+
+const BenchmarkMode* findBenchmarkMode(const std::string& flag)
+{
+    for (size_t i = 0; i < benchmarkModeCount; i++)
+        if (benchmarkModes[i].flag && flag == benchmarkModes[i].flag)
+            return &benchmarkModes[i];
+    return NULL;
+}
+
+void printBenchmarkUsage()
+{
+    for (size_t i = 0; i < benchmarkModeCount; i++)
+        std::cout << "    ModelBenchmark " << (benchmarkModes[i].flag ? std::string(benchmarkModes[i].flag) + " " : std::string())
+                  << benchmarkModes[i].usage << std::endl;
+}
+
+// the meshes still upload into the geometry heap during the load so most benchmarks need a context, but never show the
+// window. 4.4 for the persistently mapped ring, 4.3 for --indirect, 3.3 if the driver has nothing newer. Returns false
+// (with GLFW terminated) if there is no context.
+bool createBenchmarkContext()
+{
+    glfwInit();
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    const int contextVersions[][2] = { { 4, 4 }, { 4, 3 }, { 3, 3 } };
+    GLFWwindow* window = NULL;
+    for (int i = 0; i < 3 && window == NULL; i++)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+        window = glfwCreateWindow(64, 64, "Model Benchmark", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    // a mode flag anywhere picks the benchmark, the remaining arguments keep their positions
+    const BenchmarkMode* mode = &benchmarkModes[0];
+    BenchmarkArgs args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const BenchmarkMode* flagged = findBenchmarkMode(arg);
+        if (flagged) {
+            if (mode != &benchmarkModes[0] && mode != flagged) {
+                std::cout << "ERROR::MODEL_BENCHMARK::" << mode->flag << " and " << arg << " can't run together, one benchmark at a time:" << std::endl;
+                printBenchmarkUsage();
+                return -1;
+            }
+            mode = flagged;
+        }
+        else if (arg == "--parallel")
+            args.parallelImport = true;
+        else if (arg == "--assimp")
+            args.assimpOnly = true;
+        else if (arg == "--synthetic" && i + 1 < argc)
+            args.syntheticSizes = argv[++i];
+        else if (arg == "--json" && i + 1 < argc)
+            args.jsonPath = argv[++i];
+        else
+            args.positional.push_back(arg);
+    }
+
+    if (!mode->needsContext)
+        return mode->run(args);
+
+    if (!createBenchmarkContext())
+        return -1;
+    int result = mode->run(args);
+    glfwTerminate();
+    return result;
+}
@@ -0,0 +1,178 @@
+#pragma once
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// loads models without blocking the render loop.
+//
+// load() hands back a Model straight away. The model draws nothing (isReady() is false) until it's done: the mesh cache
+// read or assimp import, vertex processing and LOD generation run on a worker thread, and update() creates the GL
+// buffers and loads the textures on the GL thread, one mesh at a time, stopping once its time budget is used up. Call
+// update() once per frame; with a budget the cost per frame stays about the same no matter how many models are queued.
+// combine it with ModelLoadOptions::textureLoader to keep texture decoding off the GL thread as well.
+class ModelLoader {
+public:
+    ModelLoader(unsigned int numThreads = 1) : workers(numThreads) {}
+
+    ~ModelLoader() {
+        shutdown();
+    }
+
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    // queues the model for loading and returns it empty. Must be called on the GL thread.
+    shared_ptr<Model> load(const string& path, ModelLoadOptions options = ModelLoadOptions()) {
+        shared_ptr<Model> model(new Model(path, options, false));
+        if (shuttingDown)
+            return model;
+
+        shared_ptr<Job> job = make_shared<Job>();
+        job->model = model;
+        job->path = path;
+        job->options = options;
+        job->queued = std::chrono::steady_clock::now();
+
+        pending++;
+        workers.enqueue([this, job] { import(job); });
+        return model;
+    }
+
+    // uploads imported meshes until the budget is used up, returns how many models became ready. A budget of 0 means
+    // "finish everything that has been imported". GL thread only.
+    unsigned int update(double budgetMs = 0.0) {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int finished = 0;
+
+        while (true) {
+            if (!current) {
+                std::lock_guard<std::mutex> lock(importedMutex);
+                if (imported.empty())
+                    break;
+                current = imported.front();
+                imported.pop_front();
+            }
+
+            // nobody holds the model anymore, don't bother uploading it
+            if (current->failed || current->model.use_count() == 1) {
+                if (current->failed)
+                    std::cout << "ERROR::MODEL_LOADER::COULD NOT LOAD " << current->path << std::endl;
+                current.reset();
+                pending--;
+                continue;
+            }
+
+            if (current->nextMesh < current->meshes.size()) {
+                auto meshStart = std::chrono::steady_clock::now();
+                current->model->finalizeMesh(current->meshes[current->nextMesh]);
+                current->meshes[current->nextMesh] = ImportedMesh(); // the arrays moved into the Mesh, drop what is left
+                current->nextMesh++;
+                current->uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - meshStart).count();
+            }
+
+            if (current->nextMesh == current->meshes.size()) {
+                current->model->transformGraph = std::move(current->nodes);
+                current->model->applyResidency();
+                current->model->ready = true;
+                double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - current->queued).count();
+
+                ModelLoadTimings& timings = current->model->timings;
+                timings.parseMs = current->timings.parseMs;
+                timings.convertMs = current->timings.convertMs;
+                timings.processMs = current->timings.processMs;
+                timings.fromCache = current->timings.fromCache;
+                timings.totalMs = totalMs;
+                std::cout << "MODEL_LOADER::SUCCESS " << current->path << " ready after " << totalMs << " ms (import " << current->importMs
+                          << " ms on a worker, upload " << current->uploadMs << " ms on the GL thread)" << std::endl;
+                current.reset();
+                pending--;
+                finished++;
+            }
+
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (budgetMs > 0.0 && elapsedMs >= budgetMs)
+                break;
+        }
+
+        return finished;
+    }
+
+    // blocks until every queued model is ready
+    void finish() {
+        while (pending > 0) {
+            if (update() == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    // number of models that have been requested but aren't ready yet
+    unsigned int pendingCount() const {
+        return pending;
+    }
+
+    // drops everything that isn't ready yet, the models stay empty. Safe to call more than once.
+    void shutdown() {
+        shuttingDown = true;
+        workers.waitIdle();
+
+        std::lock_guard<std::mutex> lock(importedMutex);
+        imported.clear();
+        current.reset();
+        pending = 0;
+    }
+
+private:
+    struct Job {
+        shared_ptr<Model> model;
+        string path;
+        ModelLoadOptions options;
+        vector<ImportedMesh> meshes;
+        TransformGraph nodes;
+        size_t nextMesh = 0;
+        bool failed = false;
+        double importMs = 0.0;
+        double uploadMs = 0.0;
+        ModelLoadTimings timings;   // parse/convert/process from the worker, the rest is added by finalizeMesh
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    std::mutex importedMutex;
+    std::deque<shared_ptr<Job>> imported;   // done on the worker, waiting for the GL thread
+    shared_ptr<Job> current;                // the job update() is uploading, can span several frames
+    std::atomic<unsigned int> pending{ 0 };
+    std::atomic<bool> shuttingDown{ false };
+
+    // declared last so the workers are joined before the queue they write into is destroyed
+    ThreadPool workers;
+
+    // runs on a worker thread, no GL calls allowed in here
+    void import(shared_ptr<Job> job) {
+        if (!shuttingDown) {
+            auto start = std::chrono::steady_clock::now();
+            job->failed = !Model::importGeometry(job->path, job->options, job->meshes, job->nodes, &job->timings);
+            job->importMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        else {
+            job->failed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(importedMutex);
+        imported.push_back(job);
+    }
+};
+
+#endif // !MODEL_LOADER_H
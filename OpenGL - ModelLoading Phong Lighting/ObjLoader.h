@@ -0,0 +1,653 @@
+#pragma once
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "TransformGraph.h"
+
+using namespace std;
+
+// one mesh of an OBJ file: every triangle of one object ("o"/"g") that uses one material, with its own indexed vertices
+struct ObjMesh {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;   // type and path (relative to the OBJ's directory) from the MTL file, no ids
+    unsigned int node = 0;      // index into the TransformGraph load() filled in
+};
+
+struct ObjLoadStats {
+    double parseMs = 0.0;       // mapping the file and parsing the chunks
+    double mergeMs = 0.0;       // resolving the face corners into indexed vertices per mesh
+    unsigned int chunks = 0;
+    size_t positions = 0, texCoords = 0, normals = 0, triangles = 0;
+};
+
+// loads Wavefront OBJ/MTL files without going through assimp.
+//
+// the file is memory mapped and cut into line aligned chunks that are parsed on the thread pool, each into arrays of its
+// own (positions, texture coordinates, normals, triangle corners and the o/g/usemtl statements with the triangle they
+// start at). A short serial pass then sorts the triangles into meshes, and every mesh turns its v/vt/vn corners into
+// indexed vertices through a hash table, again one mesh per task. Polygons are fanned into triangles and the v coordinate
+// is flipped, the same result as assimp with aiProcess_Triangulate | aiProcess_FlipUVs.
+//
+// anything that doesn't look like a valid OBJ (an index out of range, no faces at all) makes load() return false so the
+// caller can hand the file to assimp instead.
+class ObjLoader {
+public:
+    static bool canLoad(const string& path) {
+        size_t dot = path.find_last_of('.');
+        if (dot == string::npos)
+            return false;
+        string extension = path.substr(dot + 1);
+        for (unsigned int i = 0; i < extension.size(); i++)
+            extension[i] = (char)tolower((unsigned char)extension[i]);
+        return extension == "obj";
+    }
+
+    // the mtllib files the OBJ names, relative to its directory, in the order they appear. These decide its textures, so
+    // a mesh cache of the file has to be rebuilt when one of them changes.
+    static vector<string> materialLibraries(const string& path) {
+        vector<string> libraries;
+        MappedFile file;
+        if (!file.open(path))
+            return libraries;
+
+        const char* p = (const char*)file.data();
+        const char* end = p + file.size();
+        while (p < end) {
+            const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char* q = skipSpaces(p, lineEnd);
+            if (lineEnd - q > 7 && memcmp(q, "mtllib", 6) == 0 && isSpace(q[6]))
+                libraries.push_back(restOfLine(q + 6, lineEnd));
+            p = lineEnd + 1;
+        }
+        return libraries;
+    }
+
+    // numThreads 0 means one per hardware core, small files are parsed on the calling thread either way
+    static bool load(const string& path, vector<ObjMesh>& meshes, TransformGraph& graph, unsigned int numThreads = 0, ObjLoadStats* stats = NULL) {
+        ObjLoadStats localStats;
+        if (!stats)
+            stats = &localStats;
+        *stats = ObjLoadStats();
+        meshes.clear();
+
+        auto start = std::chrono::steady_clock::now();
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+
+        const char* data = (const char*)file.data();
+        size_t size = file.size();
+
+        // chunk boundaries right after a newline, so every chunk starts at the beginning of a line
+        unsigned int threads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+        size_t chunkCount = size < MIN_PARALLEL_BYTES ? 1 : std::min<size_t>(threads * 4, size / MIN_CHUNK_BYTES + 1);
+        vector<size_t> bounds(1, 0);
+        for (size_t c = 1; c < chunkCount; c++) {
+            size_t position = std::max(bounds.back(), size * c / chunkCount);
+            const void* newline = memchr(data + position, '\n', size - position);
+            if (!newline)
+                break;
+            bounds.push_back((size_t)((const char*)newline - data) + 1);
+        }
+        bounds.push_back(size);
+        chunkCount = bounds.size() - 1;
+
+        vector<Chunk> chunks(chunkCount);
+        // only spin up workers when there is more than one chunk to hand them
+        std::unique_ptr<ThreadPool> pool;
+        if (chunkCount > 1)
+            pool.reset(new ThreadPool(threads));
+
+        auto parseChunk = [&](size_t c) {
+            parse(data + bounds[c], data + bounds[c + 1], chunks[c]);
+        };
+        if (pool)
+            pool->parallelFor(chunkCount, parseChunk);
+        else
+            parseChunk(0);
+
+        // global attribute arrays, chunk by chunk, plus where each chunk's own attributes start in them
+        vector<float> positions, texCoords, normals;
+        vector<string> materialLibraries;
+        for (size_t c = 0; c < chunkCount; c++) {
+            Chunk& chunk = chunks[c];
+            chunk.positionBase = (int32_t)(positions.size() / 3);
+            chunk.texCoordBase = (int32_t)(texCoords.size() / 2);
+            chunk.normalBase = (int32_t)(normals.size() / 3);
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+            vector<float>().swap(chunk.positions);
+            vector<float>().swap(chunk.texCoords);
+            vector<float>().swap(chunk.normals);
+            materialLibraries.insert(materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+            stats->triangles += chunk.corners.size() / 3;
+        }
+        stats->chunks = (unsigned int)chunkCount;
+        stats->positions = positions.size() / 3;
+        stats->texCoords = texCoords.size() / 2;
+        stats->normals = normals.size() / 3;
+        stats->parseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (stats->triangles == 0)
+            return false;
+
+        start = std::chrono::steady_clock::now();
+        string directory = path.substr(0, path.find_last_of('/'));
+        unordered_map<string, vector<Texture>> materials;
+        for (unsigned int i = 0; i < materialLibraries.size(); i++)
+            loadMaterialLibrary(directory + '/' + materialLibraries[i], materials);
+
+        // walk the statements in file order: every (object, material) pair becomes one mesh, in order of first use
+        vector<MeshGroup> groups;
+        unordered_map<string, unsigned int> groupByKey;
+        unordered_map<string, unsigned int> nodeByObject;
+        graph.clear();
+        unsigned int root = graph.addNode(TransformGraph::NO_PARENT, glm::mat4(1.0f), path.substr(path.find_last_of('/') + 1));
+        string object, material;
+        for (size_t c = 0; c < chunkCount; c++) {
+            const Chunk& chunk = chunks[c];
+            uint32_t triangleCount = (uint32_t)(chunk.corners.size() / 3);
+            uint32_t first = 0;
+            for (size_t s = 0; s <= chunk.statements.size(); s++) {
+                uint32_t end = s < chunk.statements.size() ? chunk.statements[s].triangle : triangleCount;
+                if (end > first) {
+                    string key = object + '\n' + material;
+                    unordered_map<string, unsigned int>::iterator it = groupByKey.find(key);
+                    if (it == groupByKey.end()) {
+                        MeshGroup group;
+                        group.material = material;
+                        unordered_map<string, unsigned int>::iterator node = nodeByObject.find(object);
+                        if (node == nodeByObject.end())
+                            node = nodeByObject.insert(std::make_pair(object, graph.addNode((int)root, glm::mat4(1.0f), object))).first;
+                        group.node = node->second;
+                        it = groupByKey.insert(std::make_pair(key, (unsigned int)groups.size())).first;
+                        groups.push_back(group);
+                    }
+                    groups[it->second].segments.push_back(Segment{ (uint32_t)c, first, end });
+                    first = end;
+                }
+                if (s < chunk.statements.size()) {
+                    const Statement& statement = chunk.statements[s];
+                    if (statement.kind == STATEMENT_OBJECT)
+                        object = statement.name;
+                    else
+                        material = statement.name;
+                }
+            }
+        }
+
+        meshes.resize(groups.size());
+        vector<uint8_t> valid(groups.size(), 1);
+        auto mergeGroup = [&](size_t g) {
+            valid[g] = merge(groups[g], chunks, positions, texCoords, normals, meshes[g]) ? 1 : 0;
+            meshes[g].node = groups[g].node;
+            unordered_map<string, vector<Texture>>::const_iterator it = materials.find(groups[g].material);
+            if (it != materials.end())
+                meshes[g].textures = it->second;
+        };
+        if (pool && groups.size() > 1)
+            pool->parallelFor(groups.size(), mergeGroup);
+        else {
+            for (size_t g = 0; g < groups.size(); g++)
+                mergeGroup(g);
+        }
+        stats->mergeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (!valid[g]) {
+                std::cout << "ERROR::OBJ_LOADER::INDEX OUT OF RANGE " << path << std::endl;
+                meshes.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static const size_t MIN_PARALLEL_BYTES = 1 << 20;   // smaller files aren't worth waking the pool for
+    static const size_t MIN_CHUNK_BYTES = 256 << 10;
+
+    // face corner indices as they come out of the parser: >= 0 is an absolute 0 based index, MISSING means the corner
+    // doesn't have that attribute, anything else is a negative (relative) OBJ index, stored as chunk local + RELATIVE
+    static const int32_t MISSING = INT32_MIN;
+    static const int32_t RELATIVE = -(1 << 30);
+
+    enum StatementKind { STATEMENT_OBJECT, STATEMENT_MATERIAL };
+
+    struct Statement {
+        uint32_t triangle;  // the first triangle of the chunk the statement applies to
+        StatementKind kind;
+        string name;
+    };
+
+    struct Corner {
+        int32_t v, vt, vn;
+    };
+
+    struct Chunk {
+        vector<float> positions, texCoords, normals;
+        vector<Corner> corners;     // 3 per triangle
+        vector<Statement> statements;
+        vector<string> materialLibraries;
+        int32_t positionBase = 0, texCoordBase = 0, normalBase = 0;
+    };
+
+    struct Segment {
+        uint32_t chunk, firstTriangle, endTriangle;
+    };
+
+    struct MeshGroup {
+        string material;
+        unsigned int node = 0;
+        vector<Segment> segments;
+    };
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // plain decimal and exponent notation, good to the last bit of a float. Leaves p alone if there is no number.
+    static const char* parseFloat(const char* p, const char* end, float& out) {
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                         1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        const char* start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0;
+        bool any = false;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa != 0)
+                    digits++;
+            }
+            else {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.') {
+            p++;
+            for (; p < end && *p >= '0' && *p <= '9'; p++) {
+                any = true;
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    if (mantissa != 0)
+                        digits++;
+                    exponent--;
+                }
+            }
+        }
+        if (!any) {
+            out = 0.0f;
+            return start;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* e = p + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+')) {
+                negativeExponent = *e == '-';
+                e++;
+            }
+            if (e < end && *e >= '0' && *e <= '9') {
+                int value = 0;
+                for (; e < end && *e >= '0' && *e <= '9'; e++)
+                    value = std::min(value * 10 + (*e - '0'), 1000);
+                exponent += negativeExponent ? -value : value;
+                p = e;
+            }
+        }
+
+        double value = (double)mantissa;
+        while (exponent > 22) {
+            value *= 1e22;
+            exponent -= 22;
+        }
+        while (exponent < -22) {
+            value /= 1e22;
+            exponent += 22;
+        }
+        value = exponent >= 0 ? value * powers[exponent] : value / powers[-exponent];
+        out = (float)(negative ? -value : value);
+        return p;
+    }
+
+    static const char* parseInt(const char* p, const char* end, int64_t& out, bool& ok) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        ok = p < end && *p >= '0' && *p <= '9';
+        int64_t value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            value = std::min<int64_t>(value * 10 + (*p - '0'), INT32_MAX);
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // OBJ index (1 based, or negative from the end of what's been read so far) -> the encoding Corner uses
+    static int32_t encodeIndex(int64_t index, size_t localCount) {
+        if (index > 0)
+            return (int32_t)(index - 1);
+        if (index < 0)
+            return (int32_t)((int64_t)localCount + index) + RELATIVE;
+        return MISSING; // 0 isn't a valid OBJ index, treat it like a missing one
+    }
+
+    // rest of the line without surrounding whitespace
+    static string restOfLine(const char* p, const char* lineEnd) {
+        p = skipSpaces(p, lineEnd);
+        while (lineEnd > p && isSpace(lineEnd[-1]))
+            lineEnd--;
+        return string(p, lineEnd);
+    }
+
+    static void parse(const char* p, const char* end, Chunk& chunk) {
+        // rough guess from the byte count so the big arrays don't reallocate all the time
+        size_t guess = (size_t)(end - p) / 40;
+        chunk.positions.reserve(guess);
+        chunk.corners.reserve(guess);
+
+        Corner polygon[3];
+        while (p < end) {
+            const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char* q = skipSpaces(p, lineEnd);
+
+            if (q + 1 < lineEnd) {
+                if (q[0] == 'v' && isSpace(q[1])) {
+                    float x, y, z;
+                    q = parseFloat(skipSpaces(q + 1, lineEnd), lineEnd, x);
+                    q = parseFloat(skipSpaces(q, lineEnd), lineEnd, y);
+                    parseFloat(skipSpaces(q, lineEnd), lineEnd, z);
+                    chunk.positions.push_back(x);
+                    chunk.positions.push_back(y);
+                    chunk.positions.push_back(z);
+                }
+                else if (q[0] == 'v' && q[1] == 't' && q + 2 < lineEnd && isSpace(q[2])) {
+                    float u, v;
+                    q = parseFloat(skipSpaces(q + 2, lineEnd), lineEnd, u);
+                    parseFloat(skipSpaces(q, lineEnd), lineEnd, v);
+                    chunk.texCoords.push_back(u);
+                    chunk.texCoords.push_back(v);
+                }
+                else if (q[0] == 'v' && q[1] == 'n' && q + 2 < lineEnd && isSpace(q[2])) {
+                    float x, y, z;
+                    q = parseFloat(skipSpaces(q + 2, lineEnd), lineEnd, x);
+                    q = parseFloat(skipSpaces(q, lineEnd), lineEnd, y);
+                    parseFloat(skipSpaces(q, lineEnd), lineEnd, z);
+                    chunk.normals.push_back(x);
+                    chunk.normals.push_back(y);
+                    chunk.normals.push_back(z);
+                }
+                else if (q[0] == 'f' && isSpace(q[1])) {
+                    // fan triangulation: corner 0, previous corner, this corner
+                    int count = 0;
+                    q = skipSpaces(q + 1, lineEnd);
+                    while (q < lineEnd) {
+                        int64_t index;
+                        bool ok;
+                        Corner corner = { MISSING, MISSING, MISSING };
+                        q = parseInt(q, lineEnd, index, ok);
+                        if (!ok)
+                            break;
+                        corner.v = encodeIndex(index, chunk.positions.size() / 3);
+                        if (q < lineEnd && *q == '/') {
+                            q = parseInt(q + 1, lineEnd, index, ok);
+                            if (ok)
+                                corner.vt = encodeIndex(index, chunk.texCoords.size() / 2);
+                            if (q < lineEnd && *q == '/') {
+                                q = parseInt(q + 1, lineEnd, index, ok);
+                                if (ok)
+                                    corner.vn = encodeIndex(index, chunk.normals.size() / 3);
+                            }
+                        }
+                        q = skipSpaces(q, lineEnd);
+
+                        if (count < 2) {
+                            polygon[count] = corner;
+                        }
+                        else {
+                            chunk.corners.push_back(polygon[0]);
+                            chunk.corners.push_back(polygon[1]);
+                            chunk.corners.push_back(corner);
+                            polygon[1] = corner;
+                        }
+                        count++;
+                    }
+                }
+                else if ((q[0] == 'o' || q[0] == 'g') && isSpace(q[1])) {
+                    chunk.statements.push_back(Statement{ (uint32_t)(chunk.corners.size() / 3), STATEMENT_OBJECT, restOfLine(q + 1, lineEnd) });
+                }
+                else if (lineEnd - q > 7 && memcmp(q, "usemtl", 6) == 0 && isSpace(q[6])) {
+                    chunk.statements.push_back(Statement{ (uint32_t)(chunk.corners.size() / 3), STATEMENT_MATERIAL, restOfLine(q + 6, lineEnd) });
+                }
+                else if (lineEnd - q > 7 && memcmp(q, "mtllib", 6) == 0 && isSpace(q[6])) {
+                    chunk.materialLibraries.push_back(restOfLine(q + 6, lineEnd));
+                }
+                // comments, smoothing groups, lines, points... nothing we draw
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    // resolves an encoded corner index against the chunk it came from, -1 if missing, -2 if out of range
+    static int32_t resolve(int32_t index, int32_t base, size_t count) {
+        if (index == MISSING)
+            return -1;
+        int64_t resolved = index >= 0 ? index : (int64_t)base + (index - RELATIVE);
+        return resolved >= 0 && resolved < (int64_t)count ? (int32_t)resolved : -2;
+    }
+
+    static bool merge(const MeshGroup& group, const vector<Chunk>& chunks, const vector<float>& positions, const vector<float>& texCoords,
+                      const vector<float>& normals, ObjMesh& out) {
+        size_t cornerCount = 0;
+        for (const Segment& s : group.segments)
+            cornerCount += (size_t)(s.endTriangle - s.firstTriangle) * 3;
+
+        out.indices.resize(cornerCount);
+        out.vertices.clear();
+        out.vertices.reserve(cornerCount / 4 + 16);
+
+        // open addressing table from a (v, vt, vn) triple to its vertex, grown at half load
+        size_t capacity = 64;
+        while (capacity < cornerCount / 2)
+            capacity *= 2;
+        vector<Corner> keys(capacity);
+        vector<uint32_t> values(capacity, ~0u);
+
+        size_t positionCount = positions.size() / 3, texCoordCount = texCoords.size() / 2, normalCount = normals.size() / 3;
+        size_t n = 0;
+        for (const Segment& s : group.segments) {
+            const Chunk& chunk = chunks[s.chunk];
+            for (size_t i = (size_t)s.firstTriangle * 3; i < (size_t)s.endTriangle * 3; i++) {
+                const Corner& raw = chunk.corners[i];
+                Corner c;
+                c.v = resolve(raw.v, chunk.positionBase, positionCount);
+                c.vt = resolve(raw.vt, chunk.texCoordBase, texCoordCount);
+                c.vn = resolve(raw.vn, chunk.normalBase, normalCount);
+                if (c.v < 0 || c.vt < -1 || c.vn < -1)
+                    return false;
+
+                size_t mask = capacity - 1;
+                size_t slot = hash(c) & mask;
+                while (values[slot] != ~0u && (keys[slot].v != c.v || keys[slot].vt != c.vt || keys[slot].vn != c.vn))
+                    slot = (slot + 1) & mask;
+
+                if (values[slot] == ~0u) {
+                    Vertex vertex;
+                    vertex.Position = glm::vec3(positions[c.v * 3], positions[c.v * 3 + 1], positions[c.v * 3 + 2]);
+                    vertex.Normal = c.vn >= 0 ? glm::vec3(normals[c.vn * 3], normals[c.vn * 3 + 1], normals[c.vn * 3 + 2]) : glm::vec3(0.0f);
+                    vertex.TexCoords = c.vt >= 0 ? glm::vec2(texCoords[c.vt * 2], 1.0f - texCoords[c.vt * 2 + 1]) : glm::vec2(0.0f);
+                    keys[slot] = c;
+                    values[slot] = (uint32_t)out.vertices.size();
+                    out.vertices.push_back(vertex);
+
+                    if (out.vertices.size() * 2 > capacity) {
+                        grow(keys, values, capacity);
+                        capacity = keys.size();
+                        out.indices[n++] = (uint32_t)out.vertices.size() - 1;
+                        continue;
+                    }
+                }
+                out.indices[n++] = values[slot];
+            }
+        }
+        return true;
+    }
+
+    static size_t hash(const Corner& c) {
+        uint64_t h = (uint64_t)(uint32_t)c.v * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t)(uint32_t)c.vt * 0xC2B2AE3D27D4EB4Full;
+        h ^= (uint64_t)(uint32_t)c.vn * 0x165667B19E3779F9ull;
+        h ^= h >> 29;
+        return (size_t)h;
+    }
+
+    static void grow(vector<Corner>& keys, vector<uint32_t>& values, size_t capacity) {
+        vector<Corner> oldKeys;
+        vector<uint32_t> oldValues;
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+
+        size_t newCapacity = capacity * 2, mask = newCapacity - 1;
+        keys.resize(newCapacity);
+        values.assign(newCapacity, ~0u);
+        for (size_t i = 0; i < capacity; i++) {
+            if (oldValues[i] == ~0u)
+                continue;
+            size_t slot = hash(oldKeys[i]) & mask;
+            while (values[slot] != ~0u)
+                slot = (slot + 1) & mask;
+            keys[slot] = oldKeys[i];
+            values[slot] = oldValues[i];
+        }
+    }
+
+    // the texture maps of every material in an MTL file, in the order Model::collectMaterialTextures lists them
+    static void loadMaterialLibrary(const string& path, unordered_map<string, vector<Texture>>& materials) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cout << "WARNING::OBJ_LOADER::COULD NOT OPEN " << path << std::endl;
+            return;
+        }
+
+        const char* p = (const char*)file.data();
+        const char* end = p + file.size();
+        string current;
+        // per material: diffuse, specular, normal (bump), height (ambient), like assimp's texture types
+        unordered_map<string, vector<Texture>> byType[4];
+        vector<string> order;
+
+        while (p < end) {
+            const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char* q = skipSpaces(p, lineEnd);
+            const char* word = q;
+            while (q < lineEnd && !isSpace(*q))
+                q++;
+            string keyword(word, q);
+
+            if (keyword == "newmtl") {
+                current = restOfLine(q, lineEnd);
+                if (materials.find(current) == materials.end()) {
+                    materials[current];
+                    order.push_back(current);
+                }
+            }
+            else if (!current.empty()) {
+                int type = -1;
+                if (keyword == "map_Kd")
+                    type = 0;
+                else if (keyword == "map_Ks")
+                    type = 1;
+                else if (keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump")
+                    type = 2;
+                else if (keyword == "map_Ka")
+                    type = 3;
+
+                if (type >= 0) {
+                    static const char* const typeNames[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+                    Texture texture;
+                    texture.id = 0;
+                    texture.type = typeNames[type];
+                    texture.path = textureFileName(q, lineEnd);
+                    if (!texture.path.empty())
+                        byType[type][current].push_back(texture);
+                }
+            }
+
+            p = lineEnd + 1;
+        }
+
+        for (unsigned int i = 0; i < order.size(); i++) {
+            vector<Texture>& textures = materials[order[i]];
+            for (int type = 0; type < 4; type++) {
+                const vector<Texture>& list = byType[type][order[i]];
+                textures.insert(textures.end(), list.begin(), list.end());
+            }
+        }
+    }
+
+    // the file name of a map_ statement, after options like "-bm 0.5" or "-o 0 0 0"
+    static string textureFileName(const char* p, const char* lineEnd) {
+        p = skipSpaces(p, lineEnd);
+        while (p < lineEnd && *p == '-') {
+            // the option itself, then its arguments: numbers, on/off, or a single channel letter
+            while (p < lineEnd && !isSpace(*p))
+                p++;
+            while (true) {
+                const char* q = skipSpaces(p, lineEnd);
+                const char* tokenEnd = q;
+                while (tokenEnd < lineEnd && !isSpace(*tokenEnd))
+                    tokenEnd++;
+                if (q == tokenEnd)
+                    break;
+                float number;
+                string token(q, tokenEnd);
+                bool argument = parseFloat(q, tokenEnd, number) == tokenEnd || token == "on" || token == "off" || token.size() == 1;
+                if (!argument || tokenEnd == lineEnd)
+                    break;
+                p = tokenEnd;
+            }
+            p = skipSpaces(p, lineEnd);
+        }
+        return restOfLine(p, lineEnd);
+    }
+};
+
+#endif // !OBJ_LOADER_H
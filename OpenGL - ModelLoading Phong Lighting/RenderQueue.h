@@ -0,0 +1,226 @@
+#pragma once
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GLStateCache.h"
+
+using namespace std;
+
+enum RenderPass {
+    RENDER_PASS_OPAQUE,         // depth tested and written, drawn front to back inside each state group
+    RENDER_PASS_TRANSPARENT     // blended without depth writes, drawn back to front after everything opaque
+};
+
+// one draw submitted to a RenderQueue: what to bind and what to draw. The model matrix and the depth go to submit().
+struct DrawPacket {
+    RenderPass pass = RENDER_PASS_OPAQUE;
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int texture = 0;   // the material, bound to unit 0. 0 binds nothing
+    GLenum mode = GL_TRIANGLES;
+    GLint first = 0;            // first vertex, or with indexType the byte offset into the VAO's element buffer
+    GLsizei count = 0;
+    GLenum indexType = 0;       // 0 draws with glDrawArrays, GL_UNSIGNED_SHORT / GL_UNSIGNED_INT with glDrawElementsBaseVertex
+    GLint baseVertex = 0;
+};
+
+// collects the draws of a frame and executes them sorted by a packed 64 bit key instead of in submission order.
+//
+// key layout, most significant bits first:
+//   opaque       pass:2 | program:10 | material:12 | vao:10 | depth:24 | unused:6
+//   transparent  pass:2 | inverted depth:24 | program:10 | material:12 | vao:10 | unused:6
+// so opaque draws are grouped by state (fewest program / texture / VAO changes) and go front to back inside a group, and
+// transparent draws go strictly back to front. GL names wider than their field share a group with others, which only costs
+// some state changes, the packet keeps the real names. depth is the view space distance, only its order matters.
+//
+// sort() is an LSD radix sort over (key, packet index) pairs, 8 bits per pass, skipping the passes where every key has the
+// same byte, so it costs a fixed few passes over the array per frame however many packets there are. execute() binds
+// through the GLStateCache and sets the "model" (and, if the program has one, "normalMatrix") uniform of each draw; every
+// other uniform has to be set on the programs before. Only use it from the thread that owns the GL context.
+class RenderQueue {
+public:
+    // clears the queue for the next frame, keeping its memory
+    void clear() {
+        packets.clear();
+        transforms.clear();
+        entries.clear();
+    }
+
+    void reserve(size_t count) {
+        packets.reserve(count);
+        transforms.reserve(count);
+        entries.reserve(count);
+        scratch.reserve(count);
+    }
+
+    void submit(const DrawPacket& packet, const glm::mat4& model, float depth) {
+        SortEntry entry;
+        entry.key = makeKey(packet.pass, packet.program, packet.texture, packet.vao, depth);
+        entry.index = (uint32_t)packets.size();
+        entries.push_back(entry);
+        packets.push_back(packet);
+        transforms.push_back(model);
+    }
+
+    // the view space distance of the model's origin, what submit() takes as depth
+    static float viewDepth(const glm::mat4& view, const glm::mat4& model) {
+        return -(view * model[3]).z;
+    }
+
+    static uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int material, unsigned int vao, float depth) {
+        uint64_t state = ((uint64_t)(program & 0x3FF) << 22) | ((uint64_t)(material & 0xFFF) << 10) | (uint64_t)(vao & 0x3FF);
+        uint64_t depthBits = quantizeDepth(depth);
+        if (pass == RENDER_PASS_TRANSPARENT)
+            return ((uint64_t)pass << 62) | ((0xFFFFFFull - depthBits) << 38) | (state << 6);
+        return ((uint64_t)pass << 62) | (state << 30) | (depthBits << 6);
+    }
+
+    void sort() {
+        size_t count = entries.size();
+        if (count < 2)
+            return;
+        scratch.resize(count);
+
+        // one read for the histograms of all 8 bytes
+        size_t histograms[8][256];
+        memset(histograms, 0, sizeof(histograms));
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = entries[i].key;
+            for (int b = 0; b < 8; b++)
+                histograms[b][(key >> (b * 8)) & 0xFF]++;
+        }
+
+        SortEntry* source = entries.data();
+        SortEntry* target = scratch.data();
+        for (int b = 0; b < 8; b++) {
+            size_t* histogram = histograms[b];
+            unsigned int shift = b * 8;
+            if (histogram[(source[0].key >> shift) & 0xFF] == count)
+                continue;   // every key has the same byte here, the order doesn't change
+
+            size_t offset = 0;
+            for (int d = 0; d < 256; d++) {
+                size_t n = histogram[d];
+                histogram[d] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++)
+                target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+            std::swap(source, target);
+        }
+
+        if (source != entries.data())
+            entries.swap(scratch);
+    }
+
+    // draws every packet in key order, view is needed for the normal matrix
+    void execute(const glm::mat4& view) {
+        GLStateCache& state = GLStateCache::instance();
+        unsigned int currentProgram = 0;
+        const ProgramLocations* locations = NULL;
+        bool blending = false;
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            const DrawPacket& packet = packets[entries[i].index];
+            const glm::mat4& model = transforms[entries[i].index];
+
+            if ((packet.pass == RENDER_PASS_TRANSPARENT) != blending) {
+                blending = !blending;
+                if (blending) {
+                    state.enable(GL_BLEND);
+                    state.depthMask(GL_FALSE);
+                }
+                else {
+                    state.disable(GL_BLEND);
+                    state.depthMask(GL_TRUE);
+                }
+            }
+
+            state.useProgram(packet.program);
+            if (!locations || packet.program != currentProgram) {
+                locations = &programLocations(packet.program);
+                currentProgram = packet.program;
+            }
+            state.bindVertexArray(packet.vao);
+            if (packet.texture != 0)
+                state.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, packet.texture);
+
+            glUniformMatrix4fv(locations->model, 1, GL_FALSE, &model[0][0]);
+            if (locations->normalMatrix >= 0) {
+                glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(view * model)));
+                glUniformMatrix3fv(locations->normalMatrix, 1, GL_FALSE, &normalMatrix[0][0]);
+            }
+
+            if (packet.indexType != 0)
+                glDrawElementsBaseVertex(packet.mode, packet.count, packet.indexType, (const void*)(uintptr_t)packet.first, packet.baseVertex);
+            else
+                glDrawArrays(packet.mode, packet.first, packet.count);
+        }
+
+        if (blending) {
+            state.disable(GL_BLEND);
+            state.depthMask(GL_TRUE);
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    // the key and packet of the i-th draw in execution order, valid after sort()
+    uint64_t sortedKey(size_t i) const {
+        return entries[i].key;
+    }
+
+    const DrawPacket& sortedPacket(size_t i) const {
+        return packets[entries[i].index];
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;     // into packets / transforms
+    };
+
+    struct ProgramLocations {
+        GLint model;
+        GLint normalMatrix;
+    };
+
+    vector<DrawPacket> packets;
+    vector<glm::mat4> transforms;
+    vector<SortEntry> entries;
+    vector<SortEntry> scratch;
+    unordered_map<unsigned int, ProgramLocations> locationsByProgram;
+
+    // the top 24 bits of a positive float sort the same way the float does
+    static uint64_t quantizeDepth(float depth) {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 8;
+    }
+
+    const ProgramLocations& programLocations(unsigned int program) {
+        unordered_map<unsigned int, ProgramLocations>::iterator it = locationsByProgram.find(program);
+        if (it != locationsByProgram.end())
+            return it->second;
+
+        ProgramLocations& locations = locationsByProgram[program];
+        locations.model = glGetUniformLocation(program, "model");
+        locations.normalMatrix = glGetUniformLocation(program, "normalMatrix");
+        return locations;
+    }
+};
+
+#endif // !RENDER_QUEUE_H
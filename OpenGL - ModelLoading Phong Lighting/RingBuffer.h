@@ -0,0 +1,263 @@
+#pragma once
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+struct RingBufferStats {
+    unsigned long long frames = 0;
+    unsigned int fenceWaits = 0;    // frames that had to wait for the GPU before they could write
+    double waitMs = 0.0;            // spent in those waits
+    size_t peakFrameBytes = 0;      // the most one frame allocated
+    unsigned int overflows = 0;     // allocations that didn't fit into their frame
+};
+
+// one buffer for everything the CPU writes anew each frame (per frame uniforms, instance matrices, draw commands,
+// dynamic vertices), split into a region per frame. A frame allocates from its region and writes straight into it, the
+// regions are reused round robin and a fence set at the end of each frame says when the GPU is done reading one.
+//
+// with GL 4.4 the buffer is immutable storage (glBufferStorage) mapped once, persistent and coherent, so writes go to
+// the GPU visible memory without any glBufferData / glBufferSubData copy in the driver. Without it the frame is staged in
+// CPU memory and flush() copies what was written since the last flush with one glBufferSubData, the rest stays the same.
+//
+// beginFrame() waits until the GPU has finished the frame framesInFlight() frames back, so the CPU can't run more than
+// that many frames ahead of the GPU: 3 (the region count) keeps both busy, fewer trades throughput for latency. The waits
+// are counted in stats(), frames that had to wait mean the GPU is the bottleneck.
+//
+// usage: init() once after the context exists, beginFrame() before the first allocate() of a frame, flush() before the
+// draws that read what was written (a no-op when mapped), endFrame() after the last draw of the frame, and shutdown()
+// before the context goes away. Only use it from the thread that owns the context.
+class RingBuffer {
+public:
+    static const unsigned int MAX_REGIONS = 4;
+
+    static RingBuffer& instance() {
+        static RingBuffer ring;
+        return ring;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // creates the buffer with `regions` regions of at least `frameBytes` each, replacing the one before
+    void init(size_t frameBytes, unsigned int regions = 3) {
+        shutdown();
+        regionCount = regions < 1 ? 1 : (regions > MAX_REGIONS ? MAX_REGIONS : regions);
+        inFlight = regionCount;
+        // whole 256 bytes, the largest offset alignment uniform and storage buffers ask for
+        regionBytes = (frameBytes + 255) / 256 * 256;
+        size_t totalBytes = regionBytes * regionCount;
+
+        glGenBuffers(1, &ringBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+#ifdef GL_VERSION_4_4
+        if (GLAD_GL_VERSION_4_4) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, totalBytes, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalBytes, flags);
+            if (!mapped)
+                std::cout << "ERROR::RING_BUFFER::PERSISTENT MAPPING FAILED" << std::endl;
+        }
+#endif
+        if (!mapped) {
+            // mutable storage can't be reallocated once immutable, start over with a fresh name
+            if (persistentTried()) {
+                glDeleteBuffers(1, &ringBuffer);
+                glGenBuffers(1, &ringBuffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+            }
+            glBufferData(GL_COPY_WRITE_BUFFER, totalBytes, NULL, GL_DYNAMIC_DRAW);
+            staging.assign(totalBytes, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // whether writes go straight to mapped memory, false when they are staged and copied by flush()
+    bool persistent() const {
+        return mapped != NULL;
+    }
+
+    // between beginFrame() and endFrame() of an initialised ring, allocate() only works then
+    bool frameOpen() const {
+        return inFrame;
+    }
+
+    GLuint buffer() const {
+        return ringBuffer;
+    }
+
+    size_t frameCapacity() const {
+        return regionBytes;
+    }
+
+    // the frame being written, or the next one between endFrame() and beginFrame(). Counted from init(), what was
+    // allocated in one frame stays valid until this moves on.
+    unsigned long long currentFrame() const {
+        return frame;
+    }
+
+    // how many frames the CPU may be ahead of the GPU, 1 up to the region count
+    void setFramesInFlight(unsigned int frames) {
+        inFlight = frames < 1 ? 1 : (frames > regionCount ? regionCount : frames);
+    }
+
+    unsigned int framesInFlight() const {
+        return inFlight;
+    }
+
+    // waits for the GPU to finish the frame framesInFlight() back and starts writing into the next region
+    void beginFrame() {
+        if (ringBuffer == 0)
+            return;
+        if (inFrame)
+            endFrame();
+
+        // fences signal in order, so waiting for the newest frame that has to be done covers the older ones too
+        for (unsigned int back = regionCount; back >= inFlight; back--) {
+            if (back > frame)
+                continue;
+            GLsync& fence = fences[(frame - back) % regionCount];
+            if (!fence)
+                continue;
+            if (back == inFlight)
+                waitFor(fence);
+            glDeleteSync(fence);
+            fence = 0;
+        }
+
+        regionStart = (size_t)(frame % regionCount) * regionBytes;
+        cursor = flushed = 0;
+        inFrame = true;
+    }
+
+    // `bytes` of the current frame's region at an offset that is a multiple of `alignment` (a power of two). Returns where
+    // to write them and their offset in buffer(), or NULL if the frame is out of room or not open.
+    void* allocate(size_t bytes, size_t alignment, GLintptr& offset) {
+        if (!inFrame)
+            return NULL;
+        size_t start = (cursor + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > regionBytes) {
+            if (totals.overflows++ == 0)
+                std::cout << "WARNING::RING_BUFFER::FRAME OUT OF ROOM, " << regionBytes << " BYTES PER FRAME" << std::endl;
+            return NULL;
+        }
+        cursor = start + bytes;
+        offset = (GLintptr)(regionStart + start);
+        return (mapped ? mapped : staging.data()) + regionStart + start;
+    }
+
+    // makes everything allocated so far visible to the GPU. Only does something when staged, call it anyway.
+    void flush() {
+        if (mapped || !inFrame || cursor == flushed)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, regionStart + flushed, cursor - flushed, staging.data() + regionStart + flushed);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        flushed = cursor;
+    }
+
+    // fences the frame, its region is reused once the GPU has passed the fence
+    void endFrame() {
+        if (!inFrame)
+            return;
+        flush();
+        fences[frame % regionCount] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (cursor > totals.peakFrameBytes)
+            totals.peakFrameBytes = cursor;
+        totals.frames++;
+        frame++;
+        inFrame = false;
+    }
+
+    const RingBufferStats& stats() const {
+        return totals;
+    }
+
+    void resetStats() {
+        totals = RingBufferStats();
+    }
+
+    void printStats() const {
+        std::cout << "RING_BUFFER::STATS " << (mapped ? "persistent" : "staged") << ", " << inFlight << " of " << regionCount
+                  << " frames in flight, " << totals.fenceWaits << " fence waits (" << totals.waitMs << " ms) in " << totals.frames
+                  << " frames, peak " << totals.peakFrameBytes / 1024 << " of " << regionBytes / 1024 << " KB per frame" << std::endl;
+    }
+
+    // waits for the GPU to let go of every region and deletes the buffer
+    void shutdown() {
+        for (unsigned int i = 0; i < MAX_REGIONS; i++) {
+            if (fences[i]) {
+                glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        }
+        if (ringBuffer != 0) {
+            if (mapped) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &ringBuffer);
+        }
+        ringBuffer = 0;
+        mapped = NULL;
+        staging.clear();
+        staging.shrink_to_fit();
+        inFrame = false;
+        frame = 0;
+    }
+
+private:
+    static const GLuint64 FENCE_TIMEOUT = 1000000000ull;   // 1 s, in ns
+
+    GLuint ringBuffer = 0;
+    unsigned char* mapped = NULL;
+    vector<unsigned char> staging;      // the whole buffer when it isn't mapped
+    unsigned int regionCount = 3;
+    unsigned int inFlight = 3;
+    size_t regionBytes = 0;
+    GLsync fences[MAX_REGIONS] = {};    // of the last frame that wrote each region
+
+    unsigned long long frame = 0;       // the frame being written, counted from init()
+    bool inFrame = false;
+    size_t regionStart = 0;             // of the current frame, in bytes
+    size_t cursor = 0;                  // bytes allocated in the current frame
+    size_t flushed = 0;                 // of those, copied to the buffer already
+    RingBufferStats totals;
+
+    RingBuffer() {}
+
+    static bool persistentTried() {
+#ifdef GL_VERSION_4_4
+        return GLAD_GL_VERSION_4_4 != 0;
+#else
+        return false;
+#endif
+    }
+
+    void waitFor(GLsync fence) {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            return;
+
+        // the GPU is still on that frame, this is the stall the frames in flight are there to avoid
+        totals.fenceWaits++;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        totals.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (result == GL_WAIT_FAILED)
+            std::cout << "ERROR::RING_BUFFER::FENCE WAIT FAILED" << std::endl;
+    }
+};
+
+#endif // !RING_BUFFER_H
@@ -5,6 +5,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLStateCache.h"
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -89,9 +91,10 @@ public:
 
 
 	// helper functions
+	// skipped if the program is already in use, see GLStateCache
 	void use() const
 	{
-		glUseProgram(ID);
+		GLStateCache::instance().useProgram(ID);
 	}
 
 	void setBool(const std::string& name, bool value) const
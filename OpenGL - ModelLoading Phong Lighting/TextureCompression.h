@@ -0,0 +1,668 @@
+#pragma once
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+// block compressed formats the texture cooker can write. Every format works on 4x4 pixel blocks:
+//   BC1 - 8 bytes per block, RGB with two 565 endpoints and 2 bit indices (no alpha)
+//   BC3 - 16 bytes, BC1 colour plus a separate BC4 style alpha block
+//   BC5 - 16 bytes, two BC4 blocks for red and green, meant for tangent space normal maps (z = sqrt(1 - x^2 - y^2))
+//   BC7 - 16 bytes, RGBA with far better quality than BC1/BC3. The encoder only writes mode 6 (one subset, 7777 endpoints
+//         with a p-bit, 4 bit indices), which is valid BC7 and is what the decoder below understands.
+enum TextureFormat {
+    TEXTURE_FORMAT_UNCOMPRESSED,
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC5,
+    TEXTURE_FORMAT_BC7
+};
+
+inline unsigned int textureFormatBlockBytes(TextureFormat format) {
+    return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+inline const char* textureFormatName(TextureFormat format) {
+    switch (format) {
+    case TEXTURE_FORMAT_BC1: return "bc1";
+    case TEXTURE_FORMAT_BC3: return "bc3";
+    case TEXTURE_FORMAT_BC5: return "bc5";
+    case TEXTURE_FORMAT_BC7: return "bc7";
+    default: return "rgba8";
+    }
+}
+
+// bytes of one compressed image, partial blocks at the right/bottom edge take a whole block
+inline size_t compressedImageSize(TextureFormat format, int width, int height) {
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * textureFormatBlockBytes(format);
+}
+
+class BlockCompressor {
+public:
+    // compresses a tightly packed RGBA8 image. The block rows are spread over the pool if one is given.
+    static void compress(TextureFormat format, const uint8_t* rgba, int width, int height, vector<uint8_t>& out, ThreadPool* pool = NULL) {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned int blockBytes = textureFormatBlockBytes(format);
+        out.resize((size_t)blocksX * blocksY * blockBytes);
+
+        auto compressRow = [&](size_t by) {
+            uint8_t block[64];
+            for (int bx = 0; bx < blocksX; bx++) {
+                loadBlock(rgba, width, height, bx, (int)by, block);
+                uint8_t* dst = out.data() + ((size_t)by * blocksX + bx) * blockBytes;
+                compressBlock(format, block, dst);
+            }
+        };
+
+        if (pool)
+            pool->parallelFor((size_t)blocksY, compressRow);
+        else {
+            for (int by = 0; by < blocksY; by++)
+                compressRow((size_t)by);
+        }
+    }
+
+    // the inverse, for PSNR checks and for GPUs that can't sample the format. BC5 decodes to (r, g, 0, 255).
+    static void decompress(TextureFormat format, const uint8_t* data, int width, int height, vector<uint8_t>& rgba) {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned int blockBytes = textureFormatBlockBytes(format);
+        rgba.resize((size_t)width * height * 4);
+
+        uint8_t block[64];
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                decompressBlock(format, data + ((size_t)by * blocksX + bx) * blockBytes, block);
+                for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+                    for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                        memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+                }
+            }
+        }
+    }
+
+    static void compressBlock(TextureFormat format, const uint8_t block[64], uint8_t* out) {
+        switch (format) {
+        case TEXTURE_FORMAT_BC1:
+            encodeColor(block, out);
+            break;
+        case TEXTURE_FORMAT_BC3:
+            encodeChannel(block, 3, out);
+            encodeColor(block, out + 8);
+            break;
+        case TEXTURE_FORMAT_BC5:
+            encodeChannel(block, 0, out);
+            encodeChannel(block, 1, out + 8);
+            break;
+        case TEXTURE_FORMAT_BC7:
+            encodeBC7Mode6(block, out);
+            break;
+        default:
+            break;
+        }
+    }
+
+    static void decompressBlock(TextureFormat format, const uint8_t* data, uint8_t block[64]) {
+        switch (format) {
+        case TEXTURE_FORMAT_BC1:
+            decodeColor(data, block, false);
+            break;
+        case TEXTURE_FORMAT_BC3:
+            decodeColor(data + 8, block, true);
+            decodeChannel(data, block, 3);
+            break;
+        case TEXTURE_FORMAT_BC5:
+            for (int i = 0; i < 16; i++) {
+                block[i * 4 + 2] = 0;
+                block[i * 4 + 3] = 255;
+            }
+            decodeChannel(data, block, 0);
+            decodeChannel(data + 8, block, 1);
+            break;
+        case TEXTURE_FORMAT_BC7:
+            decodeBC7(data, block);
+            break;
+        default:
+            memset(block, 0, 64);
+            break;
+        }
+    }
+
+    // peak signal to noise ratio in dB over the channels the format actually stores (RGB for BC1, RG for BC5, RGBA
+    // otherwise). Identical images give 99.
+    static double psnr(TextureFormat format, const uint8_t* original, const uint8_t* decoded, size_t pixelCount) {
+        int channels = format == TEXTURE_FORMAT_BC1 ? 3 : (format == TEXTURE_FORMAT_BC5 ? 2 : 4);
+        double squaredError = 0.0;
+        for (size_t i = 0; i < pixelCount; i++) {
+            for (int c = 0; c < channels; c++) {
+                double d = (double)original[i * 4 + c] - (double)decoded[i * 4 + c];
+                squaredError += d * d;
+            }
+        }
+        double mse = squaredError / ((double)pixelCount * channels);
+        return mse <= 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+
+private:
+    // copies a 4x4 block out of the image, repeating the last row/column for blocks hanging over the edge
+    static void loadBlock(const uint8_t* rgba, int width, int height, int bx, int by, uint8_t block[64]) {
+        for (int y = 0; y < 4; y++) {
+            int sy = std::min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++) {
+                int sx = std::min(bx * 4 + x, width - 1);
+                memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+            }
+        }
+    }
+
+    // ---- BC1 colour block ---------------------------------------------------------------------------------------------
+
+    static uint16_t packColor565(const float c[3]) {
+        int r = std::min(31, std::max(0, (int)(c[0] * 31.0f / 255.0f + 0.5f)));
+        int g = std::min(63, std::max(0, (int)(c[1] * 63.0f / 255.0f + 0.5f)));
+        int b = std::min(31, std::max(0, (int)(c[2] * 31.0f / 255.0f + 0.5f)));
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void unpackColor565(uint16_t c, int out[3]) {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+    }
+
+    // the four colours of a 4 colour mode block
+    static void colorPalette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+        unpackColor565(c0, palette[0]);
+        unpackColor565(c1, palette[1]);
+        for (int k = 0; k < 3; k++) {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k] + 1) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k] + 1) / 3;
+        }
+    }
+
+    // picks the closest palette entry for every pixel, returns the packed indices and the total squared error
+    static uint32_t colorIndices(const uint8_t block[64], const int palette[4][3], int& error) {
+        uint32_t indices = 0;
+        error = 0;
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+                int e = dr * dr + dg * dg + db * db;
+                if (e < bestError) {
+                    bestError = e;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+            error += bestError;
+        }
+        return indices;
+    }
+
+    // tries a pair of endpoints, keeps them in out if they beat the best error so far. Always 4 colour mode (c0 > c1),
+    // which is also the only mode the colour half of a BC3 block has.
+    static void tryColorEndpoints(const uint8_t block[64], const float e0[3], const float e1[3], uint8_t* out, int& bestError) {
+        uint16_t c0 = packColor565(e0), c1 = packColor565(e1);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        int error;
+        int palette[4][3];
+        colorPalette(c0, c1, palette);
+        if (c0 == c1) {
+            // every pixel gets c0, a 3 colour block would be decoded differently by BC1 and BC3
+            indices = 0;
+            error = 0;
+            for (int i = 0; i < 16; i++) {
+                for (int k = 0; k < 3; k++)
+                    error += (block[i * 4 + k] - palette[0][k]) * (block[i * 4 + k] - palette[0][k]);
+            }
+        }
+        else {
+            indices = colorIndices(block, palette, error);
+        }
+
+        if (error < bestError) {
+            bestError = error;
+            out[0] = (uint8_t)(c0 & 0xFF);
+            out[1] = (uint8_t)(c0 >> 8);
+            out[2] = (uint8_t)(c1 & 0xFF);
+            out[3] = (uint8_t)(c1 >> 8);
+            memcpy(out + 4, &indices, 4);
+        }
+    }
+
+    // principal axis of the block's colours (power iteration on the covariance), falls back to the grey axis for flat blocks
+    template <int N>
+    static void principalAxis(const uint8_t block[64], const float mean[N], float axis[N]) {
+        float cov[N][N] = {};
+        for (int i = 0; i < 16; i++) {
+            float d[N];
+            for (int k = 0; k < N; k++)
+                d[k] = block[i * 4 + k] - mean[k];
+            for (int a = 0; a < N; a++) {
+                for (int b = 0; b < N; b++)
+                    cov[a][b] += d[a] * d[b];
+            }
+        }
+
+        for (int k = 0; k < N; k++)
+            axis[k] = 1.0f;
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[N] = {};
+            for (int a = 0; a < N; a++) {
+                for (int b = 0; b < N; b++)
+                    next[a] += cov[a][b] * axis[b];
+            }
+            float length = 0.0f;
+            for (int k = 0; k < N; k++)
+                length = std::max(length, std::fabs(next[k]));
+            if (length <= 0.0f)
+                return;
+            for (int k = 0; k < N; k++)
+                axis[k] = next[k] / length;
+        }
+    }
+
+    static void encodeColor(const uint8_t block[64], uint8_t* out) {
+        float mean[3] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int k = 0; k < 3; k++)
+                mean[k] += block[i * 4 + k] / 16.0f;
+        }
+        float axis[3];
+        principalAxis<3>(block, mean, axis);
+
+        // endpoints: the extremes along the axis, pulled in a little so the interpolated colours land on the data
+        float minT = 1e30f, maxT = -1e30f;
+        float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int k = 0; k < 3; k++)
+                t += (block[i * 4 + k] - mean[k]) * axis[k];
+            t = axisLength2 > 0.0f ? t / axisLength2 : 0.0f;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float inset = (maxT - minT) / 16.0f;
+        minT += inset;
+        maxT -= inset;
+
+        float e0[3], e1[3];
+        for (int k = 0; k < 3; k++) {
+            e0[k] = mean[k] + axis[k] * maxT;
+            e1[k] = mean[k] + axis[k] * minT;
+        }
+
+        int bestError = 1 << 30;
+        tryColorEndpoints(block, e0, e1, out, bestError);
+
+        // least squares refit of the endpoints to the chosen indices, twice is where it stops paying off
+        for (int iteration = 0; iteration < 2 && bestError > 0; iteration++) {
+            uint32_t indices;
+            memcpy(&indices, out + 4, 4);
+            static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+            float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = {}, bx[3] = {};
+            for (int i = 0; i < 16; i++) {
+                float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+                aa += a * a;
+                bb += b * b;
+                ab += a * b;
+                for (int k = 0; k < 3; k++) {
+                    ax[k] += a * block[i * 4 + k];
+                    bx[k] += b * block[i * 4 + k];
+                }
+            }
+            float det = aa * bb - ab * ab;
+            if (std::fabs(det) < 1e-6f)
+                break;
+            for (int k = 0; k < 3; k++) {
+                e0[k] = std::min(255.0f, std::max(0.0f, (ax[k] * bb - bx[k] * ab) / det));
+                e1[k] = std::min(255.0f, std::max(0.0f, (bx[k] * aa - ax[k] * ab) / det));
+            }
+            tryColorEndpoints(block, e0, e1, out, bestError);
+        }
+    }
+
+    static void decodeColor(const uint8_t* data, uint8_t block[64], bool alwaysFourColors) {
+        uint16_t c0 = (uint16_t)(data[0] | (data[1] << 8)), c1 = (uint16_t)(data[2] | (data[3] << 8));
+        uint32_t indices;
+        memcpy(&indices, data + 4, 4);
+
+        int palette[4][4];
+        unpackColor565(c0, palette[0]);
+        unpackColor565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+        if (c0 > c1 || alwaysFourColors) {
+            for (int k = 0; k < 3; k++) {
+                palette[2][k] = (2 * palette[0][k] + palette[1][k] + 1) / 3;
+                palette[3][k] = (palette[0][k] + 2 * palette[1][k] + 1) / 3;
+            }
+        }
+        else {
+            for (int k = 0; k < 3; k++) {
+                palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+                palette[3][k] = 0;
+            }
+            palette[3][3] = 0;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            const int* c = palette[(indices >> (i * 2)) & 3];
+            for (int k = 0; k < 4; k++)
+                block[i * 4 + k] = (uint8_t)c[k];
+        }
+    }
+
+    // ---- BC4 single channel block (alpha of BC3, both halves of BC5) --------------------------------------------------
+
+    static void channelPalette(int a0, int a1, int palette[8]) {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1) {
+            for (int i = 1; i < 7; i++)
+                palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+        }
+        else {
+            for (int i = 1; i < 5; i++)
+                palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    static void encodeChannel(const uint8_t block[64], int channel, uint8_t* out) {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++) {
+            lo = std::min(lo, (int)block[i * 4 + channel]);
+            hi = std::max(hi, (int)block[i * 4 + channel]);
+        }
+
+        // 8 value mode between the extremes. When the block touches 0 or 255 the 6 value mode (which has exact 0 and
+        // 255 entries) often spends its interpolated values better, so try that one as well.
+        uint64_t best = 0;
+        int bestError = 1 << 30;
+        for (int mode = 0; mode < 2; mode++) {
+            int a0 = hi, a1 = lo;
+            if (mode == 1) {
+                int innerLo = 255, innerHi = 0;
+                for (int i = 0; i < 16; i++) {
+                    int v = block[i * 4 + channel];
+                    if (v != 0 && v != 255) {
+                        innerLo = std::min(innerLo, v);
+                        innerHi = std::max(innerHi, v);
+                    }
+                }
+                if (innerLo > innerHi)
+                    innerLo = innerHi = lo;
+                a0 = innerLo;
+                a1 = innerHi;
+            }
+            if (mode == 0 && a0 == a1)
+                a1 = std::max(0, a0 - 1); // keep a0 > a1 so the block stays in 8 value mode
+
+            int palette[8];
+            channelPalette(a0, a1, palette);
+
+            uint64_t bits = (uint64_t)a0 | ((uint64_t)a1 << 8);
+            int error = 0;
+            for (int i = 0; i < 16; i++) {
+                int v = block[i * 4 + channel];
+                int bestIndex = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 8; p++) {
+                    int d = std::abs(v - palette[p]);
+                    if (d < bestDistance) {
+                        bestDistance = d;
+                        bestIndex = p;
+                    }
+                }
+                bits |= (uint64_t)bestIndex << (16 + i * 3);
+                error += bestDistance * bestDistance;
+            }
+
+            if (error < bestError) {
+                bestError = error;
+                best = bits;
+            }
+        }
+
+        for (int b = 0; b < 8; b++)
+            out[b] = (uint8_t)(best >> (b * 8));
+    }
+
+    static void decodeChannel(const uint8_t* data, uint8_t block[64], int channel) {
+        uint64_t bits = 0;
+        for (int b = 0; b < 8; b++)
+            bits |= (uint64_t)data[b] << (b * 8);
+
+        int palette[8];
+        channelPalette(data[0], data[1], palette);
+        for (int i = 0; i < 16; i++)
+            block[i * 4 + channel] = (uint8_t)palette[(bits >> (16 + i * 3)) & 7];
+    }
+
+    // ---- BC7 mode 6 -----------------------------------------------------------------------------------------------------
+
+    static const int* bc7Weights() {
+        static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        return weights;
+    }
+
+    // closest of the 16 weights for every position 0..64 along the endpoint line
+    static const uint8_t* bc7IndexForWeight() {
+        // built once on first use, function local statics are thread safe so the encoder threads can race on it
+        struct Table {
+            uint8_t index[65];
+            Table() {
+                const int* weights = bc7Weights();
+                for (int t = 0; t <= 64; t++) {
+                    int best = 0;
+                    for (int w = 1; w < 16; w++) {
+                        if (std::abs(weights[w] - t) < std::abs(weights[best] - t))
+                            best = w;
+                    }
+                    index[t] = (uint8_t)best;
+                }
+            }
+        };
+        static const Table table;
+        return table.index;
+    }
+
+    // 7 bit endpoint plus its p-bit -> the 8 bit value the decoder works with
+    static void quantizeBC7Endpoint(const float e[4], int pbit, int quantized[4], int expanded[4]) {
+        for (int k = 0; k < 4; k++) {
+            int q = (int)std::floor((e[k] - pbit) / 2.0f + 0.5f);
+            q = std::min(127, std::max(0, q));
+            quantized[k] = q;
+            expanded[k] = (q << 1) | pbit;
+        }
+    }
+
+    struct BC7Candidate {
+        int q0[4], q1[4];
+        int p0, p1;
+        uint8_t indices[16];
+        int error;
+    };
+
+    static void evaluateBC7(const uint8_t block[64], const float e0[4], const float e1[4], BC7Candidate& best) {
+        const int* weights = bc7Weights();
+        for (int p0 = 0; p0 < 2; p0++) {
+            for (int p1 = 0; p1 < 2; p1++) {
+                BC7Candidate c;
+                int x0[4], x1[4];
+                quantizeBC7Endpoint(e0, p0, c.q0, x0);
+                quantizeBC7Endpoint(e1, p1, c.q1, x1);
+                c.p0 = p0;
+                c.p1 = p1;
+
+                int palette[16][4];
+                for (int w = 0; w < 16; w++) {
+                    for (int k = 0; k < 4; k++)
+                        palette[w][k] = ((64 - weights[w]) * x0[k] + weights[w] * x1[k] + 32) >> 6;
+                }
+
+                // the palette lies on a line, so project each pixel onto it instead of trying all 16 entries
+                int dir[4], dirLength2 = 0;
+                for (int k = 0; k < 4; k++) {
+                    dir[k] = x1[k] - x0[k];
+                    dirLength2 += dir[k] * dir[k];
+                }
+
+                c.error = 0;
+                for (int i = 0; i < 16 && c.error < best.error; i++) {
+                    int index = 0;
+                    if (dirLength2 > 0) {
+                        int t = 0;
+                        for (int k = 0; k < 4; k++)
+                            t += (block[i * 4 + k] - x0[k]) * dir[k];
+                        int t64 = std::min(64, std::max(0, (t * 64 + dirLength2 / 2) / dirLength2));
+                        index = bc7IndexForWeight()[t64];
+                    }
+
+                    int d = 0;
+                    for (int k = 0; k < 4; k++) {
+                        int diff = block[i * 4 + k] - palette[index][k];
+                        d += diff * diff;
+                    }
+                    c.indices[i] = (uint8_t)index;
+                    c.error += d;
+                }
+
+                if (c.error < best.error)
+                    best = c;
+            }
+        }
+    }
+
+    // little endian bit writer/reader for the 128 bit BC7 block
+    static void writeBits(uint8_t* out, int& position, uint32_t value, int count) {
+        for (int b = 0; b < count; b++, position++) {
+            if ((value >> b) & 1)
+                out[position >> 3] |= (uint8_t)(1 << (position & 7));
+        }
+    }
+
+    static uint32_t readBits(const uint8_t* data, int& position, int count) {
+        uint32_t value = 0;
+        for (int b = 0; b < count; b++, position++)
+            value |= (uint32_t)((data[position >> 3] >> (position & 7)) & 1) << b;
+        return value;
+    }
+
+    static void encodeBC7Mode6(const uint8_t block[64], uint8_t* out) {
+        float mean[4] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int k = 0; k < 4; k++)
+                mean[k] += block[i * 4 + k] / 16.0f;
+        }
+        float axis[4];
+        principalAxis<4>(block, mean, axis);
+
+        float minT = 1e30f, maxT = -1e30f;
+        float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int k = 0; k < 4; k++)
+                t += (block[i * 4 + k] - mean[k]) * axis[k];
+            t = axisLength2 > 0.0f ? t / axisLength2 : 0.0f;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        float e0[4], e1[4];
+        for (int k = 0; k < 4; k++) {
+            e0[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * minT));
+            e1[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * maxT));
+        }
+
+        BC7Candidate best;
+        best.error = 1 << 30;
+        evaluateBC7(block, e0, e1, best);
+
+        // least squares refit against the chosen weights
+        for (int iteration = 0; iteration < 2 && best.error > 0; iteration++) {
+            const int* weights = bc7Weights();
+            float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[4] = {}, bx[4] = {};
+            for (int i = 0; i < 16; i++) {
+                float b = weights[best.indices[i]] / 64.0f, a = 1.0f - b;
+                aa += a * a;
+                bb += b * b;
+                ab += a * b;
+                for (int k = 0; k < 4; k++) {
+                    ax[k] += a * block[i * 4 + k];
+                    bx[k] += b * block[i * 4 + k];
+                }
+            }
+            float det = aa * bb - ab * ab;
+            if (std::fabs(det) < 1e-6f)
+                break;
+            for (int k = 0; k < 4; k++) {
+                e0[k] = std::min(255.0f, std::max(0.0f, (ax[k] * bb - bx[k] * ab) / det));
+                e1[k] = std::min(255.0f, std::max(0.0f, (bx[k] * aa - ax[k] * ab) / det));
+            }
+            evaluateBC7(block, e0, e1, best);
+        }
+
+        // the first index is stored with 3 bits, its top bit has to be 0: swap the endpoints if it isn't
+        if (best.indices[0] >= 8) {
+            for (int k = 0; k < 4; k++)
+                std::swap(best.q0[k], best.q1[k]);
+            std::swap(best.p0, best.p1);
+            for (int i = 0; i < 16; i++)
+                best.indices[i] = (uint8_t)(15 - best.indices[i]);
+        }
+
+        memset(out, 0, 16);
+        int position = 0;
+        writeBits(out, position, 1u << 6, 7); // mode 6
+        for (int k = 0; k < 4; k++) {
+            writeBits(out, position, (uint32_t)best.q0[k], 7);
+            writeBits(out, position, (uint32_t)best.q1[k], 7);
+        }
+        writeBits(out, position, (uint32_t)best.p0, 1);
+        writeBits(out, position, (uint32_t)best.p1, 1);
+        for (int i = 0; i < 16; i++)
+            writeBits(out, position, best.indices[i], i == 0 ? 3 : 4);
+    }
+
+    // mode 6 only, blocks in any other mode decode to transparent black
+    static void decodeBC7(const uint8_t* data, uint8_t block[64]) {
+        memset(block, 0, 64);
+        int position = 0;
+        if (readBits(data, position, 7) != (1u << 6))
+            return;
+
+        int x0[4], x1[4];
+        for (int k = 0; k < 4; k++) {
+            x0[k] = (int)readBits(data, position, 7) << 1;
+            x1[k] = (int)readBits(data, position, 7) << 1;
+        }
+        int p0 = (int)readBits(data, position, 1), p1 = (int)readBits(data, position, 1);
+        for (int k = 0; k < 4; k++) {
+            x0[k] |= p0;
+            x1[k] |= p1;
+        }
+
+        const int* weights = bc7Weights();
+        for (int i = 0; i < 16; i++) {
+            int w = weights[readBits(data, position, i == 0 ? 3 : 4)];
+            for (int k = 0; k < 4; k++)
+                block[i * 4 + k] = (uint8_t)(((64 - w) * x0[k] + w * x1[k] + 32) >> 6);
+        }
+    }
+};
+
+#endif // !TEXTURE_COMPRESSION_H
@@ -0,0 +1,423 @@
+#pragma once
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/stb_image.h"
+#include "GLStateCache.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// not part of core 3.3, glad only has them when the extensions were selected
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// how Model picks the format for a material texture
+enum TextureCompressionMode {
+    TEXTURE_COMPRESSION_OFF,            // plain GL_RGB/GL_RGBA uploads as before
+    TEXTURE_COMPRESSION_FAST,           // BC1, BC3 for images with alpha, BC5 for normal maps
+    TEXTURE_COMPRESSION_HIGH_QUALITY    // BC7, BC5 for normal maps. Cooking takes several times longer.
+};
+
+const uint32_t TEXTURE_COOKER_VERSION = 2; // bump when the encoders or the mip filter change, old cooked files get redone
+
+// how a texture file gets turned into a GL texture, see TextureRegistry::acquire()
+struct TextureLoadParams {
+    TextureFormat format = TEXTURE_FORMAT_UNCOMPRESSED;
+    TextureColorSpace colorSpace = TEXTURE_COLOR_SPACE_SRGB;
+    MipFilter mipFilter = MIP_FILTER_KAISER;
+};
+
+struct CompressedTextureLevel {
+    int width, height;
+    size_t offset;      // into CompressedTexture::data
+    size_t size;
+};
+
+// a cooked texture in memory: every mip level, largest first, block compressed back to back
+struct CompressedTexture {
+    TextureFormat format = TEXTURE_FORMAT_UNCOMPRESSED;
+    int width = 0, height = 0;
+    vector<CompressedTextureLevel> levels;
+    vector<uint8_t> data;
+};
+
+// turns images into block compressed textures with a full mip chain and caches them next to the source as KTX 1.1 files
+// ("<image>.<format>.ktx"), which also load in any KTX viewer. The cooked file remembers the content hash of the source
+// image, the cooker version and how the mips were filtered; if any of them changed, loadOrCook() cooks again.
+//
+// images are cooked the way stbi_load hands them out, so with stbi_set_flip_vertically_on_load(true) the cooked file is
+// stored flipped as well. Everything except createTexture()/upload()/isSupported() is GL free and safe on any thread.
+class TextureCooker {
+public:
+    static string cookedPathFor(const string& sourcePath, TextureFormat format) {
+        return sourcePath + "." + textureFormatName(format) + ".ktx";
+    }
+
+    // the format a material texture gets under the given mode. Only reads the image header.
+    static TextureFormat chooseFormat(TextureCompressionMode mode, const string& typeName, const string& path) {
+        if (mode == TEXTURE_COMPRESSION_OFF)
+            return TEXTURE_FORMAT_UNCOMPRESSED;
+        if (typeName == "texture_normal")
+            return TEXTURE_FORMAT_BC5;
+        if (mode == TEXTURE_COMPRESSION_HIGH_QUALITY)
+            return TEXTURE_FORMAT_BC7;
+
+        int width, height, channels;
+        if (stbi_info(path.c_str(), &width, &height, &channels) && (channels == 2 || channels == 4))
+            return TEXTURE_FORMAT_BC3;
+        return TEXTURE_FORMAT_BC1;
+    }
+
+    // normal and height maps hold vectors and distances, not colours, so their mips must not be filtered in linear light
+    static TextureColorSpace chooseColorSpace(const string& typeName) {
+        if (typeName == "texture_normal" || typeName == "texture_height")
+            return TEXTURE_COLOR_SPACE_LINEAR;
+        return TEXTURE_COLOR_SPACE_SRGB;
+    }
+
+    // builds the mip chain of an RGBA8 image and compresses every level, the work is spread over the pool if given
+    static void cook(const uint8_t* rgba, int width, int height, const TextureLoadParams& params, CompressedTexture& out, ThreadPool* pool = NULL) {
+        out.format = params.format;
+        out.width = width;
+        out.height = height;
+        out.levels.clear();
+        out.data.clear();
+
+        MipChain mips;
+        MipGenerator::generate(rgba, width, height, 4, mips, params.colorSpace, params.mipFilter, pool);
+
+        out.data.reserve(compressedImageSize(params.format, width, height) * 4 / 3 + 64);
+        vector<uint8_t> blocks;
+        for (unsigned int i = 0; i < mips.levels.size(); i++) {
+            const MipLevel& level = mips.levels[i];
+            BlockCompressor::compress(params.format, mips.data.data() + level.offset, level.width, level.height, blocks, pool);
+
+            CompressedTextureLevel l;
+            l.width = level.width;
+            l.height = level.height;
+            l.offset = out.data.size();
+            l.size = blocks.size();
+            out.levels.push_back(l);
+            out.data.insert(out.data.end(), blocks.begin(), blocks.end());
+        }
+    }
+
+    // reads a cooked file, false if it's missing, damaged, in another format or was cooked from a different source
+    static bool readKtx(const string& path, uint64_t sourceHash, const TextureLoadParams& params, CompressedTexture& out) {
+        TextureFormat format = params.format;
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(KtxHeader))
+            return false;
+
+        KtxHeader h;
+        memcpy(&h, file.data(), sizeof(h));
+        if (memcmp(h.identifier, ktxIdentifier(), 12) != 0 || h.endianness != 0x04030201)
+            return false;
+        if (h.glInternalFormat != glInternalFormat(format) || h.numberOfFaces != 1 || h.numberOfMipmapLevels == 0)
+            return false;
+        if ((uint64_t)sizeof(KtxHeader) + h.bytesOfKeyValueData > file.size())
+            return false;
+        if (findKeyValue(file.data() + sizeof(KtxHeader), h.bytesOfKeyValueData, sourceKey()) != sourceKeyValue(sourceHash, params))
+            return false;
+
+        out.format = format;
+        out.width = (int)h.pixelWidth;
+        out.height = (int)h.pixelHeight;
+        out.levels.clear();
+        out.data.clear();
+
+        size_t position = sizeof(KtxHeader) + h.bytesOfKeyValueData;
+        int w = out.width, hgt = out.height;
+        for (uint32_t l = 0; l < h.numberOfMipmapLevels; l++) {
+            uint32_t imageSize;
+            if (position + 4 > file.size())
+                return false;
+            memcpy(&imageSize, file.data() + position, 4);
+            position += 4;
+            if (imageSize != compressedImageSize(format, w, hgt) || position + imageSize > file.size())
+                return false;
+
+            CompressedTextureLevel level;
+            level.width = w;
+            level.height = hgt;
+            level.offset = out.data.size();
+            level.size = imageSize;
+            out.levels.push_back(level);
+            out.data.insert(out.data.end(), file.data() + position, file.data() + position + imageSize);
+
+            position += (imageSize + 3) & ~3u;
+            w = std::max(1, w / 2);
+            hgt = std::max(1, hgt / 2);
+        }
+        return true;
+    }
+
+    // writes under a temporary name and renames at the end, like MeshCache, so a crash never leaves half a file behind
+    static bool writeKtx(const string& path, const CompressedTexture& texture, uint64_t sourceHash, const TextureLoadParams& params) {
+        string value = sourceKeyValue(sourceHash, params);
+        string keyValue = string(sourceKey()) + '\0' + value + '\0';
+        uint32_t keyValueSize = (uint32_t)keyValue.size();
+        uint32_t keyValuePadding = (4 - keyValueSize % 4) % 4;
+
+        KtxHeader h;
+        memcpy(h.identifier, ktxIdentifier(), 12);
+        h.endianness = 0x04030201;
+        h.glType = 0;
+        h.glTypeSize = 1;
+        h.glFormat = 0;
+        h.glInternalFormat = glInternalFormat(texture.format);
+        h.glBaseInternalFormat = glBaseInternalFormat(texture.format);
+        h.pixelWidth = (uint32_t)texture.width;
+        h.pixelHeight = (uint32_t)texture.height;
+        h.pixelDepth = 0;
+        h.numberOfArrayElements = 0;
+        h.numberOfFaces = 1;
+        h.numberOfMipmapLevels = (uint32_t)texture.levels.size();
+        h.bytesOfKeyValueData = 4 + keyValueSize + keyValuePadding;
+
+        string tempPath = path + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+
+            static const char zeros[4] = {};
+            out.write((const char*)&h, sizeof(h));
+            out.write((const char*)&keyValueSize, 4);
+            out.write(keyValue.data(), keyValue.size());
+            out.write(zeros, keyValuePadding);
+
+            for (unsigned int l = 0; l < texture.levels.size(); l++) {
+                uint32_t imageSize = (uint32_t)texture.levels[l].size;
+                out.write((const char*)&imageSize, 4);
+                out.write((const char*)texture.data.data() + texture.levels[l].offset, imageSize);
+                out.write(zeros, (4 - imageSize % 4) % 4);
+            }
+
+            if (!out) {
+                out.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        std::remove(path.c_str()); // rename doesn't overwrite on windows
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // reads the cooked file if it's up to date, otherwise decodes the source, cooks it (on numThreads workers, 0 means one
+    // per core, 1 means this thread only) and writes the cooked file for next time. False if the source can't be read.
+    static bool loadOrCook(const string& sourcePath, const TextureLoadParams& params, CompressedTexture& out, unsigned int numThreads = 0) {
+        return loadOrCookWith(sourcePath, params, out, NULL, numThreads);
+    }
+
+    // same, cooking on the given pool (this thread only if NULL), for callers that keep a pool around between textures
+    static bool loadOrCook(const string& sourcePath, const TextureLoadParams& params, CompressedTexture& out, ThreadPool* pool) {
+        return loadOrCookWith(sourcePath, params, out, pool, 1);
+    }
+
+    // whether the GL context can sample the format directly. GL thread only.
+    static bool isSupported(TextureFormat format) {
+        static int s3tc = -1, bptc = -1;
+        if (s3tc < 0) {
+            s3tc = hasExtension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+            bptc = hasExtension("GL_ARB_texture_compression_bptc") ? 1 : 0;
+        }
+
+        switch (format) {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC3:
+            return s3tc == 1;
+        case TEXTURE_FORMAT_BC5:
+            return true; // RGTC is core since 3.0
+        case TEXTURE_FORMAT_BC7:
+            return bptc == 1;
+        default:
+            return true;
+        }
+    }
+
+    // uploads every level into textureID with glCompressedTexImage2D and leaves it bound. If the driver can't sample the
+    // format the levels are decoded on the CPU and uploaded as RGBA8 instead. GL thread only.
+    static void upload(const CompressedTexture& texture, unsigned int textureID) {
+        GLStateCache::instance().bindTexture(GL_TEXTURE_2D, textureID);
+
+        bool native = isSupported(texture.format);
+        vector<uint8_t> decoded;
+        for (unsigned int l = 0; l < texture.levels.size(); l++) {
+            const CompressedTextureLevel& level = texture.levels[l];
+            const uint8_t* blocks = texture.data.data() + level.offset;
+            if (native) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, glInternalFormat(texture.format), level.width, level.height, 0, (GLsizei)level.size, blocks);
+            }
+            else {
+                BlockCompressor::decompress(texture.format, blocks, level.width, level.height, decoded);
+                glTexImage2D(GL_TEXTURE_2D, (GLint)l, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+            }
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    static unsigned int createTexture(const CompressedTexture& texture) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        upload(texture, textureID);
+        return textureID;
+    }
+
+    static GLenum glInternalFormat(TextureFormat format) {
+        switch (format) {
+        case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEXTURE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TEXTURE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TEXTURE_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return GL_RGBA8;
+        }
+    }
+
+private:
+    // a pool of numThreads is only started when there's something to cook and no pool was given
+    static bool loadOrCookWith(const string& sourcePath, const TextureLoadParams& params, CompressedTexture& out, ThreadPool* pool, unsigned int numThreads) {
+        uint64_t sourceHash = hashFileContents(sourcePath);
+        if (sourceHash == 0)
+            return false;
+
+        TextureFormat format = params.format;
+        string cookedPath = cookedPathFor(sourcePath, format);
+        if (readKtx(cookedPath, sourceHash, params, out))
+            return true;
+
+        auto start = std::chrono::steady_clock::now();
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+        if (!pixels)
+            return false;
+
+        if (pool || numThreads == 1) {
+            cook(pixels, width, height, params, out, pool);
+        }
+        else {
+            ThreadPool cookPool(numThreads);
+            cook(pixels, width, height, params, out, &cookPool);
+        }
+        stbi_image_free(pixels);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "TEXTURE_COOKER::SUCCESS " << sourcePath << " -> " << textureFormatName(format) << " " << width << "x" << height
+                  << ", " << out.levels.size() << " levels, " << out.data.size() / 1024 << " KB in " << ms << " ms" << std::endl;
+
+        if (!writeKtx(cookedPath, out, sourceHash, params))
+            std::cout << "WARNING::TEXTURE_COOKER::COULD NOT WRITE " << cookedPath << std::endl;
+        return true;
+    }
+
+    // KTX 1.1 file header, followed by the key/value data and then imageSize + data for every mip level
+    struct KtxHeader {
+        uint8_t identifier[12];
+        uint32_t endianness;
+        uint32_t glType;                // 0 for compressed formats
+        uint32_t glTypeSize;
+        uint32_t glFormat;              // 0 for compressed formats
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    static const char* sourceKey() {
+        return "TextureCooker.source";
+    }
+
+    static const uint8_t* ktxIdentifier() {
+        static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+        return identifier;
+    }
+
+    static GLenum glBaseInternalFormat(TextureFormat format) {
+        switch (format) {
+        case TEXTURE_FORMAT_BC1: return GL_RGB;
+        case TEXTURE_FORMAT_BC5: return GL_RG;
+        default: return GL_RGBA;
+        }
+    }
+
+    // what gets stored under sourceKey(): source content hash, cooker version and the mip filter settings
+    static string sourceKeyValue(uint64_t sourceHash, const TextureLoadParams& params) {
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), "%016llx;v%u;%s;%s", (unsigned long long)sourceHash, TEXTURE_COOKER_VERSION,
+                 params.colorSpace == TEXTURE_COLOR_SPACE_SRGB ? "srgb" : "linear", params.mipFilter == MIP_FILTER_BOX ? "box" : "kaiser");
+        return buffer;
+    }
+
+    static string findKeyValue(const uint8_t* data, size_t size, const string& key) {
+        size_t position = 0;
+        while (position + 4 <= size) {
+            uint32_t length;
+            memcpy(&length, data + position, 4);
+            position += 4;
+            if (length > size - position)
+                break;
+
+            const char* entry = (const char*)data + position;
+            size_t keyLength = strnlen(entry, length);
+            if (keyLength < length && string(entry, keyLength) == key) {
+                // the value is null terminated by convention, don't count the terminator
+                size_t valueLength = length - keyLength - 1;
+                if (valueLength > 0 && entry[keyLength + valueLength] == '\0')
+                    valueLength--;
+                return string(entry + keyLength + 1, valueLength);
+            }
+            position += (length + 3) & ~3u;
+        }
+        return string();
+    }
+
+    static bool hasExtension(const char* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (extension && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif // !TEXTURE_COOKER_H
@@ -0,0 +1,324 @@
+#pragma once
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/stb_image.h"
+#include "AsyncTextureLoader.h"
+#include "GLStateCache.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+struct TextureRegistryStats {
+    unsigned long long hits;        // acquire() calls served by a texture that was already resident
+    unsigned long long misses;      // acquire() calls that had to load the file
+    unsigned int residentTextures;
+    unsigned long long residentBytes; // GPU memory of all resident textures including their mip chains
+    double decodeMs;                // synchronous loads only: stbi_load + mip chain, or reading/cooking the compressed file
+    double uploadMs;                // synchronous loads only: the glTexImage2D calls
+};
+
+// process wide texture cache shared by every Model.
+//
+// textures are looked up by normalized file path first. Synchronous loads are also looked up by a hash of the file
+// contents and the load params, so the same image reached through two different paths (or copied next to two different
+// models) is only uploaded once. Loads through an AsyncTextureLoader go by path alone: hashing the whole image here would
+// read the file on the GL thread before the loader even gets it. Every acquire() takes a reference and must be paired
+// with a release(); the GL texture is deleted when the last reference goes away.
+// only use it from the thread that owns the GL context.
+class TextureRegistry {
+public:
+    static TextureRegistry& instance() {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    // returns the GL texture for the given file, loading it (through the async loader if one is given) on the first use.
+    // params pick a block compressed format the file gets cooked into (see TextureCooker) and how its mips are filtered;
+    // only the first acquire() of a path decides, later ones of the same path share whatever was loaded then.
+    unsigned int acquire(const string& path, AsyncTextureLoader* loader = NULL, const TextureLoadParams& params = TextureLoadParams()) {
+        string key = normalizePath(path);
+
+        // 1. same path as before
+        unordered_map<string, unsigned int>::iterator byPathIt = byPath.find(key);
+        if (byPathIt != byPath.end())
+            return addReference(byPathIt->second);
+
+        // 2. different path, identical file loaded the same way. A hash hit is only shared if the size matches as well, and a
+        //    64 bit collision that gets past that still only costs a second copy, the first texture keeps the content slot
+        uint64_t contentHash = 0;
+        size_t fileSize = 0;
+        if (!loader) {
+            contentHash = contentKey(hashFileContents(key, &fileSize), params);
+            unordered_map<uint64_t, unsigned int>::iterator byContentIt = contentHash != 0 ? byContent.find(contentHash) : byContent.end();
+            if (byContentIt != byContent.end()) {
+                Entry& shared = entries[byContentIt->second];
+                if (shared.fileSize == fileSize && sameParams(shared.params, params)) {
+                    byPath[key] = byContentIt->second;
+                    shared.paths.push_back(key);
+                    return addReference(byContentIt->second);
+                }
+                contentHash = 0;
+            }
+        }
+
+        // 3. not resident yet
+        misses++;
+        TextureLoadToken cancelled = loader ? makeTextureLoadToken() : TextureLoadToken();
+        unsigned int textureID = loader ? loader->load(key, params, cancelled) : loadTexture(key, params);
+
+        Entry& entry = entries[textureID];
+        entry.refCount = 1;
+        entry.cancelled = cancelled;
+        entry.contentHash = contentHash;
+        entry.fileSize = fileSize;
+        entry.params = params;
+        entry.paths.push_back(key);
+
+        byPath[key] = textureID;
+        if (contentHash != 0)
+            byContent[contentHash] = textureID;
+
+        return textureID;
+    }
+
+    // drops one reference, deletes the texture once nobody uses it anymore
+    void release(unsigned int textureID) {
+        unordered_map<unsigned int, Entry>::iterator it = entries.find(textureID);
+        if (it == entries.end())
+            return;
+
+        if (--it->second.refCount > 0)
+            return;
+
+        for (unsigned int i = 0; i < it->second.paths.size(); i++)
+            byPath.erase(it->second.paths[i]);
+        if (it->second.contentHash != 0)
+            byContent.erase(it->second.contentHash);    // only entries that got the content slot keep their hash
+
+        // a decode still in flight must not upload into whatever texture gets this name next
+        if (it->second.cancelled)
+            it->second.cancelled->store(true);
+        glDeleteTextures(1, &textureID);
+        GLStateCache::instance().forgetTexture(textureID);
+        entries.erase(it);
+    }
+
+    unsigned int refCount(unsigned int textureID) const {
+        unordered_map<unsigned int, Entry>::const_iterator it = entries.find(textureID);
+        return it == entries.end() ? 0 : it->second.refCount;
+    }
+
+    // resident bytes are read back from GL so textures still waiting on an async upload count as their placeholder
+    TextureRegistryStats stats() const {
+        TextureRegistryStats s;
+        s.hits = hits;
+        s.misses = misses;
+        s.decodeMs = decodeMs;
+        s.uploadMs = uploadMs;
+        s.residentTextures = (unsigned int)entries.size();
+        s.residentBytes = 0;
+
+        for (unordered_map<unsigned int, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+            s.residentBytes += textureBytes(it->first);
+
+        return s;
+    }
+
+    // just the hit/miss counters and load times, unlike stats() this doesn't ask GL for the texture sizes
+    TextureRegistryStats loadTimes() const {
+        TextureRegistryStats s = TextureRegistryStats();
+        s.hits = hits;
+        s.misses = misses;
+        s.decodeMs = decodeMs;
+        s.uploadMs = uploadMs;
+        return s;
+    }
+
+    void printStats() const {
+        TextureRegistryStats s = stats();
+        std::cout << "TEXTURE_REGISTRY::STATS hits " << s.hits << ", misses " << s.misses << ", resident " << s.residentTextures
+                  << " textures / " << (s.residentBytes / 1024) << " KB" << std::endl;
+    }
+
+    // forward slashes, no "." or "dir/.." segments, and lower case on windows where the file system ignores case
+    static string normalizePath(const string& path) {
+        string p = path;
+        for (unsigned int i = 0; i < p.size(); i++) {
+            if (p[i] == '\\')
+                p[i] = '/';
+#ifdef _WIN32
+            if (p[i] >= 'A' && p[i] <= 'Z')
+                p[i] = p[i] - 'A' + 'a';
+#endif
+        }
+
+        bool absolute = !p.empty() && p[0] == '/';
+        vector<string> parts;
+        size_t start = 0;
+        while (start <= p.size()) {
+            size_t end = p.find('/', start);
+            if (end == string::npos)
+                end = p.size();
+            string part = p.substr(start, end - start);
+            start = end + 1;
+
+            if (part.empty() || part == ".")
+                continue;
+            if (part == ".." && !parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else
+                parts.push_back(part);
+        }
+
+        string result = absolute ? "/" : "";
+        for (unsigned int i = 0; i < parts.size(); i++) {
+            if (i > 0)
+                result += '/';
+            result += parts[i];
+        }
+        return result;
+    }
+
+private:
+    struct Entry {
+        unsigned int refCount = 0;
+        uint64_t contentHash = 0;   // contentKey() of a synchronous load, 0 for async loads and hash collisions
+        size_t fileSize = 0;
+        TextureLoadParams params;
+        vector<string> paths;       // every normalized path that points at this texture
+        TextureLoadToken cancelled; // of the async load that filled it, empty for synchronous loads
+    };
+
+    unordered_map<string, unsigned int> byPath;
+    unordered_map<uint64_t, unsigned int> byContent;
+    unordered_map<unsigned int, Entry> entries;
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    double decodeMs = 0.0;
+    double uploadMs = 0.0;
+    unique_ptr<ThreadPool> pool;    // filters mips and cooks for synchronous loads, started by the first one
+
+    TextureRegistry() {}
+
+    // one pool for every synchronous load, starting threads per texture would cost more than the filtering saves
+    ThreadPool& workers() {
+        if (!pool)
+            pool.reset(new ThreadPool());
+        return *pool;
+    }
+
+    // the file hash mixed with the params, the same file cooked into another format or filtered differently is another
+    // texture. 0 if the file couldn't be read.
+    static uint64_t contentKey(uint64_t fileHash, const TextureLoadParams& params) {
+        if (fileHash == 0)
+            return 0;
+        uint64_t values[3] = { (uint64_t)params.format, (uint64_t)params.colorSpace, (uint64_t)params.mipFilter };
+        uint64_t key = fileHash;
+        for (int i = 0; i < 3; i++) {
+            key ^= values[i];
+            key *= 1099511628211ull;
+        }
+        return key != 0 ? key : 1;
+    }
+
+    static bool sameParams(const TextureLoadParams& a, const TextureLoadParams& b) {
+        return a.format == b.format && a.colorSpace == b.colorSpace && a.mipFilter == b.mipFilter;
+    }
+
+    unsigned int addReference(unsigned int textureID) {
+        hits++;
+        entries[textureID].refCount++;
+        return textureID;
+    }
+
+    // synchronous load, same as Model::TextureFromFile always did but with the mips filtered on the CPU
+    unsigned int loadTexture(const string& filename, const TextureLoadParams& params) {
+        auto start = std::chrono::steady_clock::now();
+        if (params.format != TEXTURE_FORMAT_UNCOMPRESSED) {
+            CompressedTexture compressed;
+            if (TextureCooker::loadOrCook(filename, params, compressed, &workers())) {
+                auto decoded = std::chrono::steady_clock::now();
+                decodeMs += std::chrono::duration<double, std::milli>(decoded - start).count();
+                unsigned int textureID = TextureCooker::createTexture(compressed);
+                uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decoded).count();
+                return textureID;
+            }
+            // unreadable source, the plain path below reports it
+        }
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            MipChain mips;
+            MipGenerator::generate(data, width, height, nrComponents, mips, params.colorSpace, params.mipFilter, &workers());
+            stbi_image_free(data);
+
+            auto decoded = std::chrono::steady_clock::now();
+            decodeMs += std::chrono::duration<double, std::milli>(decoded - start).count();
+            MipGenerator::upload(mips, textureID, mips.data.data());
+            uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decoded).count();
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << filename << std::endl;
+            stbi_image_free(data);
+        }
+
+        return textureID;
+    }
+
+    // sums up the size of every mip level the texture currently has
+    static unsigned long long textureBytes(unsigned int textureID) {
+        GLint previous = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+
+        unsigned long long bytes = 0;
+        for (GLint level = 0; level < 16; level++) {
+            GLint width = 0, height = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0)
+                break;
+
+            GLint compressed = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                bytes += (unsigned long long)size;
+            }
+            else {
+                GLint r = 0, g = 0, b = 0, a = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_RED_SIZE, &r);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_GREEN_SIZE, &g);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_BLUE_SIZE, &b);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_ALPHA_SIZE, &a);
+                bytes += (unsigned long long)width * height * ((r + g + b + a + 7) / 8);
+            }
+        }
+
+        glBindTexture(GL_TEXTURE_2D, (GLuint)previous);
+        return bytes;
+    }
+};
+
+#endif // !TEXTURE_REGISTRY_H
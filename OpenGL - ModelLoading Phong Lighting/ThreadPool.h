@@ -0,0 +1,132 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// a small fixed size pool of worker threads. Jobs are plain std::function<void()> objects pulled from a shared queue.
+// none of the jobs may touch OpenGL: the context is only current on the thread that created the window.
+class ThreadPool {
+public:
+    // constructor, 0 threads means "one per hardware core"
+    ThreadPool(unsigned int numThreads = 0) {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0; i < numThreads; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const {
+        return (unsigned int)workers.size();
+    }
+
+    // queues a single job, returns immediately
+    void enqueue(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.push(std::move(job));
+        }
+        queueCondition.notify_one();
+    }
+
+    // blocks until the queue is empty and no worker is running a job anymore
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        idleCondition.wait(lock, [this] { return jobs.empty() && activeJobs == 0; });
+    }
+
+    // runs fn(i) for every i in [0, count) spread across the workers and blocks until all of them are done.
+    // items are handed out one at a time through an atomic counter so a few huge meshes don't stall a whole chunk.
+    template <typename Fn>
+    void parallelFor(size_t count, Fn fn) {
+        parallelForJobs(count, [&fn](size_t i, unsigned int) { fn(i); });
+    }
+
+    // same, fn(i, job) also gets the number of the job running it, below min(size(), count). Lets every job keep scratch
+    // memory of its own across the items it picks up.
+    template <typename Fn>
+    void parallelForJobs(size_t count, Fn fn) {
+        if (count == 0)
+            return;
+
+        std::atomic<size_t> next(0);
+        std::atomic<unsigned int> running(0);
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+
+        unsigned int numJobs = (unsigned int)std::min<size_t>(workers.size(), count);
+        running = numJobs;
+
+        for (unsigned int j = 0; j < numJobs; j++) {
+            enqueue([&, j] {
+                for (size_t i = next++; i < count; i = next++)
+                    fn(i, j);
+
+                // the last job to finish wakes up the calling thread
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--running == 0)
+                    doneCondition.notify_one();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return running == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable idleCondition;
+    unsigned int activeJobs = 0;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+                if (stopping && jobs.empty())
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop();
+                activeJobs++;
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                activeJobs--;
+                if (jobs.empty() && activeJobs == 0)
+                    idleCondition.notify_all();
+            }
+        }
+    }
+};
+
+#endif // !THREAD_POOL_H
@@ -0,0 +1,141 @@
+#pragma once
+#ifndef TRANSFORM_GRAPH_H
+#define TRANSFORM_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// the node hierarchy of a model (aiNode tree), flattened into arrays.
+//
+// nodes are stored parent before child, so a single front to back pass over the arrays always sees a node's parent world
+// matrix before the node itself. Every property lives in its own array (structure of arrays): the update loop only walks
+// parents, dirty flags and the matrices, the names are never touched after loading.
+//
+// setLocal() only marks the node dirty. update() recomputes world = world(parent) * local for dirty nodes and everything
+// below them, and starts at the first dirty node, so moving one part of a big scene only costs the nodes after it whose
+// ancestors actually changed.
+class TransformGraph {
+public:
+    static const int NO_PARENT = -1;
+
+    // appends a node, parent has to be an existing node (or NO_PARENT for a root). Returns the node index.
+    unsigned int addNode(int parent, const glm::mat4& local, const string& name = string()) {
+        unsigned int index = (unsigned int)parents.size();
+        parents.push_back(parent < (int)index ? parent : (int)NO_PARENT);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(1);
+        changed.push_back(0);
+        names.push_back(name);
+        if (index < firstDirty)
+            firstDirty = index;
+        return index;
+    }
+
+    void clear() {
+        parents.clear();
+        locals.clear();
+        worlds.clear();
+        dirty.clear();
+        changed.clear();
+        names.clear();
+        firstDirty = NONE_DIRTY;
+    }
+
+    void reserve(size_t count) {
+        parents.reserve(count);
+        locals.reserve(count);
+        worlds.reserve(count);
+        dirty.reserve(count);
+        changed.reserve(count);
+        names.reserve(count);
+    }
+
+    unsigned int size() const { return (unsigned int)parents.size(); }
+    bool empty() const { return parents.empty(); }
+
+    int parent(unsigned int node) const { return parents[node]; }
+    const string& name(unsigned int node) const { return names[node]; }
+    const glm::mat4& local(unsigned int node) const { return locals[node]; }
+
+    // the world matrix as of the last update()
+    const glm::mat4& world(unsigned int node) const { return worlds[node]; }
+
+    // first node with the given name, -1 if there is none
+    int find(const string& name) const {
+        for (unsigned int i = 0; i < names.size(); i++) {
+            if (names[i] == name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    void setLocal(unsigned int node, const glm::mat4& local) {
+        locals[node] = local;
+        dirty[node] = 1;
+        if (node < firstDirty)
+            firstDirty = node;
+    }
+
+    bool needsUpdate() const {
+        return firstDirty != NONE_DIRTY;
+    }
+
+    // brings the world matrices up to date, returns how many of them were recomputed
+    unsigned int update() {
+        if (firstDirty == NONE_DIRTY)
+            return 0;
+
+        unsigned int count = (unsigned int)parents.size();
+        unsigned int start = firstDirty;
+        unsigned int recomputed = 0;
+
+        for (unsigned int i = start; i < count; i++) {
+            int p = parents[i];
+            // nodes in front of start weren't touched this time, their changed flags are from an older update
+            bool parentChanged = p >= (int)start && changed[p];
+            if (dirty[i] || parentChanged) {
+                worlds[i] = p == NO_PARENT ? locals[i] : worlds[p] * locals[i];
+                dirty[i] = 0;
+                changed[i] = 1;
+                recomputed++;
+            }
+            else {
+                changed[i] = 0;
+            }
+        }
+
+        firstDirty = NONE_DIRTY;
+        return recomputed;
+    }
+
+    // true if the world matrix of the node is exactly the identity, i.e. drawing its meshes doesn't need a matrix at all
+    bool isIdentity(unsigned int node) const {
+        const glm::mat4& m = worlds[node];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                if (m[c][r] != (c == r ? 1.0f : 0.0f))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static const unsigned int NONE_DIRTY = ~0u;
+
+    vector<int> parents;
+    vector<glm::mat4> locals;
+    vector<glm::mat4> worlds;
+    vector<uint8_t> dirty;      // local matrix changed since the last update
+    vector<uint8_t> changed;    // world matrix was recomputed by the last update, tells the children to follow
+    vector<string> names;
+    unsigned int firstDirty = NONE_DIRTY;
+};
+
+#endif // !TRANSFORM_GRAPH_H
@@ -0,0 +1,155 @@
+#pragma once
+#ifndef VERTEX_COMPRESSION_H
+#define VERTEX_COMPRESSION_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// 16 byte vertex used by meshes created with VERTEX_FORMAT_COMPACT (the full Vertex is 32 bytes). Decoded in
+// modelShadersCompact.vts:
+//   Position  - xyz quantized to 16 bit relative to the mesh bounding box, read as normalized unsigned shorts and
+//               rescaled with the positionOffset/positionScale uniforms. w is padding to keep the normal 4 byte aligned.
+//   Normal    - octahedral encoding, two normalized signed shorts
+//   TexCoords - half floats
+struct CompactVertex {
+    uint16_t Position[4];
+    int16_t Normal[2];
+    uint16_t TexCoords[2];
+};
+
+// IEEE 754 binary32 -> binary16 with round to nearest even, overflow goes to infinity and NaN stays NaN
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFFu) // inf / NaN
+        return (uint16_t)(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+
+    int halfExponent = (int)exponent - 127 + 15;
+    if (halfExponent >= 31) // too big
+        return (uint16_t)(sign | 0x7C00u);
+
+    if (halfExponent <= 0) {
+        // subnormal half or zero
+        if (halfExponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++; // may carry into the exponent, which is exactly right (and gives inf at the top)
+    return (uint16_t)(sign | half);
+}
+
+inline float halfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1Fu;
+    uint32_t mantissa = value & 0x3FFu;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            // normalize the subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3FFu;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    }
+    else if (exponent == 31) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+inline int16_t floatToSnorm16(float value) {
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return (int16_t)std::lround(value * 32767.0f);
+}
+
+// maps a unit vector onto the octahedron |x|+|y|+|z| = 1 and unfolds the lower half over the upper one, giving two
+// values in [-1, 1]
+inline glm::vec2 octahedralEncode(glm::vec3 n) {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f)
+        return glm::vec2(0.0f, 0.0f); // degenerate normal, decodes to +z
+
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+// same math as octDecode in modelShadersCompact.vts
+inline glm::vec3 octahedralDecode(glm::vec2 e) {
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = n.z < 0.0f ? -n.z : 0.0f;
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// quantizes a position into [0, 65535] along each axis of the bounding box
+inline void quantizePosition(const glm::vec3& p, const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint16_t out[3]) {
+    for (int k = 0; k < 3; k++) {
+        float extent = boundsMax[k] - boundsMin[k];
+        float t = extent > 0.0f ? (p[k] - boundsMin[k]) / extent : 0.0f;
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+        out[k] = (uint16_t)std::lround(t * 65535.0f);
+    }
+}
+
+// packs full vertices into the compact layout. T is anything with Position/Normal/TexCoords members, i.e. Vertex.
+template <typename T>
+void compressVertices(const T* vertices, size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, vector<CompactVertex>& out) {
+    out.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        CompactVertex& c = out[i];
+
+        quantizePosition(vertices[i].Position, boundsMin, boundsMax, c.Position);
+        c.Position[3] = 0;
+
+        glm::vec2 oct = octahedralEncode(vertices[i].Normal);
+        c.Normal[0] = floatToSnorm16(oct.x);
+        c.Normal[1] = floatToSnorm16(oct.y);
+
+        c.TexCoords[0] = floatToHalf(vertices[i].TexCoords.x);
+        c.TexCoords[1] = floatToHalf(vertices[i].TexCoords.y);
+    }
+}
+
+#endif // !VERTEX_COMPRESSION_H
@@ -0,0 +1,166 @@
+#pragma once
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// what an instance carries besides its model matrix
+enum InstanceAttributes {
+    INSTANCE_MODEL_ONLY = 0,
+    INSTANCE_NORMAL_MATRIX = 1 << 0,    // mat3(transpose(inverse(model))), normals in world space like FragPos
+    INSTANCE_MATERIAL = 1 << 1          // an int, e.g. an index into a uniform array of colours or materials
+};
+
+// per instance vertex attributes for drawing the same geometry many times with one glDraw*Instanced call, instead of a
+// setMat4("model") and a draw per copy.
+//
+// the attributes start at the location given to attach() (3 by default, after position / normal / texture coordinates):
+//     location + 0 .. 3   mat4 model
+//     location + 4 .. 6   mat3 normalMatrix   (INSTANCE_NORMAL_MATRIX)
+//     location + 7        int material        (INSTANCE_MATERIAL)
+// so an instanced vertex shader declares e.g. "layout (location = 3) in mat4 model;" in place of the uniform.
+//
+// the instances are kept on the CPU and only go to the buffer when they changed, with one glBufferSubData for all of them.
+// Instances that don't move are uploaded once and every frame after that costs one draw call however many there are.
+// Only use it on the thread that owns the GL context, and call shutdown() (or destroy it) before the context goes away.
+class InstanceBuffer {
+public:
+    static const GLuint DEFAULT_LOCATION = 3;
+
+    explicit InstanceBuffer(unsigned int attributes = INSTANCE_MODEL_ONLY) : attributes(attributes) {
+        instanceBytes = sizeof(glm::mat4);
+        if (attributes & INSTANCE_NORMAL_MATRIX)
+            instanceBytes += sizeof(glm::mat3);
+        if (attributes & INSTANCE_MATERIAL)
+            instanceBytes += sizeof(GLint);
+    }
+
+    ~InstanceBuffer() {
+        shutdown();
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // adds the instance attributes to a vertex array, any number of vertex arrays can share the buffer. Binds the vertex
+    // array and leaves 0 bound, so do it while setting up, before a GLStateCache is in use (or invalidate it after).
+    void attach(GLuint vao, GLuint location = DEFAULT_LOCATION) {
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        size_t offset = 0;
+        for (GLuint column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(location + column);
+            glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, (GLsizei)instanceBytes, (void*)(offset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location + column, 1);
+        }
+        offset += sizeof(glm::mat4);
+
+        if (attributes & INSTANCE_NORMAL_MATRIX) {
+            for (GLuint column = 0; column < 3; column++) {
+                glEnableVertexAttribArray(location + 4 + column);
+                glVertexAttribPointer(location + 4 + column, 3, GL_FLOAT, GL_FALSE, (GLsizei)instanceBytes, (void*)(offset + column * sizeof(glm::vec3)));
+                glVertexAttribDivisor(location + 4 + column, 1);
+            }
+            offset += sizeof(glm::mat3);
+        }
+
+        if (attributes & INSTANCE_MATERIAL) {
+            glEnableVertexAttribArray(location + 7);
+            glVertexAttribIPointer(location + 7, 1, GL_INT, (GLsizei)instanceBytes, (void*)offset);
+            glVertexAttribDivisor(location + 7, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    void clear() {
+        data.clear();
+        dirty = true;
+    }
+
+    void reserve(unsigned int count) {
+        data.reserve((size_t)count * instanceBytes);
+    }
+
+    // returns the index of the new instance
+    unsigned int add(const glm::mat4& model, int material = 0) {
+        unsigned int index = size();
+        data.resize(data.size() + instanceBytes);
+        set(index, model, material);
+        return index;
+    }
+
+    void set(unsigned int index, const glm::mat4& model, int material = 0) {
+        unsigned char* instance = &data[(size_t)index * instanceBytes];
+        memcpy(instance, &model[0][0], sizeof(glm::mat4));
+        instance += sizeof(glm::mat4);
+        if (attributes & INSTANCE_NORMAL_MATRIX) {
+            glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+            memcpy(instance, &normalMatrix[0][0], sizeof(glm::mat3));
+            instance += sizeof(glm::mat3);
+        }
+        if (attributes & INSTANCE_MATERIAL) {
+            GLint value = material;
+            memcpy(instance, &value, sizeof(value));
+        }
+        dirty = true;
+    }
+
+    unsigned int size() const {
+        return (unsigned int)(data.size() / instanceBytes);
+    }
+
+    // copies the instances to the buffer if they changed since the last upload, the draws call it themselves
+    void upload() {
+        if (!dirty || buffer == 0)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (data.size() > capacity)
+            capacity = data.capacity();
+        // fresh storage every time (orphaning), so the GPU can keep reading the old instances while the new ones are written
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+        if (!data.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, data.size(), data.data());
+        dirty = false;
+    }
+
+    // draw every instance with the vertex array bound now, which has to be one this buffer is attached to
+    void drawArrays(GLenum mode, GLint first, GLsizei count) {
+        upload();
+        if (size() > 0)
+            glDrawArraysInstanced(mode, first, count, (GLsizei)size());
+    }
+
+    void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+        upload();
+        if (size() > 0)
+            glDrawElementsInstanced(mode, count, type, indices, (GLsizei)size());
+    }
+
+    // deletes the buffer, the vertex arrays it was attached to mustn't draw instanced after this
+    void shutdown() {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        capacity = 0;
+        dirty = true;
+    }
+
+private:
+    unsigned int attributes;
+    size_t instanceBytes;
+    vector<unsigned char> data;     // the instances, instanceBytes each, laid out like the buffer
+    GLuint buffer = 0;
+    size_t capacity = 0;            // bytes the buffer has storage for
+    bool dirty = true;
+};
+
+#endif // !INSTANCE_BUFFER_H
@@ -9,6 +9,8 @@
 #include "stb_image.h"
 #include "shader.h"
 #include "camera.h"
+#include "InstanceBuffer.h"
+#include "LightUniforms.h"
 
 void processInput(GLFWwindow* window);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -64,9 +66,9 @@ int main() {
 
     glEnable(GL_DEPTH_TEST); 
 
-    // call shader files
-    Shader cubeShader("shader.vts", "shader.fts");
-    Shader lightingShader("lightingShader.vts", "lightingShader.fts"); 
+    // call shader files, the instanced variants take the model matrices from an InstanceBuffer
+    Shader cubeShader("shaderInstanced.vts", "shader.fts");
+    Shader lightingShader("lightingShaderInstanced.vts", "lightingShaderInstanced.fts"); 
 
 
 
@@ -154,6 +156,7 @@ int main() {
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+
     // normal attribute
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
@@ -172,6 +175,29 @@ int main() {
     glEnableVertexAttribArray(0);
 
 
+    // set up the instances: the cubes and lights don't move, so their matrices are uploaded once and each is drawn with
+    // a single instanced draw call
+    InstanceBuffer cubeInstances(INSTANCE_NORMAL_MATRIX);
+    cubeInstances.attach(cubeVAO);
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        cubeInstances.add(model);
+    }
+
+    // each light cube picks its colour from lightColours with its material index
+    InstanceBuffer lightInstances(INSTANCE_MATERIAL);
+    lightInstances.attach(lightVAO);
+    for (unsigned int i = 0; i < 4; i++) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, lightPosition[i]);
+        model = glm::scale(model, glm::vec3(0.2f));
+        lightInstances.add(model, i);
+    }
+
 
 
     // texture:
@@ -241,6 +267,55 @@ int main() {
     cubeShader.setInt("material.specular", 1); 
     cubeShader.setInt("material.emission", 2);
 
+    lightingShader.use();
+    lightingShader.setVec3("lightColours[0]", glm::vec3(1.0, 1.0, 0.0));
+    lightingShader.setVec3("lightColours[1]", glm::vec3(1.0, 0.0, 0.0));
+    lightingShader.setVec3("lightColours[2]", glm::vec3(0.0, 0.0, 1.0));
+    lightingShader.setVec3("lightColours[3]", glm::vec3(0.0, 1.0, 0.0));
+
+    // set up the lights: they all live in LightUniforms' buffers, set once here. Only the flashlight changes in the render
+    // loop, so only its bytes are uploaded again each frame.
+    LightUniforms& lights = LightUniforms::instance();
+    lights.attach(cubeShader.ID);
+
+    DirLight dirLight;
+    dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    dirLight.ambient = glm::vec3(0.01f, 0.01f, 0.01f);
+    dirLight.diffuse = glm::vec3(0.05f, 0.05f, 0.05f);
+    dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.addDirLight(dirLight);
+
+    // same colours as the light cubes
+    glm::vec3 pointLightColours[] = {
+        glm::vec3(1.0f, 1.0f, 0.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f)
+    };
+    for (unsigned int i = 0; i < 4; i++) {
+        PointLight pointLight;
+        pointLight.position = lightPosition[i];
+        pointLight.ambient = pointLightColours[i] * 0.01f;
+        pointLight.diffuse = pointLightColours[i] * 0.8f;
+        pointLight.specular = pointLightColours[i];
+        pointLight.constant = 1.0f;
+        pointLight.linear = 0.09f;
+        pointLight.quadratic = 0.032f;
+        lights.addPointLight(pointLight);
+    }
+
+    // the flashlight, follows the camera
+    SpotLight flashlight;
+    flashlight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    flashlight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    flashlight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    flashlight.constant = 1.0f;
+    flashlight.linear = 0.09f;
+    flashlight.quadratic = 0.032f;
+    flashlight.cutOff = glm::cos(glm::radians(12.5f));
+    flashlight.outerCutOff = glm::cos(glm::radians(15.0f));
+    unsigned int flashlightIndex = lights.addSpotLight(flashlight);
+
 	// render loop
     // ---------------------------------------------------------------------------------------------------------------------------------------------------------------------
     while (!glfwWindowShouldClose(window)) {
@@ -261,60 +336,11 @@ int main() {
         cubeShader.setVec3("viewPos", camera.Position);
         cubeShader.setFloat("time", glfwGetTime() / 5);
 
-        /*
-           Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-           the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-           by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-           by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-        */
-        // directional light
-        cubeShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        cubeShader.setVec3("dirLight.ambient", 0.01f, 0.01f, 0.01f);
-        cubeShader.setVec3("dirLight.diffuse", 0.05f, 0.05f, 0.05f);
-        cubeShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        // point light 1
-        cubeShader.setVec3("pLights[0].position", lightPosition[0]);
-        cubeShader.setVec3("pLights[0].ambient", 0.01f, 0.01f, 0.0f);
-        cubeShader.setVec3("pLights[0].diffuse", 0.8f, 0.8f, 0.0f);
-        cubeShader.setVec3("pLights[0].specular", 1.0f, 1.0f, 0.0f);
-        cubeShader.setFloat("pLights[0].constant", 1.0f);
-        cubeShader.setFloat("pLights[0].linear", 0.09f);
-        cubeShader.setFloat("pLights[0].quadratic", 0.032f);
-        // point light 2
-        cubeShader.setVec3("pLights[1].position", lightPosition[1]);
-        cubeShader.setVec3("pLights[1].ambient", 0.01f, 0.0f, 0.0f);
-        cubeShader.setVec3("pLights[1].diffuse", 0.8f, 0.0f, 0.0f);
-        cubeShader.setVec3("pLights[1].specular", 1.0f, 0.0f, 0.0f);
-        cubeShader.setFloat("pLights[1].constant", 1.0f);
-        cubeShader.setFloat("pLights[1].linear", 0.09f);
-        cubeShader.setFloat("pLights[1].quadratic", 0.032f);
-        // point light 3
-        cubeShader.setVec3("pLights[2].position", lightPosition[2]);
-        cubeShader.setVec3("pLights[2].ambient", 0.0f, 0.0f, 0.01f);
-        cubeShader.setVec3("pLights[2].diffuse", 0.0f, 0.0f, 0.8f);
-        cubeShader.setVec3("pLights[2].specular", 0.0f, 0.0f, 1.0f);
-        cubeShader.setFloat("pLights[2].constant", 1.0f);
-        cubeShader.setFloat("pLights[2].linear", 0.09f);
-        cubeShader.setFloat("pLights[2].quadratic", 0.032f);
-        // point light 4
-        cubeShader.setVec3("pLights[3].position", lightPosition[3]);
-        cubeShader.setVec3("pLights[3].ambient", 0.0f, 0.01f, 0.0f);
-        cubeShader.setVec3("pLights[3].diffuse", 0.0f, 0.8f, 0.0f);
-        cubeShader.setVec3("pLights[3].specular", 0.0f, 1.0f, 0.0f);
-        cubeShader.setFloat("pLights[3].constant", 1.0f);
-        cubeShader.setFloat("pLights[3].linear", 0.09f);
-        cubeShader.setFloat("pLights[3].quadratic", 0.032f);
-        // spotLight
-        cubeShader.setVec3("spotLights.position", camera.Position);
-        cubeShader.setVec3("spotLights.direction", camera.Front);
-        cubeShader.setVec3("spotLights.ambient", 0.0f, 0.0f, 0.0f);
-        cubeShader.setVec3("spotLights.diffuse", 0.8f, 0.8f, 0.8f);
-        cubeShader.setVec3("spotLights.specular", 1.0f, 1.0f, 1.0f);
-        cubeShader.setFloat("spotLights.constant", 1.0f);
-        cubeShader.setFloat("spotLights.linear", 0.09f);
-        cubeShader.setFloat("spotLights.quadratic", 0.032f);
-        cubeShader.setFloat("spotLights.cutOff", glm::cos(glm::radians(12.5f)));
-        cubeShader.setFloat("spotLights.outerCutOff", glm::cos(glm::radians(15.0f)));
+        // move the flashlight with the camera, the other lights don't change and aren't uploaded again
+        flashlight.position = camera.Position;
+        flashlight.direction = camera.Front;
+        lights.setSpotLight(flashlightIndex, flashlight);
+        lights.upload();
 
 
         // projections transformations
@@ -328,14 +354,6 @@ int main() {
             cubeShader.setMat4("view", view);
         }
 
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);  
-        //model = glm::rotate(model, (float)glfwGetTime() * glm::radians(48.0f), glm::vec3(1.0, 1.0, 0.0));
-        cubeShader.setMat4("model", model);
-
-        glm::mat3 normalMatrix = glm::mat3(transpose(inverse(view* model)));   
-        cubeShader.setMat3("normalMatrix", normalMatrix);
-
         // diffuse
         glActiveTexture(GL_TEXTURE0); 
         glBindTexture(GL_TEXTURE_2D, diffuseMap); 
@@ -346,19 +364,9 @@ int main() {
         glActiveTexture(GL_TEXTURE2); 
         glBindTexture(GL_TEXTURE_2D, emmissionMap);
 
-        // render cube
+        // render all 10 cubes in one draw, each instance brings its own model and normal matrix
         glBindVertexArray(cubeVAO); 
-        for (unsigned int i = 0; i < 10; i++)
-        {
-            // calculate the model matrix for each object and pass it to shader before drawing
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            cubeShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
+        cubeInstances.drawArrays(GL_TRIANGLES, 0, 36);
 
          
         // draw the light source
@@ -371,29 +379,7 @@ int main() {
         }
 
         glBindVertexArray(lightVAO); 
-
-        for (unsigned int i = 0; i < 4; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, lightPosition[i]);
-            model = glm::scale(model, glm::vec3(0.2f));
-
-
-            lightingShader.setMat4("model", model);
-            
-            if (i == 0) {
-                lightingShader.setVec3("lightColour", glm::vec3(1.0, 1.0, 0.0));
-            } else if (i == 1) {
-                lightingShader.setVec3("lightColour", glm::vec3(1.0, 0.0, 0.0));
-
-            } else if (i == 2) {
-                lightingShader.setVec3("lightColour", glm::vec3(0.0, 0.0, 1.0));
-
-            } else if (i == 3) {
-                lightingShader.setVec3("lightColour", glm::vec3(0.0, 1.0, 0.0));
-            }
-         
-            glDrawArrays(GL_TRIANGLES, 0, 36);  
-        }
+        lightInstances.drawArrays(GL_TRIANGLES, 0, 36);  
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -401,6 +387,9 @@ int main() {
 
 
 	// clear memory
+    cubeInstances.shutdown();
+    lightInstances.shutdown();
+    lights.shutdown();
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &VBO);   